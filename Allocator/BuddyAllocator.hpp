@@ -0,0 +1,162 @@
+/*
+    File: BuddyAllocator.hpp
+
+    C++ adapters for my_malloc/my_free: a standard allocator, a
+    std::pmr::memory_resource, and unique_ptr deleters.
+
+*/
+
+#ifndef _BuddyAllocator_hpp_                   // include file only once
+#define _BuddyAllocator_hpp_
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+extern "C" {
+#include "my_allocator.h"
+}
+
+namespace allocator {
+
+/*--------------------------------------------------------------------------*/
+/* CLASS   BuddyAllocator<T> */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Standard allocator over the one allocator heap, so any two of them compare equal.
+
+    Memory is aligned to alignof(T), and allocations the heap can't serve throw std::bad_alloc.
+ */
+template <typename T>
+class BuddyAllocator {
+public:
+    typedef T value_type;
+
+    BuddyAllocator() noexcept {}
+
+    template <typename U>
+    BuddyAllocator(const BuddyAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t count) {
+        if(count > std::numeric_limits<unsigned int>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+
+        void* address = my_malloc_aligned((unsigned int)(count * sizeof(T)), alignof(T));
+
+        if(address == 0) {
+            throw std::bad_alloc();
+        }
+
+        return static_cast<T*>(address);
+    }
+
+    void deallocate(T* address, std::size_t) noexcept {
+        my_free(address);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const BuddyAllocator<T>&, const BuddyAllocator<U>&) noexcept { return true; }
+
+template <typename T, typename U>
+bool operator!=(const BuddyAllocator<T>&, const BuddyAllocator<U>&) noexcept { return false; }
+
+#if __cplusplus >= 201703L
+
+/*--------------------------------------------------------------------------*/
+/* CLASS   BuddyMemoryResource */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Memory resource over the allocator heap, for std::pmr containers.
+
+    The requested alignment goes to my_malloc_aligned, so over-aligned types are honoured too.
+ */
+class BuddyMemoryResource : public std::pmr::memory_resource {
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if(bytes > std::numeric_limits<unsigned int>::max()) {
+            throw std::bad_alloc();
+        }
+
+        void* address = my_malloc_aligned((unsigned int)bytes, (unsigned int)alignment);
+
+        if(address == 0) {
+            throw std::bad_alloc();
+        }
+
+        return address;
+    }
+
+    void do_deallocate(void* address, std::size_t, std::size_t) override {
+        my_free(address);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return dynamic_cast<const BuddyMemoryResource*>(&other) != nullptr;
+    }
+};
+
+/* Returns a resource shared by everything that uses the allocator heap. */
+inline BuddyMemoryResource* buddy_memory_resource() noexcept {
+    static BuddyMemoryResource resource;
+    return &resource;
+}
+
+#endif
+
+/*--------------------------------------------------------------------------*/
+/* UNIQUE_PTR DELETERS */
+/*--------------------------------------------------------------------------*/
+
+/* Runs the destructor of a T made with make_buddy_unique, then frees its memory. */
+template <typename T>
+struct BuddyDeleter {
+    void operator()(T* object) const noexcept {
+        if(object != nullptr) {
+            object->~T();
+            my_free(object);
+        }
+    }
+};
+
+/* Frees raw memory from my_malloc, with no destructor to run. */
+struct BuddyFree {
+    void operator()(void* address) const noexcept {
+        if(address != nullptr) {
+            my_free(address);
+        }
+    }
+};
+
+template <typename T>
+using buddy_unique_ptr = std::unique_ptr<T, BuddyDeleter<T> >;
+
+/* Constructs a T from ’args’ in memory from the allocator heap. Throws std::bad_alloc when out of memory. */
+template <typename T, typename... Args>
+buddy_unique_ptr<T> make_buddy_unique(Args&&... args) {
+    void* address = BuddyAllocator<T>().allocate(1);
+
+    try {
+        return buddy_unique_ptr<T>(new (address) T(std::forward<Args>(args)...));
+    } catch(...) {
+        my_free(address);
+        throw;
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,350 @@
+/*
+    File: BuddyHeap.hpp
+
+    Header-only buddy heap whose geometry is fixed at compile time. Every
+    size to order conversion is constexpr, so the hot paths fold down to
+    shifts and masks where the C engine multiplies and adds per call.
+
+*/
+
+#ifndef _BuddyHeap_hpp_                   // include file only once
+#define _BuddyHeap_hpp_
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace allocator {
+
+namespace detail {
+
+/* Bits needed to hold ’value’: 0 for 0, and n + 1 for 2^n up to 2^(n+1) - 1. */
+constexpr unsigned int bitWidth(unsigned long value) {
+    return (value == 0) ? 0 : (unsigned int)(8 * sizeof(unsigned long) - __builtin_clzl(value));
+}
+
+/* Smallest order whose blocks, 1 << (’basicBlockShift’ + order), have room past a ’headerSize’ header. */
+constexpr unsigned int minOrderForHeader(unsigned int basicBlockShift, std::size_t headerSize) {
+    return ((std::size_t(1) << basicBlockShift) > headerSize) ? 0 : 1 + minOrderForHeader(basicBlockShift + 1, headerSize);
+}
+
+}
+
+/*--------------------------------------------------------------------------*/
+/* CLASS   BuddyHeap<BasicBlockShift, MinOrder, MaxOrder> */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Buddy heap over memory handed to init(). Blocks of order i are (1 << BasicBlockShift) << i bytes, with
+    orders MinOrder to MaxOrder in use, the same unadjusted indexes the C engine keeps in its freestore.
+    Orders below are counted from MinOrder on, like the C engine's adjusted indexes.
+
+    Free blocks sit on a doubly linked list per order, so a buddy is unlinked in constant time, and a byte per
+    smallest block, at the front of the memory, records the order of the free block that starts there.
+    A bitmask of the orders with free blocks finds the one to split from with a single instruction.
+
+    Allocated memory is preceded by a 16 byte Header. The default constructor does nothing, so a heap can be a
+    plain static. Not thread safe: callers lock around it, as they do around the C engine.
+
+    {[Header]...memory...}
+ */
+template <unsigned int BasicBlockShift, unsigned int MinOrder, unsigned int MaxOrder>
+class BuddyHeap {
+public:
+    static constexpr std::size_t basicBlockSize = std::size_t(1) << BasicBlockShift;
+    static constexpr unsigned int orderCount = MaxOrder - MinOrder + 1;
+    static constexpr std::size_t headerSize = 16;
+    static constexpr unsigned int minBlockShift = BasicBlockShift + MinOrder;
+
+    /* Block size of ’order’, header included. */
+    static constexpr std::size_t sizeForOrder(unsigned int order) {
+        return std::size_t(1) << (minBlockShift + order);
+    }
+
+    static constexpr std::size_t minBlockSize = sizeForOrder(0);
+    static constexpr std::size_t maxBlockSize = sizeForOrder(orderCount - 1);
+    static constexpr std::size_t maxRequest = maxBlockSize - headerSize;
+
+    /* Smallest order whose blocks hold ’size’ bytes, header included, or orderCount if none does. */
+    static constexpr unsigned int orderForSize(std::size_t size) {
+        return (size <= minBlockSize) ? 0 : (size > maxBlockSize) ? orderCount : detail::bitWidth(size - 1) - minBlockShift;
+    }
+
+    static_assert(MinOrder <= MaxOrder, "MinOrder can't be above MaxOrder");
+    static_assert(minBlockShift + orderCount <= 8 * sizeof(std::size_t), "the largest block doesn't fit in a size_t");
+    static_assert(orderCount <= 8 * sizeof(unsigned long), "orders with free blocks are kept in one unsigned long");
+    static_assert(minBlockSize > headerSize, "the smallest block has no room past its header");
+    static_assert(orderForSize(minBlockSize) == 0 && orderForSize(maxBlockSize) == orderCount - 1, "orderForSize is off");
+    static_assert(orderCount == 1 || orderForSize(minBlockSize + 1) == 1, "orderForSize is off");
+
+    /*
+        Lays the free block map at the front of ’length’ bytes at ’memory’, and the largest blocks that fit over
+        the rest. The memory stays owned by the caller. Returns the bytes the blocks cover, or 0 if none fit.
+     */
+    std::size_t init(void* memory, std::size_t length) {
+        char* start = static_cast<char*>(memory);
+        std::size_t mapLength = length >> minBlockShift;
+
+        freeOrders = reinterpret_cast<unsigned char*>(start);
+        base = alignUp(start + mapLength, minBlockSize);
+        blockLength = (base < start + length) ? (std::size_t)(start + length - base) & ~(minBlockSize - 1) : 0;
+        nonEmptyOrders = 0;
+        freeBytes = 0;
+        splitCount = 0;
+        mergeCount = 0;
+
+        for(unsigned int order = 0; order < orderCount; order++) {
+            heads[order] = nullptr;
+        }
+
+        if(blockLength == 0) {
+            return 0;
+        }
+
+        std::memset(freeOrders, 0, mapLength);
+
+        //Largest blocks first from the start, so each one lands on a multiple of its size.
+        std::size_t offset = 0;
+
+        for(unsigned int order = orderCount; order-- > 0;) {
+            while(offset + sizeForOrder(order) <= blockLength) {
+                pushBlock(order, base + offset);
+                offset += sizeForOrder(order);
+            }
+        }
+
+        return offset;
+    }
+
+    /* Returns ’length’ bytes from the smallest order that holds them, or nullptr when out of memory. */
+    void* allocate(std::size_t length) {
+        if(length > maxRequest) {
+            return nullptr;
+        }
+
+        unsigned int order = orderForSize(length + headerSize);
+        char* block = takeBlock(order);
+
+        return (block != nullptr) ? placeHeader(block, order, length) : nullptr;
+    }
+
+    /* Same as allocate(), but the memory starts at a multiple of the power of two ’alignment’. */
+    void* allocateAligned(std::size_t length, std::size_t alignment) {
+        //Blocks start at multiples of their size, so with the header in front, the memory is already 16 byte aligned.
+        if(alignment <= headerSize) {
+            return allocate(length);
+        }
+
+        if(length > maxRequest - alignment) {
+            return nullptr;
+        }
+
+        unsigned int order = orderForSize(length + alignment + headerSize);
+        char* block = takeBlock(order);
+
+        if(block == nullptr) {
+            return nullptr;
+        }
+
+        char* memory = alignUp(block + headerSize, alignment);
+
+        return placeHeader(memory - headerSize, order, length);
+    }
+
+    /* Returns the block of ’address’ and merges it with its free buddies. Returns false if it is not an allocation. */
+    bool deallocate(void* address) {
+        Header* header = headerForAddress(address);
+
+        if(header == nullptr) {
+            return false;
+        }
+
+        unsigned int order = header->order;
+        char* block = blockForHeader(header, order);
+        header->magic = freedMagic;
+
+        while(order + 1 < orderCount) {
+            char* buddy = base + ((std::size_t)(block - base) ^ sizeForOrder(order));
+
+            if(buddy + sizeForOrder(order) > base + blockLength || freeOrders[mapIndex(buddy)] != order + 1) {
+                break;
+            }
+
+            unlinkBlock(order, reinterpret_cast<FreeBlock*>(buddy));
+            block = (buddy < block) ? buddy : block;
+            order++;
+            mergeCount++;
+        }
+
+        pushBlock(order, block);
+
+        return true;
+    }
+
+    /* Returns the bytes of the block of the allocation at ’address’, header included, or 0 if it isn't one. */
+    std::size_t blockSize(void* address) const {
+        Header* header = headerForAddress(address);
+        return (header != nullptr) ? sizeForOrder(header->order) : 0;
+    }
+
+    /* Returns the bytes the allocation at ’address’ can hold from there on, or 0 if it isn't one. */
+    std::size_t usableSize(void* address) const {
+        Header* header = headerForAddress(address);
+
+        if(header == nullptr) {
+            return 0;
+        }
+
+        return (std::size_t)((blockForHeader(header, header->order) + sizeForOrder(header->order)) - static_cast<char*>(address));
+    }
+
+    /* Returns the bytes asked for by the allocation at ’address’, or 0 if it isn't one. */
+    std::size_t requestedSize(void* address) const {
+        Header* header = headerForAddress(address);
+        return (header != nullptr) ? header->length : 0;
+    }
+
+    /* Walks the list of ’order’. Meant for stats, not for the hot path. */
+    unsigned long freeBlocks(unsigned int order) const {
+        unsigned long count = 0;
+
+        for(FreeBlock* block = (order < orderCount) ? heads[order] : nullptr; block != nullptr; block = block->next) {
+            count++;
+        }
+
+        return count;
+    }
+
+    std::size_t freeBytes;
+    unsigned long splitCount;
+    unsigned long mergeCount;
+
+private:
+    static constexpr unsigned int allocatedMagic = 0x414c4c43;     //"ALLC"
+    static constexpr unsigned int freedMagic = 0x46524545;         //"FREE"
+
+    struct Header {
+        unsigned int magic;
+        unsigned int order;
+        unsigned long length;
+    };
+
+    struct FreeBlock {
+        FreeBlock* next;
+        FreeBlock* previous;
+    };
+
+    static_assert(sizeof(Header) == headerSize, "the header has to stay 16 bytes");
+
+    static char* alignUp(char* address, std::size_t alignment) {
+        return reinterpret_cast<char*>((reinterpret_cast<std::uintptr_t>(address) + alignment - 1) & ~(std::uintptr_t)(alignment - 1));
+    }
+
+    std::size_t mapIndex(char* block) const {
+        return (std::size_t)(block - base) >> minBlockShift;
+    }
+
+    /* Blocks of an order start at multiples of its size, so masking the header's offset finds its block. */
+    char* blockForHeader(Header* header, unsigned int order) const {
+        return base + ((std::size_t)(reinterpret_cast<char*>(header) - base) & ~(sizeForOrder(order) - 1));
+    }
+
+    Header* headerForAddress(void* address) const {
+        char* memory = static_cast<char*>(address);
+
+        if(memory < base + headerSize || memory >= base + blockLength || (reinterpret_cast<std::uintptr_t>(memory) & (headerSize - 1)) != 0) {
+            return nullptr;
+        }
+
+        Header* header = reinterpret_cast<Header*>(memory - headerSize);
+
+        return (header->magic == allocatedMagic && header->order < orderCount) ? header : nullptr;
+    }
+
+    void* placeHeader(char* headerAddress, unsigned int order, std::size_t length) {
+        Header* header = reinterpret_cast<Header*>(headerAddress);
+        header->magic = allocatedMagic;
+        header->order = order;
+        header->length = length;
+
+        return headerAddress + headerSize;
+    }
+
+    void pushBlock(unsigned int order, char* address) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(address);
+        block->next = heads[order];
+        block->previous = nullptr;
+
+        if(heads[order] != nullptr) {
+            heads[order]->previous = block;
+        }
+
+        heads[order] = block;
+        nonEmptyOrders |= (1UL << order);
+        freeOrders[mapIndex(address)] = (unsigned char)(order + 1);
+        freeBytes += sizeForOrder(order);
+    }
+
+    void unlinkBlock(unsigned int order, FreeBlock* block) {
+        if(block->previous != nullptr) {
+            block->previous->next = block->next;
+        } else {
+            heads[order] = block->next;
+        }
+
+        if(block->next != nullptr) {
+            block->next->previous = block->previous;
+        }
+
+        if(heads[order] == nullptr) {
+            nonEmptyOrders &= ~(1UL << order);
+        }
+
+        freeOrders[mapIndex(reinterpret_cast<char*>(block))] = 0;
+        freeBytes -= sizeForOrder(order);
+    }
+
+    /* Takes a free block of ’target’, splitting one from the lowest order above that has one. */
+    char* takeBlock(unsigned int target) {
+        unsigned long candidates = (target < orderCount) ? (nonEmptyOrders >> target) : 0;
+
+        if(candidates == 0) {
+            return nullptr;
+        }
+
+        unsigned int order = target + (unsigned int)__builtin_ctzl(candidates);
+        FreeBlock* block = heads[order];
+        unlinkBlock(order, block);
+
+        char* address = reinterpret_cast<char*>(block);
+
+        //Keep the lower half, free the upper half.
+        while(order > target) {
+            order--;
+            pushBlock(order, address + sizeForOrder(order));
+            splitCount++;
+        }
+
+        return address;
+    }
+
+    FreeBlock* heads[orderCount];
+    unsigned long nonEmptyOrders;      //Bit set for each order with a free block.
+    unsigned char* freeOrders;         //Order + 1 of the free block starting at each smallest block, or 0.
+    char* base;
+    std::size_t blockLength;
+};
+
+/*
+    BuddyHeap for ’BasicBlockShift’ with every order the 16 byte header leaves room in, up to blocks of 2 GB.
+ */
+template <unsigned int BasicBlockShift>
+using BuddyHeapFor = BuddyHeap<BasicBlockShift, detail::minOrderForHeader(BasicBlockShift, 16), 31 - BasicBlockShift>;
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+/*
+    File: Pool.hpp
+
+    Typed C++ wrapper around the "POOL" module.
+
+*/
+
+#ifndef _Pool_hpp_                   // include file only once
+#define _Pool_hpp_
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <new>
+#include <utility>
+
+extern "C" {
+#include "pool.h"
+}
+
+/*--------------------------------------------------------------------------*/
+/* CLASS   Pool<T> */
+/*--------------------------------------------------------------------------*/
+
+namespace allocator {
+
+/*
+    Owns a pool of sizeof(T) objects, and constructs and destroys T's in it.
+
+    Destroying the Pool returns its chunks without running any destructors, so every
+    object should go through destroy() first.
+ */
+template <typename T>
+class Pool {
+public:
+    explicit Pool(unsigned int objectsPerChunk = 64)
+        : pool(pool_create(sizeof(T), objectsPerChunk)) {}
+
+    ~Pool() {
+        if(pool != 0) {
+            pool_destroy(pool);
+        }
+    }
+
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    /* Returns true if the pool itself could be allocated. */
+    bool valid() const { return pool != 0; }
+
+    /* Constructs a T from ’args’ in a pooled object. Returns nullptr when out of memory. */
+    template <typename... Args>
+    T* construct(Args&&... args) {
+        void* address = (pool != 0) ? pool_alloc(pool) : 0;
+
+        if(address == 0) {
+            return nullptr;
+        }
+
+        return new (address) T(std::forward<Args>(args)...);
+    }
+
+    /* Runs the destructor of ’object’ and gives its memory back to the pool. */
+    void destroy(T* object) {
+        if(object != nullptr) {
+            object->~T();
+            pool_free(pool, object);
+        }
+    }
+
+private:
+    static_assert(alignof(T) <= 16, "pool objects are only 16 byte aligned");
+
+    ::Pool* pool;
+};
+
+}
+
+#endif
@@ -1 +1,143 @@
-/*     File: ackerman.c    Author: R. Bettati            Department of Computer Science            Texas A&M University    Date  : 08/02/09    This file implements the function "ackerman(n,m)", which is used     by the "memtest" program in MP1. *//*--------------------------------------------------------------------------*//* DEFINES *//*--------------------------------------------------------------------------*/    /* -- (none) -- */    /*--------------------------------------------------------------------------*//* INCLUDES *//*--------------------------------------------------------------------------*/#include <stdlib.h>#include <stdio.h>#include <sys/time.h>#include <assert.h>#include "my_allocator.h"/*--------------------------------------------------------------------------*//* DATA STRUCTURES */ /*--------------------------------------------------------------------------*/    /* -- (none) -- *//*--------------------------------------------------------------------------*//* CONSTANTS *//*--------------------------------------------------------------------------*/    /* -- (none) -- *//*--------------------------------------------------------------------------*//* FORWARDS *//*--------------------------------------------------------------------------*/int ackerman(int a, int b);/* used in "ackerman_main" */void print_time_diff(struct timeval * tp1, struct timeval * tp2);/* used in "ackerman" *//*--------------------------------------------------------------------------*//* LOCAL VARIABLES *//*--------------------------------------------------------------------------*/unsigned long int num_allocations;/*--------------------------------------------------------------------------*//* EXPORTED FUNCTIONS *//*--------------------------------------------------------------------------*/extern void ackerman_main() {  /* This is function repeatedly asks the user for the two parameters     "n" and "m" to pass to the ackerman function, and invokes the function.     Before and after the invocation of the ackerman function, the      value of the wallclock is taken, and the elapsed time for the computation     of the ackerman function is output.  */      int pointerSize = sizeof(void*);  printf(" Pointer Size: %i ", pointerSize);      int n, m; /* Parameter for the invocation of the Ackerman function. */   struct timeval tp_start; /* Used to compute elapsed time. */  struct timeval tp_end;      for (;;) {    num_allocations = 0;    printf("\n");    printf("Please enter parameters n and m to ackerman function.\n");    printf("Note that this function takes a long time to compute,\n");    printf("even for small values. Keep n at or below 3, and mat or\n");    printf("below 8. Otherwise, the function takes seemingly forever.\n");    printf("Enter 0 for either n or m in order to exit.\n\n");    printf("  n = "); scanf("%d", &n);    if (!n) break;     printf("  m = "); scanf("%d", &m);    if (!m) break;    printf("      n = %d, m = %d\n", n, m);    assert(gettimeofday(&tp_start, 0) == 0);    /* Assert aborts if there is a problem with gettimeofday.       We rather die of a horrible death rather than returning       invalid timing information!     */    int result = ackerman(n, m);          assert(gettimeofday(&tp_end, 0) == 0);    /* (see above) */    printf("Result of ackerman(%d, %d): %d\n", n, m, result);     printf("Time taken for computation : ");     print_time_diff(&tp_start, &tp_end);    printf("\n");    printf("Number of allocate/free cycles: %lu\n\n\n", num_allocations);  }    printf("Reached end of Ackerman program. Thank you for using it.\n");}/*--------------------------------------------------------------------------*//* LOCAL FUNCTIONS *//*--------------------------------------------------------------------------*/void print_time_diff(struct timeval * tp1, struct timeval * tp2) {  /* Prints to stdout the difference, in seconds and museconds, between two     timevals. */  long sec = tp2->tv_sec - tp1->tv_sec;  long musec = tp2->tv_usec - tp1->tv_usec;  if (musec < 0) {    musec += 1000000;    sec--;  }  printf(" [sec = %ld, musec = %ld] ", sec, musec);}int ackerman(int a, int b) {/* This is the implementation of the Ackerman function. The function itself is very   function is very simple (just two recursive calls). We use it to exercise the   memory allocator (see "my_alloc" and "my_free").    For this, there are additional calls to "gettimeofday" to measure the elapsed   time. */      void * mem;  /* The size "to_alloc" of the region to allocate is computed randomly: */  int to_alloc =  ((2 << (rand() % 19)) * (rand() % 100)) / 100;  if  (to_alloc < 4) to_alloc = 4;  int result = 0;  mem = my_malloc(to_alloc * sizeof(char));  num_allocations++;  if (mem != NULL) {    if (a == 0)      result = b + 1;    else if (b == 0)      result = ackerman(a - 1, 1);    else      result = ackerman(a - 1, ackerman(a, b - 1) );    my_free(mem);  }      return result;}
\ No newline at end of file
+/* 
+    File: ackerman.c
+
+    Based on the MP1 ackerman driver by R. Bettati,
+    Department of Computer Science, Texas A&M University.
+
+    Modified: n and m are passed in by the caller instead of being read
+              from the keyboard, so the workload can be scripted.
+
+    Implementation of the ackerman function used by the "memtest" program.
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define MIN_ALLOCATION 4                    /* smallest buffer handed out */
+#define MAX_ALLOCATION_SHIFT 19             /* buffers range up to ~2^19 bytes */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "my_allocator.h"
+#include "ackerman.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */ 
+/*--------------------------------------------------------------------------*/
+
+    /* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* CONSTANTS */
+/*--------------------------------------------------------------------------*/
+
+static unsigned long num_allocations;       /* allocate/free cycles so far */
+static int allocation_failed;               /* set once my_malloc returns 0 */
+static int corruption_found;                /* set when a buffer lost its fill */
+
+/*--------------------------------------------------------------------------*/
+/* FORWARDS */
+/*--------------------------------------------------------------------------*/
+
+static unsigned long ackerman(unsigned long a, unsigned long b);
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS */
+/*--------------------------------------------------------------------------*/
+
+static double elapsed_seconds(struct timespec * start, struct timespec * end) {
+  return (double)(end->tv_sec - start->tv_sec) 
+       + (double)(end->tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static int buffer_is_intact(char * mem, char c, int length) {
+  /* Checks that nobody else wrote into our buffer while we recursed. */
+  for (int i = 0; i < length; i++) {
+    if (mem[i] != c) return 0;
+  }
+  return 1;
+}
+
+static unsigned long ackerman(unsigned long a, unsigned long b) {
+/* This is the implementation of the Ackerman function.
+   The function itself is very simple (just two levels of recursion).
+   We keep a buffer of random size (at least MIN_ALLOCATION bytes) 
+   allocated for the duration of every call, filled with a random
+   character, and check that it is still intact before we free it. */
+
+  unsigned long result;
+
+  if (allocation_failed || corruption_found) return 0;
+
+  char c = 'a' + rand() % 26;
+  int to_alloc = ((2 << (rand() % MAX_ALLOCATION_SHIFT)) * (rand() % 100)) / 100;
+  if (to_alloc < MIN_ALLOCATION) to_alloc = MIN_ALLOCATION;
+
+  char * mem = (char*)my_malloc(to_alloc);
+  num_allocations++;
+
+  if (mem == NULL) {
+    allocation_failed = 1;
+    return 0;
+  }
+
+  memset(mem, c, to_alloc);
+
+  if (a == 0)
+    result = b + 1;
+  else if (b == 0)
+    result = ackerman(a - 1, 1);
+  else
+    result = ackerman(a - 1, ackerman(a, b - 1));
+
+  if (!corruption_found && !buffer_is_intact(mem, c, to_alloc)) {
+    printf("ERROR> Buffer of size %d at %p was overwritten.\n", to_alloc, mem);
+    corruption_found = 1;
+  }
+
+  my_free(mem);
+
+  return result;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTION */
+/*--------------------------------------------------------------------------*/
+
+int ackerman_main(unsigned int n, unsigned int m) {
+
+  struct timespec tp_start, tp_end;
+
+  num_allocations = 0;
+  allocation_failed = 0;
+  corruption_found = 0;
+
+  printf("Computing ackerman(%u, %u)...\n", n, m);
+
+  clock_gettime(CLOCK_MONOTONIC, &tp_start);
+  unsigned long result = ackerman(n, m);
+  clock_gettime(CLOCK_MONOTONIC, &tp_end);
+
+  double seconds = elapsed_seconds(&tp_start, &tp_end);
+  double per_second = (seconds > 0) ? (num_allocations / seconds) : 0;
+
+  if (allocation_failed) {
+    printf("ERROR> ackerman(%u, %u) aborted: MEMORY ALLOCATION ERROR after %lu calls.\n", n, m, num_allocations);
+  } else if (!corruption_found) {
+    printf("Result of ackerman(%u, %u): %lu\n", n, m, result);
+  }
+
+  printf("Time taken for computation : %.6f sec\n", seconds);
+  printf("Number of calls (allocate/free cycles): %lu\n", num_allocations);
+  printf("Cycles per second: %.0f\n\n", per_second);
+
+  return (allocation_failed || corruption_found) ? 1 : 0;
+}
@@ -38,11 +38,14 @@
 /* MODULE ackerman */
 /*--------------------------------------------------------------------------*/
 
-extern void ackerman_main();
-/* Asks user for parameters n and m and computes the result of the
-   (highly recursive!) ackerman function. During every recursion step,
-   it allocates and de-allocates a portion of memory with the use of the
-   memory allocator defined in module "my_allocator.H".
+extern int ackerman_main(unsigned int n, unsigned int m);
+/* Computes the result of the (highly recursive!) ackerman function for
+   parameters n and m. During every recursion step, it allocates and 
+   de-allocates a portion of memory with the use of the memory allocator
+   defined in module "my_allocator.H".
+   Prints the result, the elapsed time, the number of recursive calls and
+   the allocate/free cycles per second. Returns 0 if everything ok, and 1
+   if an allocation failed or a buffer was found corrupted.
 */ 
 
 #endif
@@ -0,0 +1,207 @@
+/*
+    File: buddy_heap.cpp
+
+    This file contains the implementation of the module "BUDDY_HEAP".
+
+    Each basic block size has a BuddyHeap instantiation of its own, with
+    its conversions folded in at compile time. Init picks one and the
+    calls after it go straight to its functions through a table.
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define MIN_BASIC_BLOCK_SHIFT 4
+#define MAX_BASIC_BLOCK_SHIFT 12
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "BuddyHeap.hpp"
+
+extern "C" {
+#include "buddy_heap.h"
+}
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Entry points of one instantiation. Built at compile time, so nothing here needs a constructor to run,
+    and the module links into C programs without the C++ runtime.
+ */
+struct HeapFunctions {
+    std::size_t (*init)(void* memory, std::size_t length);
+    void* (*allocate)(std::size_t length);
+    void* (*allocateAligned)(std::size_t length, std::size_t alignment);
+    bool (*deallocate)(void* address);
+    std::size_t (*blockSize)(void* address);
+    std::size_t (*usableSize)(void* address);
+    std::size_t (*requestedSize)(void* address);
+    unsigned long (*freeBlocks)(unsigned int order);
+    std::size_t (*freeBytes)(void);
+    unsigned long (*splitCount)(void);
+    unsigned long (*mergeCount)(void);
+    unsigned int orderCount;
+    std::size_t minBlockSize;
+};
+
+/*--------------------------------------------------------------------------*/
+/* CONSTANTS */
+/*--------------------------------------------------------------------------*/
+
+/* -- Heaps -- */
+    template <unsigned int BasicBlockShift>
+    allocator::BuddyHeapFor<BasicBlockShift> _heap;     //Zero initialised, only the selected one is ever touched.
+
+    static const HeapFunctions* _functions;
+    static unsigned int _orderCount;                      //Orders with a block in the memory.
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS FOR MODULE BUDDY_HEAP */
+/*--------------------------------------------------------------------------*/
+
+template <unsigned int BasicBlockShift>
+struct HeapFor {
+    typedef allocator::BuddyHeapFor<BasicBlockShift> Heap;
+
+    static std::size_t init(void* memory, std::size_t length) { return _heap<BasicBlockShift>.init(memory, length); }
+    static void* allocate(std::size_t length) { return _heap<BasicBlockShift>.allocate(length); }
+    static void* allocateAligned(std::size_t length, std::size_t alignment) { return _heap<BasicBlockShift>.allocateAligned(length, alignment); }
+    static bool deallocate(void* address) { return _heap<BasicBlockShift>.deallocate(address); }
+    static std::size_t blockSize(void* address) { return _heap<BasicBlockShift>.blockSize(address); }
+    static std::size_t usableSize(void* address) { return _heap<BasicBlockShift>.usableSize(address); }
+    static std::size_t requestedSize(void* address) { return _heap<BasicBlockShift>.requestedSize(address); }
+    static unsigned long freeBlocks(unsigned int order) { return _heap<BasicBlockShift>.freeBlocks(order); }
+    static std::size_t freeBytes(void) { return _heap<BasicBlockShift>.freeBytes; }
+    static unsigned long splitCount(void) { return _heap<BasicBlockShift>.splitCount; }
+    static unsigned long mergeCount(void) { return _heap<BasicBlockShift>.mergeCount; }
+
+    static constexpr HeapFunctions functions = {
+        init, allocate, allocateAligned, deallocate, blockSize, usableSize, requestedSize, freeBlocks, freeBytes, splitCount, mergeCount,
+        Heap::orderCount, Heap::minBlockSize
+    };
+};
+
+template <unsigned int BasicBlockShift>
+constexpr HeapFunctions HeapFor<BasicBlockShift>::functions;
+
+/* Returns the functions of the instantiation for ’shift’, counting down from Shift, or nullptr if there is none. */
+template <unsigned int Shift>
+const HeapFunctions* functionsForShift(unsigned int shift) {
+    return (shift == Shift) ? &HeapFor<Shift>::functions : functionsForShift<Shift - 1>(shift);
+}
+
+template <>
+const HeapFunctions* functionsForShift<MIN_BASIC_BLOCK_SHIFT - 1>(unsigned int) {
+    return nullptr;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE BUDDY_HEAP */
+/*--------------------------------------------------------------------------*/
+
+unsigned int buddy_heap_init(Addr memory, unsigned int length, unsigned int basic_block_size) {
+
+    _functions = nullptr;
+    _orderCount = 0;
+
+    if(basic_block_size == 0 || (basic_block_size & (basic_block_size - 1)) != 0) {
+        return 0;
+    }
+
+    const HeapFunctions* functions = functionsForShift<MAX_BASIC_BLOCK_SHIFT>((unsigned int)__builtin_ctz(basic_block_size));
+
+    if(functions == nullptr) {
+        return 0;
+    }
+
+    std::size_t coveredLength = functions->init(memory, length);
+
+    if(coveredLength == 0) {
+        return 0;
+    }
+
+    _functions = functions;
+    _orderCount = 1;
+
+    //Orders past the largest block that fits are there, but never hold one.
+    while(_orderCount < functions->orderCount && (functions->minBlockSize << _orderCount) <= coveredLength) {
+        _orderCount++;
+    }
+
+    return (unsigned int)coveredLength;
+}
+
+Addr buddy_heap_malloc(unsigned int length) {
+
+    return (_functions != nullptr) ? _functions->allocate(length) : nullptr;
+}
+
+Addr buddy_heap_malloc_aligned(unsigned int length, unsigned int alignment) {
+
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return nullptr;
+    }
+
+    return (_functions != nullptr) ? _functions->allocateAligned(length, alignment) : nullptr;
+}
+
+int buddy_heap_free(Addr a) {
+
+    return (_functions != nullptr && _functions->deallocate(a)) ? 0 : 1;
+}
+
+unsigned int buddy_heap_block_size(Addr a) {
+
+    return (_functions != nullptr) ? (unsigned int)_functions->blockSize(a) : 0;
+}
+
+unsigned int buddy_heap_usable_size(Addr a) {
+
+    return (_functions != nullptr) ? (unsigned int)_functions->usableSize(a) : 0;
+}
+
+unsigned int buddy_heap_requested_size(Addr a) {
+
+    return (_functions != nullptr) ? (unsigned int)_functions->requestedSize(a) : 0;
+}
+
+unsigned int buddy_heap_header_size(void) {
+
+    return (unsigned int)allocator::BuddyHeapFor<MIN_BASIC_BLOCK_SHIFT>::headerSize;
+}
+
+unsigned int buddy_heap_order_count(void) {
+
+    return _orderCount;
+}
+
+unsigned int buddy_heap_order_size(unsigned int order) {
+
+    return (order < _orderCount) ? (unsigned int)(_functions->minBlockSize << order) : 0;
+}
+
+unsigned long buddy_heap_free_blocks(unsigned int order) {
+
+    return (order < _orderCount) ? _functions->freeBlocks(order) : 0;
+}
+
+unsigned long buddy_heap_free_bytes(void) {
+
+    return (_functions != nullptr) ? _functions->freeBytes() : 0;
+}
+
+unsigned long buddy_heap_split_count(void) {
+
+    return (_functions != nullptr) ? _functions->splitCount() : 0;
+}
+
+unsigned long buddy_heap_merge_count(void) {
+
+    return (_functions != nullptr) ? _functions->mergeCount() : 0;
+}
@@ -0,0 +1,89 @@
+/*
+    File: buddy_heap.h
+
+    C entry points to the BuddyHeap template of BuddyHeap.hpp, so the
+    compile-time specialised heap can back my_malloc/my_free and run the
+    same tests and benchmarks as the C engine.
+
+*/
+
+#ifndef _buddy_heap_h_                   // include file only once
+#define _buddy_heap_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "my_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   BUDDY_HEAP */
+/*--------------------------------------------------------------------------*/
+
+unsigned int buddy_heap_init(Addr _memory, unsigned int _length, unsigned int _basic_block_size);
+/* Picks the BuddyHeap instantiation built for ’_basic_block_size’, a
+   power of two from 16 to 4096 bytes, and lays it over the ’_length’
+   bytes at ’_memory’. The memory stays owned by the caller. Returns the
+   number of bytes the blocks cover, or 0 if the memory is too small or
+   no instantiation has that basic block size. */
+
+Addr buddy_heap_malloc(unsigned int _length);
+/* Allocates ’_length’ bytes from the smallest order that fits them.
+   Returns 0 when no block is large enough. Not thread safe. */
+
+Addr buddy_heap_malloc_aligned(unsigned int _length, unsigned int _alignment);
+/* Same as ’buddy_heap_malloc’, but the returned address is a multiple of
+   the power of two ’_alignment’. */
+
+int buddy_heap_free(Addr _a);
+/* Returns the block of ’_a’ and merges it with its free buddies. Returns
+   0 if everything ok, and 1 if ’_a’ is not an allocated block. */
+
+unsigned int buddy_heap_block_size(Addr _a);
+/* Returns the bytes held by the allocated block at ’_a’, header included,
+   or 0 if ’_a’ is not an allocated block. */
+
+unsigned int buddy_heap_usable_size(Addr _a);
+/* Returns the bytes the allocated block at ’_a’ can hold from ’_a’ on,
+   or 0 if ’_a’ is not an allocated block. */
+
+unsigned int buddy_heap_requested_size(Addr _a);
+/* Returns the bytes asked for by the allocation at ’_a’, or 0 if ’_a’
+   is not an allocated block. */
+
+unsigned int buddy_heap_header_size(void);
+/* Returns the bytes in front of every allocation. */
+
+unsigned int buddy_heap_order_count(void);
+/* Returns the number of orders with blocks in the memory, or 0 before
+   ’buddy_heap_init’. */
+
+unsigned int buddy_heap_order_size(unsigned int _order);
+/* Returns the block size of ’_order’, header included, or 0 if there is
+   no such order. */
+
+unsigned long buddy_heap_free_blocks(unsigned int _order);
+/* Returns the free blocks of ’_order’. Walks the order's list. */
+
+unsigned long buddy_heap_free_bytes(void);
+/* Returns the bytes held by free blocks. */
+
+unsigned long buddy_heap_split_count(void);
+/* Returns the number of blocks split since ’buddy_heap_init’. */
+
+unsigned long buddy_heap_merge_count(void);
+/* Returns the number of buddies merged since ’buddy_heap_init’. */
+
+#endif
@@ -0,0 +1,212 @@
+#include "BuddyAllocator.hpp"
+#include "Pool.hpp"
+#include <cstdio>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+
+#define KB * 1024
+#define MB * 1048576
+
+/*
+ C++ Header Test
+
+ Builds the C++ headers, BuddyAllocator.hpp and Pool.hpp, against the allocator and checks
+ that the memory they hand out comes from the allocator heap and goes back to it, by
+ watching the stats move.
+ Prints every check that fails, and exits with 1 if any did.
+
+ Example:
+ make cpptest && ./cpptest
+*/
+
+using namespace allocator;
+
+static unsigned int _checks;
+static unsigned int _failures;
+
+static void check(bool passed, const char* what)
+{
+    _checks++;
+
+    if(!passed)
+    {
+        _failures++;
+        printf("FAILED> %s\n", what);
+    }
+}
+
+static unsigned long allocatedBlocks()
+{
+    AllocatorStats stats;
+
+    return (my_allocator_stats(&stats) == 0) ? stats.allocatedBlocks : 0;
+}
+
+/*
+    Counts the destructors run, so a deleter can be seen to run them.
+ */
+struct Tracked {
+    static unsigned int destroyed;
+
+    int value;
+    double padding[4];
+
+    explicit Tracked(int v) : value(v) {}
+    ~Tracked() { destroyed++; }
+};
+
+unsigned int Tracked::destroyed;
+
+static void testBuddyAllocator()
+{
+    unsigned long before = allocatedBlocks();
+
+    {
+        std::vector<int, BuddyAllocator<int> > numbers;
+
+        for(int i = 0; i < 1000; i++)
+        {
+            numbers.push_back(i);
+        }
+
+        check(allocatedBlocks() > before, "vector storage comes from the allocator heap");
+        check(numbers[999] == 999, "vector keeps its values through growth");
+
+        //Nodes are a rebound allocator's, not int's.
+        std::map<int, int, std::less<int>, BuddyAllocator<std::pair<const int, int> > > squares;
+
+        for(int i = 0; i < 100; i++)
+        {
+            squares[i] = i * i;
+        }
+
+        check(squares[99] == 9801, "rebound allocator serves map nodes");
+        check(BuddyAllocator<int>() == BuddyAllocator<double>(), "any two allocators compare equal");
+    }
+
+    check(allocatedBlocks() == before, "containers give all their memory back");
+
+    bool threw = false;
+
+    try
+    {
+        BuddyAllocator<long long>().allocate(((std::size_t)1 << 62));
+    }
+    catch(const std::bad_alloc&)
+    {
+        threw = true;
+    }
+
+    check(threw, "an impossible allocation throws std::bad_alloc");
+    check(allocatedBlocks() == before, "a failed allocation holds nothing");
+}
+
+static void testMemoryResource()
+{
+    unsigned long before = allocatedBlocks();
+    std::pmr::memory_resource* resource = buddy_memory_resource();
+
+    {
+        std::pmr::vector<std::pmr::string> words(resource);
+
+        for(int i = 0; i < 50; i++)
+        {
+            words.emplace_back("a string long enough to need memory of its own");
+        }
+
+        check(allocatedBlocks() > before, "pmr containers allocate from the heap");
+        check(words.get_allocator().resource() == resource, "pmr strings inherit the resource");
+
+        void* aligned = resource->allocate(100, 256);
+
+        check(aligned != nullptr && ((unsigned long)aligned % 256) == 0, "the resource honours over-alignment");
+        resource->deallocate(aligned, 100, 256);
+    }
+
+    check(allocatedBlocks() == before, "pmr containers give all their memory back");
+    check(resource->is_equal(*buddy_memory_resource()), "the shared resource equals itself");
+    check(!resource->is_equal(*std::pmr::new_delete_resource()), "the resource differs from new/delete");
+}
+
+static void testDeleters()
+{
+    unsigned long before = allocatedBlocks();
+    unsigned int destroyed = Tracked::destroyed;
+
+    {
+        buddy_unique_ptr<Tracked> object = make_buddy_unique<Tracked>(42);
+
+        check(object->value == 42, "make_buddy_unique passes its arguments on");
+        check(allocatedBlocks() == before + 1, "make_buddy_unique allocates one block");
+
+        std::unique_ptr<char, BuddyFree> raw((char*)my_malloc(100));
+
+        check(raw != nullptr && allocatedBlocks() == before + 2, "BuddyFree owns raw my_malloc memory");
+    }
+
+    check(Tracked::destroyed == destroyed + 1, "BuddyDeleter runs the destructor");
+    check(allocatedBlocks() == before, "the deleters free their memory");
+}
+
+static void testPool()
+{
+    unsigned long before = allocatedBlocks();
+    unsigned int destroyed = Tracked::destroyed;
+
+    {
+        //pool.h's own Pool is global too, so the wrapper needs its namespace.
+        allocator::Pool<Tracked> pool(16);
+        Tracked* objects[40];
+
+        check(pool.valid(), "a pool can be created");
+
+        for(int i = 0; i < 40; i++)
+        {
+            objects[i] = pool.construct(i);
+        }
+
+        check(objects[0] != nullptr && objects[39] != nullptr && objects[39]->value == 39, "the pool constructs its objects");
+        check(((unsigned long)objects[1] % 16) == 0, "pooled objects are 16 byte aligned");
+
+        //Three chunks of 16 hold the 40 objects, on top of the pool itself.
+        unsigned long pooled = allocatedBlocks();
+        check(pooled > before && pooled <= before + 4, "the pool takes whole chunks from the heap");
+
+        for(int i = 0; i < 40; i++)
+        {
+            pool.destroy(objects[i]);
+        }
+
+        check(Tracked::destroyed == destroyed + 40, "destroy runs the destructor");
+
+        Tracked* reused = pool.construct(7);
+
+        check(allocatedBlocks() == pooled, "freed objects are reused without new chunks");
+        pool.destroy(reused);
+    }
+
+    check(allocatedBlocks() == before, "destroying the pool gives its chunks back");
+}
+
+int main()
+{
+    if(init_allocator(128, 4 MB) == 0)
+    {
+        printf("Could not initialize the allocator.\n");
+        return 1;
+    }
+
+    testBuddyAllocator();
+    testMemoryResource();
+    testDeleters();
+    testPool();
+
+    release_allocator();
+
+    printf("%u checks, %u failed\n", _checks, _failures);
+
+    return (_failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,455 @@
+#include "my_allocator.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define B * 1
+#define KB * 1024
+#define MB * 1048576
+
+/*
+ Allocator Fragmentation Simulator
+
+ Drives the allocator through a long run of allocations and frees with a mix of
+ object sizes and lifetimes, and periodically samples how much memory is lost to
+ fragmentation. Each sample is written as one CSV row so the run can be plotted.
+
+ Internal fragmentation is split into its two sources:
+    - rounding: block bytes lost to rounding each request up to 2^i * basic block size,
+      or up to its size class when those are on.
+    - header: bytes taken by the MemoryHeader in front of each allocation.
+ With size classes on, slab_idle is the slab bytes not handed out as slots.
+
+ External fragmentation is reported per order: ext_N is the fraction of free bytes that
+ sit in blocks smaller than order N, and so cannot serve a request of that order.
+ ext_demand weights those fractions by the orders the workload actually asked for.
+
+ Commands:
+ -b : Basic Block Size to use in this run.
+ -k : Memory Size in Kilobytes to use in this run.
+ -m : Memory Size in Megabytes to use in this run.
+ -n : Number of operations in millions.
+ -i : Sample interval in operations.
+ -w : Workload mix. (0 = service, 1 = request-scoped, 2 = cache-heavy)
+ -r : Random seed.
+ -l : Lazy coalescing threshold. (Default: 0, merge on every free)
+ -c : Serve small requests from size class slabs. (0 = off, 1 = on)
+ -o : Output CSV path. (Default: fragsim.csv)
+
+ Example:
+ fragsim -b 64 -m 256 -n 10 -w 0    //10 million operations of the service mix on 256MB.
+*/
+
+typedef struct Options{
+    unsigned int error;
+    unsigned int basicBlockSize;
+    unsigned int memorySize;
+    unsigned int operations;        //In millions.
+    unsigned int sampleInterval;
+    unsigned int workload;
+    unsigned int seed;
+    unsigned int lazyThreshold;
+    unsigned int sizeClasses;
+    char* outputPath;
+} Options;
+
+/*
+    A lifetime class of the workload: how often it is picked, the size range of its
+    objects (drawn log-uniformly) and its mean lifetime in operations (drawn exponentially).
+ */
+typedef struct LifetimeClass{
+    double weight;
+    unsigned int minSize;
+    unsigned int maxSize;
+    double meanLifetime;
+} LifetimeClass;
+
+#define WORKLOAD_CLASSES 4
+
+static const char* workloadNames[] = { "service", "request-scoped", "cache-heavy" };
+
+static const LifetimeClass workloads[][WORKLOAD_CLASSES] = {
+    //Service: mostly short request buffers, some session state and a slowly churning cache.
+    {
+        { 0.70, 16 B,  2 KB,   40.0 },
+        { 0.20, 64 B,  16 KB,  4000.0 },
+        { 0.09, 32 B,  4 KB,   200000.0 },
+        { 0.01, 16 KB, 256 KB, 20000.0 },
+    },
+    //Request-scoped: nearly everything dies within a few operations.
+    {
+        { 0.90, 16 B,  4 KB,   10.0 },
+        { 0.08, 1 KB,  64 KB,  100.0 },
+        { 0.02, 64 B,  1 KB,   50000.0 },
+        { 0.00, 16 B,  16 B,   1.0 },
+    },
+    //Cache-heavy: long lived entries of mixed size, interleaved with short lived lookups.
+    {
+        { 0.50, 16 B,  512 B,  20.0 },
+        { 0.40, 128 B, 8 KB,   400000.0 },
+        { 0.08, 4 KB,  64 KB,  1000000.0 },
+        { 0.02, 64 KB, 512 KB, 100000.0 },
+    },
+};
+
+/*
+    Live allocations are kept in a binary min-heap ordered by the operation they die at.
+ */
+typedef struct LiveAllocation{
+    unsigned long death;
+    unsigned int size;
+    Addr address;
+} LiveAllocation;
+
+typedef struct LiveHeap{
+    LiveAllocation* items;
+    unsigned long count;
+    unsigned long capacity;
+} LiveHeap;
+
+/*--------------------------------------------------------------------------*/
+/* RANDOM */
+/*--------------------------------------------------------------------------*/
+
+static unsigned long long randomState = 88172645463325252ULL;
+
+unsigned long long nextRandom(void)
+{
+    //xorshift64; fast and reproducible across platforms, unlike rand().
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+double nextUniform(void)
+{
+    return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+unsigned int drawSize(const LifetimeClass* lifetimeClass)
+{
+    double low = log((double)lifetimeClass->minSize);
+    double high = log((double)lifetimeClass->maxSize);
+    return (unsigned int)exp(low + (high - low) * nextUniform());
+}
+
+unsigned long drawLifetime(const LifetimeClass* lifetimeClass)
+{
+    double lifetime = -log(1.0 - nextUniform()) * lifetimeClass->meanLifetime;
+    return 1 + (unsigned long)lifetime;
+}
+
+const LifetimeClass* drawClass(const LifetimeClass* classes)
+{
+    double pick = nextUniform();
+
+    for(int i = 0; i < WORKLOAD_CLASSES - 1; i++)
+    {
+        pick -= classes[i].weight;
+        if(pick < 0){
+            return &classes[i];
+        }
+    }
+
+    return &classes[WORKLOAD_CLASSES - 1];
+}
+
+/*--------------------------------------------------------------------------*/
+/* LIVE HEAP */
+/*--------------------------------------------------------------------------*/
+
+void pushLiveAllocation(LiveHeap* heap, LiveAllocation allocation)
+{
+    if(heap->count == heap->capacity)
+    {
+        heap->capacity = (heap->capacity == 0) ? 4096 : heap->capacity * 2;
+        heap->items = realloc(heap->items, heap->capacity * sizeof(LiveAllocation));
+    }
+
+    unsigned long i = heap->count++;
+
+    while(i > 0)
+    {
+        unsigned long parent = (i - 1) / 2;
+        if(heap->items[parent].death <= allocation.death){
+            break;
+        }
+
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+
+    heap->items[i] = allocation;
+}
+
+LiveAllocation popLiveAllocation(LiveHeap* heap)
+{
+    LiveAllocation top = heap->items[0];
+    LiveAllocation last = heap->items[--heap->count];
+    unsigned long i = 0;
+
+    while(1)
+    {
+        unsigned long child = (i * 2) + 1;
+        if(child >= heap->count){
+            break;
+        }
+
+        if(child + 1 < heap->count && heap->items[child + 1].death < heap->items[child].death){
+            child += 1;
+        }
+
+        if(last.death <= heap->items[child].death){
+            break;
+        }
+
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+
+    if(heap->count > 0){
+        heap->items[i] = last;
+    }
+
+    return top;
+}
+
+/*--------------------------------------------------------------------------*/
+/* SAMPLING */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Returns the order a request of the given size lands in, using the same rounding as the allocator.
+ */
+unsigned int orderForRequest(AllocatorStats* stats, unsigned int size)
+{
+    unsigned int combinedSize = size + stats->headerSize;
+
+    for(unsigned int i = 0; i < stats->orderCount; i++)
+    {
+        if(stats->orderSize[i] >= combinedSize){
+            return i;
+        }
+    }
+
+    return stats->orderCount;
+}
+
+void writeHeader(FILE* output, AllocatorStats* stats)
+{
+    fprintf(output, "op,live,requested_bytes,block_bytes,header_bytes,rounding_bytes,internal_frag,header_frag,rounding_frag,free_bytes,largest_free,ext_demand");
+
+    for(unsigned int i = 0; i < stats->orderCount; i++)
+    {
+        fprintf(output, ",ext_%u", stats->orderSize[i]);
+    }
+
+    fprintf(output, ",failures,splits,merges,slab_bytes,slab_idle\n");
+}
+
+void writeSample(FILE* output, unsigned long operation, unsigned long requestedBytes, unsigned long* demand, unsigned long totalDemand)
+{
+    AllocatorStats stats;
+    my_allocator_stats(&stats);
+
+    //Slots don't record their length, so the requested bytes are tracked here.
+    unsigned long headerBytes = stats.headerBytes;
+    unsigned long roundingBytes = stats.allocatedBytes - requestedBytes - headerBytes;
+    double blockBytes = (stats.allocatedBytes > 0) ? (double)stats.allocatedBytes : 1.0;
+    double freeBytes = (stats.freeBytes > 0) ? (double)stats.freeBytes : 1.0;
+
+    unsigned int largestFree = 0;
+    double unusable[MAX_ALLOCATOR_ORDERS];
+    unsigned long smallerFreeBytes = 0;
+    double demandWeighted = 0;
+
+    //Free bytes in orders below i can't be handed out as order i.
+    for(unsigned int i = 0; i < stats.orderCount; i++)
+    {
+        unusable[i] = smallerFreeBytes / freeBytes;
+        smallerFreeBytes += (unsigned long)stats.freeBlocks[i] * stats.orderSize[i];
+
+        if(stats.freeBlocks[i] > 0){
+            largestFree = stats.orderSize[i];
+        }
+
+        if(totalDemand > 0){
+            demandWeighted += unusable[i] * ((double)demand[i] / totalDemand);
+        }
+    }
+
+    fprintf(output, "%lu,%lu,%lu,%lu,%lu,%lu,%.5f,%.5f,%.5f,%lu,%u,%.5f",
+            operation, stats.allocatedBlocks, requestedBytes, stats.allocatedBytes, headerBytes, roundingBytes,
+            (headerBytes + roundingBytes) / blockBytes, headerBytes / blockBytes, roundingBytes / blockBytes,
+            stats.freeBytes, largestFree, demandWeighted);
+
+    for(unsigned int i = 0; i < stats.orderCount; i++)
+    {
+        fprintf(output, ",%.5f", unusable[i]);
+    }
+
+    fprintf(output, ",%lu,%lu,%lu,%lu,%lu\n", stats.failedCount, stats.splitCount, stats.mergeCount,
+            stats.slabBytes, stats.slabBytes - stats.slotBytes);
+}
+
+/*--------------------------------------------------------------------------*/
+/* SIMULATION */
+/*--------------------------------------------------------------------------*/
+
+int runSimulation(Options options, FILE* output)
+{
+    const LifetimeClass* classes = workloads[options.workload];
+    unsigned long operations = (unsigned long)options.operations * 1000000UL;
+    unsigned long demand[MAX_ALLOCATOR_ORDERS + 1] = { 0 };
+    unsigned long totalDemand = 0;
+    unsigned long requestedBytes = 0;
+    LiveHeap heap = { 0x0, 0, 0 };
+
+    AllocatorStats stats;
+    my_allocator_stats(&stats);
+    writeHeader(output, &stats);
+
+    for(unsigned long operation = 0; operation < operations; operation++)
+    {
+        //Release everything that has reached the end of its life.
+        while(heap.count > 0 && heap.items[0].death <= operation)
+        {
+            LiveAllocation dead = popLiveAllocation(&heap);
+            my_free(dead.address);
+            requestedBytes -= dead.size;
+        }
+
+        const LifetimeClass* lifetimeClass = drawClass(classes);
+        unsigned int size = drawSize(lifetimeClass);
+        Addr address = my_malloc(size);
+
+        unsigned int order = orderForRequest(&stats, size);
+        demand[order] += 1;
+        totalDemand += 1;
+
+        if(address != 0x0)
+        {
+            LiveAllocation allocation;
+            allocation.death = operation + drawLifetime(lifetimeClass);
+            allocation.size = size;
+            allocation.address = address;
+            pushLiveAllocation(&heap, allocation);
+            requestedBytes += size;
+        }
+
+        if((operation % options.sampleInterval) == 0){
+            writeSample(output, operation, requestedBytes, demand, totalDemand);
+        }
+    }
+
+    writeSample(output, operations, requestedBytes, demand, totalDemand);
+
+    while(heap.count > 0)
+    {
+        LiveAllocation dead = popLiveAllocation(&heap);
+        my_free(dead.address);
+    }
+
+    free(heap.items);
+    return 0;
+}
+
+Options buildOptions(int argc, char ** argv)
+{
+    Options options;
+
+    options.error = 0;
+    options.basicBlockSize = 64 B;
+    options.memorySize = 256 MB;
+    options.operations = 1;
+    options.sampleInterval = 10000;
+    options.workload = 0;
+    options.seed = 1;
+    options.lazyThreshold = 0;
+    options.sizeClasses = 0;
+    options.outputPath = "fragsim.csv";
+
+    for (int i = 1; i < argc; i += 2)
+    {
+        char* p = argv[i];
+
+        // if option does not start from dash or is missing its value, report an error
+        if (*p != '-' || (i + 1) >= argc){
+            options.error = 1;
+            return options;
+        }
+
+        switch (p[1]) // switch on whatever comes after dash
+        {
+            case 'b': options.basicBlockSize = atoi(argv[i+1]); break;
+            case 'k': options.memorySize = (atoi(argv[i+1]) KB); break;
+            case 'm': options.memorySize = (atoi(argv[i+1]) MB); break;
+            case 'n': options.operations = atoi(argv[i+1]); break;
+            case 'i': options.sampleInterval = atoi(argv[i+1]); break;
+            case 'w': options.workload = atoi(argv[i+1]); break;
+            case 'r': options.seed = atoi(argv[i+1]); break;
+            case 'l': options.lazyThreshold = atoi(argv[i+1]); break;
+            case 'c': options.sizeClasses = atoi(argv[i+1]); break;
+            case 'o': options.outputPath = argv[i+1]; break;
+            default : { options.error = 1; return options; }
+        }
+    }
+
+    if(options.workload > 2 || options.sampleInterval == 0){
+        options.error = 1;
+    }
+
+    return options;
+}
+
+int main(int argc, char ** argv) {
+
+    Options options = buildOptions(argc, argv);
+
+    if(options.error)
+    {
+        printf("Allocator Fragmentation Simulator\n\n");
+        printf("Commands: \n");
+        printf("-b : Basic Block Size to use in this run.\n");
+        printf("-k : Memory Size in Kilobytes to use in this run.\n");
+        printf("-m : Memory Size in Megabytes to use in this run.\n");
+        printf("-n : Number of operations in millions.\n");
+        printf("-i : Sample interval in operations.\n");
+        printf("-w : Workload mix. (0 = service, 1 = request-scoped, 2 = cache-heavy)\n");
+        printf("-r : Random seed.\n");
+        printf("-l : Lazy coalescing threshold. (Default: 0, merge on every free)\n");
+        printf("-c : Serve small requests from size class slabs. (0 = off, 1 = on)\n");
+        printf("-o : Output CSV path. (Default: fragsim.csv)\n");
+        printf("Example: fragsim -b 64 -m 256 -n 10 -w 0\n");
+        return 1;
+    }
+
+    FILE* output = fopen(options.outputPath, "w");
+
+    if(output == 0x0)
+    {
+        printf("ERROR> Could not open '%s' for writing.\n", options.outputPath);
+        return 1;
+    }
+
+    printf("fragsim options:\n - memory: ~%d KB\n - block size: %d B\n - operations: %dM\n - workload: %s\n - output: %s\n\n",
+           options.memorySize / 1024, options.basicBlockSize, options.operations, workloadNames[options.workload], options.outputPath);
+
+    randomState ^= ((unsigned long long)options.seed * 0x9E3779B97F4A7C15ULL);
+
+    if(init_allocator(options.basicBlockSize, options.memorySize) == 0)
+    {
+        printf("ERROR> Could not initialize the allocator.\n");
+        fclose(output);
+        return 1;
+    }
+
+    my_allocator_set_lazy_coalescing(options.lazyThreshold);
+    my_allocator_set_size_classes(options.sizeClasses);
+    runSimulation(options, output);
+
+    release_allocator();
+    fclose(output);
+    return 0;
+}
@@ -0,0 +1,380 @@
+/*
+    File: heap_profiler.c
+
+    This file contains the implementation of the module "HEAP_PROFILER".
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define EMPTY_ADDRESS 0x0
+
+#define PROFILE_MAX_DEPTH 32                //Frames kept per call site.
+#define PROFILE_SKIP_FRAMES 3               //recordSample, heap_profiler_malloc and my_malloc, which every stack starts with.
+#define PROFILE_SITE_BUCKETS 1024
+#define PROFILE_SAMPLE_BUCKETS 4096
+#define PROFILE_MAPS_PATH "/proc/self/maps"
+
+typedef enum { false, true } bool;
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <execinfo.h>
+#include "heap_profiler.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/*
+    One call stack that sampled allocations came from, with the sampled bytes that are still live and that were
+    ever allocated there. Sites are never removed, so their cumulative bytes last the whole run.
+ */
+typedef struct ProfileSite {
+    struct ProfileSite* nextSite;
+    unsigned long hash;
+    unsigned int depth;
+    void* frames[PROFILE_MAX_DEPTH];
+    unsigned long liveCount;
+    unsigned long liveBytes;
+    unsigned long totalCount;
+    unsigned long totalBytes;
+} ProfileSite;
+
+/*
+    A sampled allocation that hasn't been freed yet, keyed by its address.
+ */
+typedef struct ProfileSample {
+    struct ProfileSample* nextSample;
+    Addr address;
+    unsigned long length;
+    ProfileSite* site;
+} ProfileSample;
+
+/*--------------------------------------------------------------------------*/
+/* CONSTANTS */
+/*--------------------------------------------------------------------------*/
+
+/* -- Sampling -- */
+    static unsigned long _sampleRate;                               //Mean bytes between samples. 0 when off.
+    static __thread long _bytesUntilSample;
+    static __thread unsigned long _randomState;                     //xorshift state, seeded on first use.
+
+/* -- Tables -- */
+    static pthread_mutex_t _profileLock = PTHREAD_MUTEX_INITIALIZER;
+    static ProfileSite* _sites[PROFILE_SITE_BUCKETS];
+    static ProfileSample* _samples[PROFILE_SAMPLE_BUCKETS];
+    static unsigned long _liveSamples;
+
+/*--------------------------------------------------------------------------*/
+/* FORWARDS */
+/*--------------------------------------------------------------------------*/
+
+long nextSampleGap(void);
+unsigned long hashForFrames(void** frames, unsigned int depth);
+unsigned int sampleBucketForAddress(Addr address);
+ProfileSite* siteForFrames(void** frames, unsigned int depth);
+void recordSample(Addr address, unsigned long length);
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS FOR MODULE HEAP_PROFILER */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Draws the bytes to allocate before the next sample, exponentially distributed around the rate.
+    Sampling that way is what lets pprof scale the samples back up to the real bytes.
+ */
+long nextSampleGap(void)
+{
+    if(_randomState == 0)
+    {
+        _randomState = ((unsigned long)&_randomState * 2654435761UL) | 1;
+    }
+
+    _randomState ^= _randomState << 13;
+    _randomState ^= _randomState >> 7;
+    _randomState ^= _randomState << 17;
+
+    //53 random bits, in (0, 1].
+    double uniform = ((_randomState >> 11) + 1.0) / 9007199254740992.0;
+    double gap = -log(uniform) * _sampleRate;
+
+    return (long)gap + 1;
+}
+
+unsigned long hashForFrames(void** frames, unsigned int depth)
+{
+    unsigned long hash = 14695981039346656037UL;
+
+    for(unsigned int i = 0; i < depth; i++)
+    {
+        hash = (hash ^ (unsigned long)frames[i]) * 1099511628211UL;
+    }
+
+    return hash;
+}
+
+unsigned int sampleBucketForAddress(Addr address)
+{
+    //Allocations are at least 16 bytes apart, so the low bits carry nothing.
+    return (unsigned int)(((unsigned long)address >> 4) % PROFILE_SAMPLE_BUCKETS);
+}
+
+/*
+    Returns the site for the stack, adding it the first time it is seen. The caller holds the lock.
+ */
+ProfileSite* siteForFrames(void** frames, unsigned int depth)
+{
+    unsigned long hash = hashForFrames(frames, depth);
+    unsigned int bucket = (unsigned int)(hash % PROFILE_SITE_BUCKETS);
+
+    for(ProfileSite* site = _sites[bucket]; site != EMPTY_ADDRESS; site = site->nextSite)
+    {
+        if(site->hash != hash || site->depth != depth)
+        {
+            continue;
+        }
+
+        unsigned int i = 0;
+
+        while(i < depth && site->frames[i] == frames[i])
+        {
+            i++;
+        }
+
+        if(i == depth)
+        {
+            return site;
+        }
+    }
+
+    //The tables live in the C heap, so profiling never takes memory from the allocator it watches.
+    ProfileSite* site = calloc(1, sizeof(ProfileSite));
+
+    if(site == EMPTY_ADDRESS)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    site->hash = hash;
+    site->depth = depth;
+
+    for(unsigned int i = 0; i < depth; i++)
+    {
+        site->frames[i] = frames[i];
+    }
+
+    site->nextSite = _sites[bucket];
+    _sites[bucket] = site;
+
+    return site;
+}
+
+/*
+    Takes the stack of the allocation and adds it to its site, and to the live samples.
+ */
+void recordSample(Addr address, unsigned long length)
+{
+    void* frames[PROFILE_MAX_DEPTH + PROFILE_SKIP_FRAMES];
+    int depth = backtrace(frames, PROFILE_MAX_DEPTH + PROFILE_SKIP_FRAMES);
+
+    if(depth <= PROFILE_SKIP_FRAMES)
+    {
+        return;
+    }
+
+    ProfileSample* sample = malloc(sizeof(ProfileSample));
+
+    if(sample == EMPTY_ADDRESS)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&_profileLock);
+
+    ProfileSite* site = siteForFrames(&frames[PROFILE_SKIP_FRAMES], (unsigned int)(depth - PROFILE_SKIP_FRAMES));
+
+    if(site == EMPTY_ADDRESS)
+    {
+        pthread_mutex_unlock(&_profileLock);
+        free(sample);
+        return;
+    }
+
+    site->liveCount += 1;
+    site->liveBytes += length;
+    site->totalCount += 1;
+    site->totalBytes += length;
+
+    unsigned int bucket = sampleBucketForAddress(address);
+
+    sample->address = address;
+    sample->length = length;
+    sample->site = site;
+    sample->nextSample = _samples[bucket];
+    _samples[bucket] = sample;
+
+    __atomic_add_fetch(&_liveSamples, 1, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&_profileLock);
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE HEAP_PROFILER */
+/*--------------------------------------------------------------------------*/
+
+void heap_profiler_set_rate(unsigned long rate) {
+
+    _sampleRate = rate;
+    _bytesUntilSample = 0;      //Other threads draw a new gap once their current one runs out.
+}
+
+void heap_profiler_malloc(Addr address, unsigned int length) {
+
+    if(_sampleRate == 0 || address == EMPTY_ADDRESS)
+    {
+        return;
+    }
+
+    //A thread's first allocation only draws its first gap.
+    if(_bytesUntilSample == 0)
+    {
+        _bytesUntilSample = nextSampleGap();
+    }
+
+    _bytesUntilSample -= length;
+
+    if(_bytesUntilSample > 0)
+    {
+        return;
+    }
+
+    _bytesUntilSample = nextSampleGap();
+    recordSample(address, length);
+}
+
+void heap_profiler_free(Addr address) {
+
+    if(__atomic_load_n(&_liveSamples, __ATOMIC_RELAXED) == 0 || address == EMPTY_ADDRESS)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&_profileLock);
+
+    ProfileSample** link = &_samples[sampleBucketForAddress(address)];
+
+    while(*link != EMPTY_ADDRESS && (*link)->address != address)
+    {
+        link = &(*link)->nextSample;
+    }
+
+    ProfileSample* sample = *link;
+
+    if(sample != EMPTY_ADDRESS)
+    {
+        *link = sample->nextSample;
+        sample->site->liveCount -= 1;
+        sample->site->liveBytes -= sample->length;
+        __atomic_sub_fetch(&_liveSamples, 1, __ATOMIC_RELAXED);
+    }
+
+    pthread_mutex_unlock(&_profileLock);
+
+    free(sample);
+}
+
+void heap_profiler_release_all(void) {
+
+    pthread_mutex_lock(&_profileLock);
+
+    for(unsigned int i = 0; i < PROFILE_SAMPLE_BUCKETS; i++)
+    {
+        while(_samples[i] != EMPTY_ADDRESS)
+        {
+            ProfileSample* sample = _samples[i];
+            _samples[i] = sample->nextSample;
+
+            sample->site->liveCount -= 1;
+            sample->site->liveBytes -= sample->length;
+            free(sample);
+        }
+    }
+
+    __atomic_store_n(&_liveSamples, 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&_profileLock);
+}
+
+int heap_profiler_dump(const char* path) {
+
+    FILE* file = fopen(path, "w");
+
+    if(file == EMPTY_ADDRESS)
+    {
+        return 1;
+    }
+
+    pthread_mutex_lock(&_profileLock);
+
+    unsigned long liveCount = 0, liveBytes = 0, totalCount = 0, totalBytes = 0;
+
+    for(unsigned int i = 0; i < PROFILE_SITE_BUCKETS; i++)
+    {
+        for(ProfileSite* site = _sites[i]; site != EMPTY_ADDRESS; site = site->nextSite)
+        {
+            liveCount += site->liveCount;
+            liveBytes += site->liveBytes;
+            totalCount += site->totalCount;
+            totalBytes += site->totalBytes;
+        }
+    }
+
+    //Sampled counts as they are; pprof unsamples them with the rate in the header.
+    fprintf(file, "heap profile: %6lu: %8lu [%6lu: %8lu] @ heap_v2/%lu\n", liveCount, liveBytes, totalCount, totalBytes, _sampleRate);
+
+    for(unsigned int i = 0; i < PROFILE_SITE_BUCKETS; i++)
+    {
+        for(ProfileSite* site = _sites[i]; site != EMPTY_ADDRESS; site = site->nextSite)
+        {
+            fprintf(file, "%6lu: %8lu [%6lu: %8lu] @", site->liveCount, site->liveBytes, site->totalCount, site->totalBytes);
+
+            for(unsigned int frame = 0; frame < site->depth; frame++)
+            {
+                fprintf(file, " %p", site->frames[frame]);
+            }
+
+            fprintf(file, "\n");
+        }
+    }
+
+    pthread_mutex_unlock(&_profileLock);
+
+    //pprof needs the mappings to turn the addresses back into symbols.
+    fprintf(file, "\nMAPPED_LIBRARIES:\n");
+
+    FILE* maps = fopen(PROFILE_MAPS_PATH, "r");
+
+    if(maps != EMPTY_ADDRESS)
+    {
+        char buffer[4096];
+        size_t count;
+
+        while((count = fread(buffer, 1, sizeof(buffer), maps)) > 0)
+        {
+            fwrite(buffer, 1, count, file);
+        }
+
+        fclose(maps);
+    }
+
+    return (fclose(file) == 0) ? 0 : 1;
+}
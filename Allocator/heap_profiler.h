@@ -0,0 +1,61 @@
+/*
+    File: heap_profiler.h
+
+    Samples allocations about once every so many bytes, and keeps the bytes
+    allocated and still live per call site, for pprof.
+
+*/
+
+#ifndef _heap_profiler_h_                   // include file only once
+#define _heap_profiler_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "my_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   HEAP_PROFILER */
+/*--------------------------------------------------------------------------*/
+
+void heap_profiler_set_rate(unsigned long _rate);
+/* Samples an allocation about once every ’_rate’ bytes allocated, on
+   each thread. The gaps are drawn from an exponential distribution, so
+   allocations of every size get their fair chance of being sampled. A
+   ’_rate’ of 0 stops sampling; allocations already sampled are still
+   tracked until they are freed. */
+
+void heap_profiler_malloc(Addr _a, unsigned int _length);
+/* Counts ’_length’ bytes allocated at ’_a’ against the calling thread’s
+   sampling gap, and records the call stack if it is used up. Meant to be
+   called from ’my_malloc’ itself: the frames of the profiler and of its
+   caller are left out of the stack. */
+
+void heap_profiler_free(Addr _a);
+/* Takes ’_a’ out of the live bytes of its call site, if it was sampled.
+   Costs a single check while nothing sampled is live. */
+
+void heap_profiler_release_all(void);
+/* Forgets every live sample, as when the whole heap goes away at once.
+   Bytes allocated so far stay in the profile. */
+
+int heap_profiler_dump(const char* _path);
+/* Writes the sampled live and cumulative bytes per call site to
+   ’_path’ in the legacy pprof heap format (heap_v2), followed by the
+   process mappings pprof needs to symbolize it. Returns 0 if everything
+   ok, and 1 if the file couldn’t be written. */
+
+#endif
@@ -0,0 +1,328 @@
+/*
+    File: large_allocations.c
+
+    This file contains the implementation of the module "LARGE_ALLOCATIONS".
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE                         //mremap
+
+#define EMPTY_ADDRESS 0x0
+
+#define LARGE_BUCKETS 1024
+
+typedef enum { false, true } bool;
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "large_allocations.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/*
+    One mapping, which starts right at the memory handed out. Kept in the C heap, so nothing is written
+    into the mapping itself, and a pointer that isn't in the table is never read from.
+ */
+typedef struct LargeAllocation {
+    struct LargeAllocation* nextAllocation;
+    Addr address;
+    unsigned long length;                   //Mapped bytes, a whole number of pages.
+} LargeAllocation;
+
+/*--------------------------------------------------------------------------*/
+/* CONSTANTS */
+/*--------------------------------------------------------------------------*/
+
+/* -- Table -- */
+    static pthread_mutex_t _largeLock = PTHREAD_MUTEX_INITIALIZER;
+    static LargeAllocation* _allocations[LARGE_BUCKETS];
+    static unsigned long _allocationCount;
+    static unsigned long _allocationBytes;
+
+/*--------------------------------------------------------------------------*/
+/* FORWARDS */
+/*--------------------------------------------------------------------------*/
+
+unsigned long pageSize(void);
+unsigned long pageAlignedLength(unsigned long length);
+unsigned int bucketForAddress(Addr address);
+LargeAllocation** linkForAddress(Addr address);
+Addr mapAligned(unsigned long length, unsigned long alignment);
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS FOR MODULE LARGE_ALLOCATIONS */
+/*--------------------------------------------------------------------------*/
+
+unsigned long pageSize(void)
+{
+    return (unsigned long)sysconf(_SC_PAGESIZE);
+}
+
+/*
+    Returns the length rounded up to whole pages, or 0 if that overflows.
+ */
+unsigned long pageAlignedLength(unsigned long length)
+{
+    unsigned long page = pageSize();
+
+    if(length == 0 || length > (~0UL - page))
+    {
+        return 0;
+    }
+
+    return (length + page - 1) & ~(page - 1);
+}
+
+unsigned int bucketForAddress(Addr address)
+{
+    //Mappings start on pages, so the low bits carry nothing.
+    return (unsigned int)(((unsigned long)address / pageSize()) % LARGE_BUCKETS);
+}
+
+/*
+    Returns the link that points at the allocation starting at the address, or at EMPTY_ADDRESS if there is none.
+    The caller holds the lock.
+ */
+LargeAllocation** linkForAddress(Addr address)
+{
+    LargeAllocation** link = &_allocations[bucketForAddress(address)];
+
+    while(*link != EMPTY_ADDRESS && (*link)->address != address)
+    {
+        link = &(*link)->nextAllocation;
+    }
+
+    return link;
+}
+
+/*
+    Maps the page aligned length at a multiple of the alignment. Mappings already start on a page, so a larger
+    alignment maps that much more, and unmaps what is left over on either side.
+ */
+Addr mapAligned(unsigned long length, unsigned long alignment)
+{
+    unsigned long slack = (alignment > pageSize()) ? alignment : 0;
+
+    if(length > (~0UL - slack))
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    Addr mapping = mmap(EMPTY_ADDRESS, length + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(mapping == MAP_FAILED)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    if(slack == 0)
+    {
+        return mapping;
+    }
+
+    Addr address = (Addr)(((unsigned long)mapping + alignment - 1) & ~(alignment - 1));
+    unsigned long leading = (unsigned long)(address - mapping);
+
+    if(leading > 0)
+    {
+        munmap(mapping, leading);
+    }
+
+    if(slack - leading > 0)
+    {
+        munmap(address + length, slack - leading);
+    }
+
+    return address;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE LARGE_ALLOCATIONS */
+/*--------------------------------------------------------------------------*/
+
+Addr large_malloc(unsigned long length, unsigned int alignment) {
+
+    unsigned long mappedLength = pageAlignedLength(length);
+    LargeAllocation* allocation = malloc(sizeof(LargeAllocation));
+
+    if(mappedLength == 0 || allocation == EMPTY_ADDRESS)
+    {
+        free(allocation);
+        return EMPTY_ADDRESS;
+    }
+
+    Addr address = mapAligned(mappedLength, alignment);
+
+    if(address == EMPTY_ADDRESS)
+    {
+        free(allocation);
+        return EMPTY_ADDRESS;
+    }
+
+    allocation->address = address;
+    allocation->length = mappedLength;
+
+    pthread_mutex_lock(&_largeLock);
+
+    unsigned int bucket = bucketForAddress(address);
+    allocation->nextAllocation = _allocations[bucket];
+    _allocations[bucket] = allocation;
+
+    __atomic_add_fetch(&_allocationCount, 1, __ATOMIC_RELAXED);
+    _allocationBytes += mappedLength;
+
+    pthread_mutex_unlock(&_largeLock);
+
+    return address;
+}
+
+int large_free(Addr address) {
+
+    if(__atomic_load_n(&_allocationCount, __ATOMIC_RELAXED) == 0 || address == EMPTY_ADDRESS)
+    {
+        return 1;
+    }
+
+    pthread_mutex_lock(&_largeLock);
+
+    LargeAllocation** link = linkForAddress(address);
+    LargeAllocation* allocation = *link;
+
+    if(allocation != EMPTY_ADDRESS)
+    {
+        *link = allocation->nextAllocation;
+        __atomic_sub_fetch(&_allocationCount, 1, __ATOMIC_RELAXED);
+        _allocationBytes -= allocation->length;
+    }
+
+    pthread_mutex_unlock(&_largeLock);
+
+    if(allocation == EMPTY_ADDRESS)
+    {
+        return 1;
+    }
+
+    munmap(allocation->address, allocation->length);
+    free(allocation);
+
+    return 0;
+}
+
+Addr large_realloc(Addr address, unsigned long length) {
+
+    unsigned long mappedLength = pageAlignedLength(length);
+
+    if(mappedLength == 0)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    pthread_mutex_lock(&_largeLock);
+
+    LargeAllocation** link = linkForAddress(address);
+    LargeAllocation* allocation = *link;
+
+    if(allocation == EMPTY_ADDRESS)
+    {
+        pthread_mutex_unlock(&_largeLock);
+        return EMPTY_ADDRESS;
+    }
+
+    if(allocation->length == mappedLength)
+    {
+        pthread_mutex_unlock(&_largeLock);
+        return address;
+    }
+
+    Addr newAddress = mremap(allocation->address, allocation->length, mappedLength, MREMAP_MAYMOVE);
+
+    if(newAddress == MAP_FAILED)
+    {
+        pthread_mutex_unlock(&_largeLock);
+        return EMPTY_ADDRESS;
+    }
+
+    _allocationBytes += mappedLength;
+    _allocationBytes -= allocation->length;
+    allocation->length = mappedLength;
+
+    //A moved mapping hashes to another bucket.
+    if(newAddress != address)
+    {
+        *link = allocation->nextAllocation;
+        allocation->address = newAddress;
+
+        unsigned int bucket = bucketForAddress(newAddress);
+        allocation->nextAllocation = _allocations[bucket];
+        _allocations[bucket] = allocation;
+    }
+
+    pthread_mutex_unlock(&_largeLock);
+
+    return newAddress;
+}
+
+unsigned long large_usable_size(Addr address) {
+
+    if(__atomic_load_n(&_allocationCount, __ATOMIC_RELAXED) == 0 || address == EMPTY_ADDRESS)
+    {
+        return 0;
+    }
+
+    pthread_mutex_lock(&_largeLock);
+
+    LargeAllocation* allocation = *linkForAddress(address);
+    unsigned long length = (allocation != EMPTY_ADDRESS) ? allocation->length : 0;
+
+    pthread_mutex_unlock(&_largeLock);
+
+    return length;
+}
+
+unsigned long large_count(void) {
+
+    return __atomic_load_n(&_allocationCount, __ATOMIC_RELAXED);
+}
+
+unsigned long large_bytes(void) {
+
+    pthread_mutex_lock(&_largeLock);
+    unsigned long bytes = _allocationBytes;
+    pthread_mutex_unlock(&_largeLock);
+
+    return bytes;
+}
+
+void large_release_all(void) {
+
+    pthread_mutex_lock(&_largeLock);
+
+    for(unsigned int i = 0; i < LARGE_BUCKETS; i++)
+    {
+        while(_allocations[i] != EMPTY_ADDRESS)
+        {
+            LargeAllocation* allocation = _allocations[i];
+            _allocations[i] = allocation->nextAllocation;
+
+            munmap(allocation->address, allocation->length);
+            free(allocation);
+        }
+    }
+
+    __atomic_store_n(&_allocationCount, 0, __ATOMIC_RELAXED);
+    _allocationBytes = 0;
+
+    pthread_mutex_unlock(&_largeLock);
+}
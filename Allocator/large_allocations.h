@@ -0,0 +1,63 @@
+/*
+    File: large_allocations.h
+
+    Allocations too large for the buddy blocks, each in a mapping of its
+    own, tracked in a small hash so my_free can tell them apart.
+
+*/
+
+#ifndef _large_allocations_h_                   // include file only once
+#define _large_allocations_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "my_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   LARGE_ALLOCATIONS */
+/*--------------------------------------------------------------------------*/
+
+Addr large_malloc(unsigned long _length, unsigned int _alignment);
+/* Maps ’_length’ bytes, rounded up to whole pages, and returns their
+   start, a multiple of the power of two ’_alignment’ or of the page size,
+   whichever is larger. Returns 0 if the mapping failed. */
+
+int large_free(Addr _a);
+/* Unmaps the large allocation at ’_a’. Returns 0 if everything ok, and 1
+   if ’_a’ is not the start of a large allocation. */
+
+Addr large_realloc(Addr _a, unsigned long _length);
+/* Grows or shrinks the large allocation at ’_a’ to ’_length’ bytes with
+   mremap, which moves the pages instead of copying them if it can't grow
+   them in place. Returns the new start, or 0 if it couldn't, in which
+   case ’_a’ is left as it was. */
+
+unsigned long large_usable_size(Addr _a);
+/* Returns the bytes usable at ’_a’, or 0 if ’_a’ is not the start of a
+   large allocation. */
+
+unsigned long large_count(void);
+/* Returns the number of live large allocations. Cheap enough to check
+   before every free. */
+
+unsigned long large_bytes(void);
+/* Returns the bytes mapped for live large allocations. */
+
+void large_release_all(void);
+/* Unmaps every large allocation. */
+
+#endif
@@ -0,0 +1,581 @@
+/*
+    File: lockfree_buddy.c
+
+    This file contains the implementation of the module "LOCKFREE_BUDDY".
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define EMPTY_ADDRESS 0x0
+
+#define LOCKFREE_MAX_ORDERS 32
+#define LOCKFREE_ALIGNMENT 64                   //Stacks, metadata and the blocks start on cache lines of their own.
+#define LOCKFREE_HEADER_SIZE (sizeof(LockfreeHeader))
+#define EMPTY_NODE 0                            //Nodes are block index + 1, so 0 ends a stack.
+#define NO_BLOCK (~0UL)
+#define NODE_MASK 0xffffffffUL
+#define VERSION_SHIFT 32
+#define BLOCK_ALLOCATED 0x414c4c43              //"ALLC"
+#define BLOCK_RELEASED 0x46524545               //"FREE"
+#define BITMAP_WORD_BITS (8 * sizeof(unsigned long))
+
+#define alignUp(value, alignment) (((value) + (alignment) - 1) & ~((unsigned long)(alignment) - 1))
+
+typedef enum { false, true } bool;
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <string.h>
+#include "lockfree_buddy.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Every allocated block starts with its header. Free blocks carry nothing: the stacks link block numbers
+    through arrays of their own, because a block can still be on a stack after it was claimed and handed out.
+
+    {[LockfreeHeader]...memory...}
+ */
+typedef struct LockfreeHeader {
+    unsigned int state;             //BLOCK_ALLOCATED until freed, so a second free is turned away.
+    unsigned int order;
+    unsigned int blockIndex;        //Block number within its order.
+    unsigned int length;
+} LockfreeHeader;
+
+/*
+    Top node of an order's stack in the low half, and a version in the high half that every push and pop bumps.
+    Both change in one CAS, so a pop can't succeed on a head that was popped and pushed back in the meantime (ABA).
+ */
+typedef struct OrderStack {
+    unsigned long head;
+    char padding[LOCKFREE_ALIGNMENT - sizeof(unsigned long)];
+} OrderStack;
+
+/*
+    A block of an order is free when its bit in _freeBits is set. Whoever clears the bit owns the block,
+    whether to hand it out or to merge it with its buddy, so the bitmap settles every race.
+
+    The stacks are only a way to find free blocks quickly. A block is pushed when its bit in _queuedBits wasn't
+    set yet, so it's on its order's stack at most once. A pop whose block was claimed by a merge in the meantime
+    is just dropped.
+ */
+
+/*--------------------------------------------------------------------------*/
+/* CONSTANTS */
+/*--------------------------------------------------------------------------*/
+
+/* -- Definitions -- */
+    static Addr _heapStart;
+    static unsigned long _heapLength;
+    static unsigned int _minBlockSize;
+    static unsigned int _orderCount;
+    static unsigned long _blockCounts[LOCKFREE_MAX_ORDERS];
+
+/* -- Stacks -- */
+    static OrderStack _stacks[LOCKFREE_MAX_ORDERS] __attribute__((aligned(LOCKFREE_ALIGNMENT)));
+    static unsigned int* _nextNodes[LOCKFREE_MAX_ORDERS];           //Node under each block's node, while it's on the stack.
+
+/* -- Bitmaps -- */
+    static unsigned long* _freeBits[LOCKFREE_MAX_ORDERS];
+    static unsigned long* _queuedBits[LOCKFREE_MAX_ORDERS];
+
+/*--------------------------------------------------------------------------*/
+/* FORWARDS */
+/*--------------------------------------------------------------------------*/
+
+/* Geometry */
+unsigned long sizeForOrder(unsigned int order);
+unsigned int orderForLength(unsigned long length);
+Addr addressForBlock(unsigned int order, unsigned long blockIndex);
+unsigned long metadataSizeForCount(unsigned long blockCount);
+
+/* Bitmaps */
+bool testBlockBit(unsigned long* bits, unsigned long blockIndex);
+bool setBlockBit(unsigned long* bits, unsigned long blockIndex);
+bool clearBlockBit(unsigned long* bits, unsigned long blockIndex);
+
+/* Stacks */
+void pushBlock(unsigned int order, unsigned long blockIndex);
+bool popBlock(unsigned int order, unsigned long* blockIndex);
+
+/* Blocks */
+void publishBlock(unsigned int order, unsigned long blockIndex);
+bool claimBlock(unsigned int order, unsigned long blockIndex);
+unsigned long takeBlock(unsigned int order);
+void releaseBlock(unsigned int order, unsigned long blockIndex);
+Addr allocateWithHeader(unsigned int length, unsigned int alignment);
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS FOR MODULE LOCKFREE_BUDDY */
+/*--------------------------------------------------------------------------*/
+
+unsigned long sizeForOrder(unsigned int order)
+{
+    return ((unsigned long)_minBlockSize << order);
+}
+
+/*
+    Returns the smallest order whose blocks hold the length, or _orderCount if none does.
+ */
+unsigned int orderForLength(unsigned long length)
+{
+    unsigned int order = 0;
+
+    while(order < _orderCount && sizeForOrder(order) < length)
+    {
+        order++;
+    }
+
+    return order;
+}
+
+Addr addressForBlock(unsigned int order, unsigned long blockIndex)
+{
+    return (_heapStart + (blockIndex * sizeForOrder(order)));
+}
+
+/*
+    Bytes an order with the given number of blocks needs for its nodes and both bitmaps.
+ */
+unsigned long metadataSizeForCount(unsigned long blockCount)
+{
+    unsigned long words = (blockCount + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+
+    return alignUp(blockCount * sizeof(unsigned int), LOCKFREE_ALIGNMENT) + (2 * alignUp(words * sizeof(unsigned long), LOCKFREE_ALIGNMENT));
+}
+
+/* Bitmaps */
+
+bool testBlockBit(unsigned long* bits, unsigned long blockIndex)
+{
+    unsigned long word = __atomic_load_n(&bits[blockIndex / BITMAP_WORD_BITS], __ATOMIC_SEQ_CST);
+    return ((word >> (blockIndex % BITMAP_WORD_BITS)) & 1) ? true : false;
+}
+
+/*
+    Sets the bit and returns whether it was already set.
+ */
+bool setBlockBit(unsigned long* bits, unsigned long blockIndex)
+{
+    unsigned long bit = (1UL << (blockIndex % BITMAP_WORD_BITS));
+    unsigned long word = __atomic_fetch_or(&bits[blockIndex / BITMAP_WORD_BITS], bit, __ATOMIC_SEQ_CST);
+    return ((word & bit) != 0) ? true : false;
+}
+
+/*
+    Clears the bit and returns whether it was set, i.e. whether this caller is the one who cleared it.
+ */
+bool clearBlockBit(unsigned long* bits, unsigned long blockIndex)
+{
+    unsigned long bit = (1UL << (blockIndex % BITMAP_WORD_BITS));
+    unsigned long word = __atomic_fetch_and(&bits[blockIndex / BITMAP_WORD_BITS], ~bit, __ATOMIC_SEQ_CST);
+    return ((word & bit) != 0) ? true : false;
+}
+
+/* Stacks */
+
+void pushBlock(unsigned int order, unsigned long blockIndex)
+{
+    unsigned long head = __atomic_load_n(&_stacks[order].head, __ATOMIC_ACQUIRE);
+    unsigned long newHead;
+
+    do {
+        __atomic_store_n(&_nextNodes[order][blockIndex], (unsigned int)(head & NODE_MASK), __ATOMIC_RELAXED);
+        newHead = ((((head >> VERSION_SHIFT) + 1) << VERSION_SHIFT) | (blockIndex + 1));
+    } while(!__atomic_compare_exchange_n(&_stacks[order].head, &head, newHead, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+/*
+    Pops the top block of the order's stack. Returns false if the stack is empty.
+
+    The next node is read from the node array, which is always there, so reading it for a node another thread
+    just popped is harmless; the version makes the CAS fail in that case.
+ */
+bool popBlock(unsigned int order, unsigned long* blockIndex)
+{
+    unsigned long head = __atomic_load_n(&_stacks[order].head, __ATOMIC_ACQUIRE);
+
+    for(;;)
+    {
+        unsigned long node = (head & NODE_MASK);
+
+        if(node == EMPTY_NODE)
+        {
+            return false;
+        }
+
+        unsigned long nextNode = __atomic_load_n(&_nextNodes[order][node - 1], __ATOMIC_RELAXED);
+        unsigned long newHead = ((((head >> VERSION_SHIFT) + 1) << VERSION_SHIFT) | nextNode);
+
+        if(__atomic_compare_exchange_n(&_stacks[order].head, &head, newHead, true, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            *blockIndex = (node - 1);
+            return true;
+        }
+    }
+}
+
+/* Blocks */
+
+/*
+    Marks the block free, and puts it on its stack unless it's still there from an earlier time it was free.
+ */
+void publishBlock(unsigned int order, unsigned long blockIndex)
+{
+    setBlockBit(_freeBits[order], blockIndex);
+
+    if(setBlockBit(_queuedBits[order], blockIndex) == false)
+    {
+        pushBlock(order, blockIndex);
+    }
+}
+
+/*
+    Takes ownership of a free block. Returns false if it isn't free, or another thread got it first.
+ */
+bool claimBlock(unsigned int order, unsigned long blockIndex)
+{
+    return clearBlockBit(_freeBits[order], blockIndex);
+}
+
+/*
+    Claims a free block of the order, splitting one from the order above if its stack runs dry.
+
+    Returns NO_BLOCK if no order at or above has a free block.
+ */
+unsigned long takeBlock(unsigned int order)
+{
+    unsigned long blockIndex;
+
+    while(popBlock(order, &blockIndex))
+    {
+        //Off the stack now, so the next publish pushes it again. Cleared before the claim, so that publish isn't missed.
+        clearBlockBit(_queuedBits[order], blockIndex);
+
+        if(claimBlock(order, blockIndex))
+        {
+            return blockIndex;
+        }
+    }
+
+    if((order + 1) >= _orderCount)
+    {
+        return NO_BLOCK;
+    }
+
+    unsigned long parentIndex = takeBlock(order + 1);
+
+    if(parentIndex == NO_BLOCK)
+    {
+        return NO_BLOCK;
+    }
+
+    //Keep the lower half, hand the upper half to everyone else.
+    publishBlock(order, (parentIndex * 2) + 1);
+
+    return (parentIndex * 2);
+}
+
+/*
+    Frees an owned block, merging it with its buddy for as long as the buddy can be claimed.
+
+    Two buddies freed at the same time can both miss each other on the first try. So after publishing,
+    a block whose buddy is free by then is claimed back and merged, which leaves at most one of them short.
+ */
+void releaseBlock(unsigned int order, unsigned long blockIndex)
+{
+    for(;;)
+    {
+        bool mergeable = ((order + 1) < _orderCount && (blockIndex / 2) < _blockCounts[order + 1]) ? true : false;
+        unsigned long buddyIndex = (blockIndex ^ 1);
+
+        if(mergeable && claimBlock(order, buddyIndex))
+        {
+            blockIndex /= 2;
+            order += 1;
+            continue;
+        }
+
+        publishBlock(order, blockIndex);
+
+        if(mergeable && testBlockBit(_freeBits[order], buddyIndex) && claimBlock(order, blockIndex))
+        {
+            if(claimBlock(order, buddyIndex))
+            {
+                blockIndex /= 2;
+                order += 1;
+                continue;
+            }
+
+            publishBlock(order, blockIndex);
+        }
+
+        return;
+    }
+}
+
+/*
+    Takes a block large enough for the header, the length, and the slack to slide the memory up to the alignment.
+ */
+Addr allocateWithHeader(unsigned int length, unsigned int alignment)
+{
+    if(_orderCount == 0)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    unsigned long slack = (alignment > LOCKFREE_HEADER_SIZE) ? alignment : 0;
+    unsigned int order = orderForLength((unsigned long)length + LOCKFREE_HEADER_SIZE + slack);
+
+    if(order >= _orderCount)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    unsigned long blockIndex = takeBlock(order);
+
+    if(blockIndex == NO_BLOCK)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    Addr blockAddress = addressForBlock(order, blockIndex);
+    Addr memoryAddress = (blockAddress + LOCKFREE_HEADER_SIZE);
+
+    if(slack > 0)
+    {
+        memoryAddress = (Addr)alignUp((unsigned long)memoryAddress, alignment);
+    }
+
+    LockfreeHeader* header = (LockfreeHeader*)(memoryAddress - LOCKFREE_HEADER_SIZE);
+    header->order = order;
+    header->blockIndex = (unsigned int)blockIndex;
+    header->length = length;
+    __atomic_store_n(&header->state, BLOCK_ALLOCATED, __ATOMIC_RELEASE);
+
+    return memoryAddress;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE LOCKFREE_BUDDY */
+/*--------------------------------------------------------------------------*/
+
+unsigned int lockfree_init(Addr memory, unsigned int length, unsigned int basic_block_size) {
+
+    _orderCount = 0;
+
+    if(memory == EMPTY_ADDRESS || basic_block_size == 0)
+    {
+        return 0;
+    }
+
+    _minBlockSize = basic_block_size;
+
+    //Every order needs a node per block, so blocks are kept to a cache line at least; that also keeps
+    //blocks handed to different threads off each other's lines.
+    while(_minBlockSize < LOCKFREE_ALIGNMENT)
+    {
+        _minBlockSize <<= 1;
+    }
+
+    Addr metadataStart = (Addr)alignUp((unsigned long)memory, LOCKFREE_ALIGNMENT);
+    Addr memoryEnd = (memory + length);
+
+    if(metadataStart >= memoryEnd)
+    {
+        return 0;
+    }
+
+    //Sized as if the blocks covered all of the memory, which is a little more than they will.
+    unsigned long available = (unsigned long)(memoryEnd - metadataStart);
+    unsigned long metadataSize = 0;
+    unsigned int orderCount = 0;
+
+    while(orderCount < LOCKFREE_MAX_ORDERS && sizeForOrder(orderCount) <= available)
+    {
+        metadataSize += metadataSizeForCount(available / sizeForOrder(orderCount));
+        orderCount++;
+    }
+
+    _heapStart = (Addr)alignUp((unsigned long)(metadataStart + metadataSize), LOCKFREE_ALIGNMENT);
+
+    if(orderCount == 0 || _heapStart >= memoryEnd)
+    {
+        return 0;
+    }
+
+    _heapLength = (unsigned long)(memoryEnd - _heapStart);
+
+    Addr cursor = metadataStart;
+
+    for(unsigned int order = 0; order < orderCount; order++)
+    {
+        unsigned long reservedCount = (available / sizeForOrder(order));
+        unsigned long words = (reservedCount + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+
+        _nextNodes[order] = cursor;
+        cursor += alignUp(reservedCount * sizeof(unsigned int), LOCKFREE_ALIGNMENT);
+        _freeBits[order] = cursor;
+        cursor += alignUp(words * sizeof(unsigned long), LOCKFREE_ALIGNMENT);
+        _queuedBits[order] = cursor;
+        cursor += alignUp(words * sizeof(unsigned long), LOCKFREE_ALIGNMENT);
+
+        memset(_freeBits[order], 0, words * sizeof(unsigned long));
+        memset(_queuedBits[order], 0, words * sizeof(unsigned long));
+        _stacks[order].head = EMPTY_NODE;
+
+        _blockCounts[order] = (_heapLength / sizeForOrder(order));
+
+        if(_blockCounts[order] > 0)
+        {
+            _orderCount = order + 1;
+        }
+    }
+
+    if(_orderCount == 0)
+    {
+        return 0;
+    }
+
+    //Lay the largest blocks that fit from the start, then fill what's left with smaller ones.
+    unsigned long offset = 0;
+
+    for(unsigned int order = _orderCount; order-- > 0;)
+    {
+        while((offset + sizeForOrder(order)) <= _heapLength)
+        {
+            publishBlock(order, (offset / sizeForOrder(order)));
+            offset += sizeForOrder(order);
+        }
+    }
+
+    return (unsigned int)offset;
+}
+
+Addr lockfree_malloc(unsigned int length) {
+
+    return allocateWithHeader(length, 0);
+}
+
+Addr lockfree_malloc_aligned(unsigned int length, unsigned int alignment) {
+
+    return allocateWithHeader(length, alignment);
+}
+
+int lockfree_free(Addr memoryAddress) {
+
+    if(lockfree_block_size(memoryAddress) == 0)
+    {
+        return 1;
+    }
+
+    LockfreeHeader* header = (LockfreeHeader*)(memoryAddress - LOCKFREE_HEADER_SIZE);
+    unsigned int expected = BLOCK_ALLOCATED;
+
+    //Only one of two frees of the same memory gets past here.
+    if(!__atomic_compare_exchange_n(&header->state, &expected, BLOCK_RELEASED, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        return 1;
+    }
+
+    releaseBlock(header->order, header->blockIndex);
+
+    return 0;
+}
+
+unsigned int lockfree_block_size(Addr memoryAddress) {
+
+    if(_orderCount == 0 || memoryAddress < (_heapStart + LOCKFREE_HEADER_SIZE) || memoryAddress >= (_heapStart + _heapLength))
+    {
+        return 0;
+    }
+
+    //Memory always starts on a header boundary, and the header has to describe a block around it.
+    if(((unsigned long)(memoryAddress - _heapStart) % LOCKFREE_HEADER_SIZE) != 0)
+    {
+        return 0;
+    }
+
+    LockfreeHeader* header = (LockfreeHeader*)(memoryAddress - LOCKFREE_HEADER_SIZE);
+
+    if(__atomic_load_n(&header->state, __ATOMIC_ACQUIRE) != BLOCK_ALLOCATED || header->order >= _orderCount || header->blockIndex >= _blockCounts[header->order])
+    {
+        return 0;
+    }
+
+    Addr blockAddress = addressForBlock(header->order, header->blockIndex);
+
+    if((Addr)header < blockAddress || memoryAddress >= (blockAddress + sizeForOrder(header->order)))
+    {
+        return 0;
+    }
+
+    return (unsigned int)sizeForOrder(header->order);
+}
+
+unsigned int lockfree_usable_size(Addr memoryAddress) {
+
+    unsigned int blockSize = lockfree_block_size(memoryAddress);
+
+    if(blockSize == 0)
+    {
+        return 0;
+    }
+
+    LockfreeHeader* header = (LockfreeHeader*)(memoryAddress - LOCKFREE_HEADER_SIZE);
+
+    return (unsigned int)((addressForBlock(header->order, header->blockIndex) + blockSize) - memoryAddress);
+}
+
+unsigned int lockfree_requested_size(Addr memoryAddress) {
+
+    if(lockfree_block_size(memoryAddress) == 0)
+    {
+        return 0;
+    }
+
+    LockfreeHeader* header = (LockfreeHeader*)(memoryAddress - LOCKFREE_HEADER_SIZE);
+
+    return header->length;
+}
+
+unsigned int lockfree_header_size(void) {
+
+    return LOCKFREE_HEADER_SIZE;
+}
+
+unsigned int lockfree_order_count(void) {
+
+    return _orderCount;
+}
+
+unsigned int lockfree_order_size(unsigned int order) {
+
+    return (order < _orderCount) ? (unsigned int)sizeForOrder(order) : 0;
+}
+
+unsigned long lockfree_free_blocks(unsigned int order) {
+
+    if(order >= _orderCount)
+    {
+        return 0;
+    }
+
+    unsigned long count = 0;
+    unsigned long words = (_blockCounts[order] + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+
+    for(unsigned long i = 0; i < words; i++)
+    {
+        count += __builtin_popcountl(__atomic_load_n(&_freeBits[order][i], __ATOMIC_RELAXED));
+    }
+
+    return count;
+}
@@ -0,0 +1,86 @@
+/*
+    File: lockfree_buddy.h
+
+    Buddy engine behind my_malloc/my_free that takes no lock. Each order's
+    free blocks sit on a tagged Treiber stack, and blocks are claimed, split
+    and merged through atomic bitmaps.
+
+*/
+
+#ifndef _lockfree_buddy_h_                   // include file only once
+#define _lockfree_buddy_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "my_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   LOCKFREE_BUDDY */
+/*--------------------------------------------------------------------------*/
+
+unsigned int lockfree_init(Addr _memory, unsigned int _length, unsigned int _basic_block_size);
+/* Lays the stacks and bitmaps at the front of the ’_length’ bytes at
+   ’_memory’, and the buddy blocks over the rest. Blocks are
+   ’_basic_block_size’ doubled until they span a cache line at least. The
+   stacks need a node per block of every order, which takes about a
+   sixteenth of the memory with 64 byte blocks. The memory stays owned by
+   the caller. Returns the number of bytes the blocks cover, or 0 if the
+   memory is too small. Not safe to call while other threads allocate. */
+
+Addr lockfree_malloc(unsigned int _length);
+/* Allocates ’_length’ bytes from the smallest order that fits them,
+   splitting a larger block if that order has none. Safe to call from any
+   thread without a lock. Returns 0 when no block is large enough. */
+
+Addr lockfree_malloc_aligned(unsigned int _length, unsigned int _alignment);
+/* Same as ’lockfree_malloc’, but the returned address is a multiple of
+   the power of two ’_alignment’. The block is large enough to slide the
+   memory up to the alignment. */
+
+int lockfree_free(Addr _a);
+/* Returns the block of ’_a’ and merges it with its buddy on every order
+   where the buddy is free too. Safe to call from any thread without a
+   lock. Returns 0 if everything ok, and 1 if ’_a’ is not an allocated
+   block. */
+
+unsigned int lockfree_block_size(Addr _a);
+/* Returns the bytes held by the allocated block at ’_a’, header included,
+   or 0 if ’_a’ is not an allocated block. */
+
+unsigned int lockfree_usable_size(Addr _a);
+/* Returns the bytes the allocated block at ’_a’ can hold from ’_a’ on,
+   or 0 if ’_a’ is not an allocated block. */
+
+unsigned int lockfree_requested_size(Addr _a);
+/* Returns the bytes asked for by the allocation at ’_a’, or 0 if ’_a’
+   is not an allocated block. */
+
+unsigned int lockfree_header_size(void);
+/* Returns the bytes in front of every allocation. */
+
+unsigned int lockfree_order_count(void);
+/* Returns the number of orders. */
+
+unsigned int lockfree_order_size(unsigned int _order);
+/* Returns the block size of ’_order’, header included, or 0 if there is
+   no such order. */
+
+unsigned long lockfree_free_blocks(unsigned int _order);
+/* Returns the free blocks of ’_order’, read from its bitmap. Only a
+   snapshot while other threads allocate. */
+
+#endif
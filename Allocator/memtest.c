@@ -1,6 +1,16 @@
 #include "ackerman.h"
 #include "my_allocator.h"
+#include "region.h"
+#include "pool.h"
+#include "perf_counters.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/uio.h>
 
 #define B * 1
 #define KB * 1024
@@ -16,13 +26,44 @@
  -k : Memory Size in Kilobytes to use in this test.
  -m : Memory Size in Megabytes to use in this test.
  -t : Identifier of more simple test to run before ackermann memtest.
+      (1 = maw, 2 = for, 3 = recursive, 4 = region, 5 = pool, 6 = threads: x threads doing y mallocs each,
+       7 = realloc: one allocation grown from y bytes, doubling x times,
+       8 = lifetimes: x rounds of one long and 15 short lived allocations of y bytes, without and with hints,
+       9 = handles: x handles of y bytes, every other one freed, then compacted,
+       10 = wait: x blocks of y bytes allocated with my_malloc_wait while another thread frees them,
+       11 = iobuf: x rounds of a readv list of 16 I/O buffers of y bytes, allocated and freed,
+       12 = hint maintenance: x short lived hinted blocks of y bytes freed with maintenance on, then one of 256 KB timed)
  -x : First parameter of simple memtest.
  -y : Second parameter of simple memtest.
  -z : When to run the simple memtest. (Will not run if -t = 0);
+ -N : Ackermann parameter n.
+ -M : Ackermann parameter m.
+ -l : Lazy coalescing threshold. (0 merges on every free)
+ -c : Serve small requests from size class slabs. (0 = off, 1 = on)
+ -e : Engine. (0 = buddy, 1 = tlsf, 2 = buddy and tlsf, 3 = lock-free, 4 = all of them, 5 = template, 6 = buddy and template,
+      7 = tree, 8 = buddy and tree, one after the other on the same workload)
+ -n : One buddy arena of the memory size per NUMA node. (0 = off, 1 = on)
+ -f : File to keep the buddy arena in. Reused as it was left if it already holds one.
+ -r : Only reserve the buddy arena, committing it as blocks are first handed out. (0 = off, 1 = on)
+ -p : Sample an allocation about every this many bytes, and write the profile to memtest.heap. (0 = off)
+ -w : Run the buddy maintenance thread, waking up every this many microseconds. (0 = off)
+ -L : Map requests of this many bytes or more on their own. (0 = only those too large for any block)
+ -P : Count cycles, instructions, cache, dTLB and branch misses of each phase, per allocator call. (0 = off, 1 = on)
  
  
  Example: 
  memtest -b 5 -m 128   //Runs with Basic Block Size of 5 and 128MB
+ memtest -m 16 -N 3 -M 6   //Runs ackerman(3, 6) against 16MB
+ memtest -m 16 -N 3 -M 6 -e 2   //Compares both engines on ackerman(3, 6)
+ memtest -m 64 -t 6 -x 8 -y 1000000 -e 4   //Compares the engines with 8 threads, where they allow it
+ memtest -m 64 -t 6 -x 1 -y 1000000 -e 6   //Compares the C buddy engine with the compile-time specialised BuddyHeap
+ memtest -m 1 -t 7 -x 12 -y 1000 -L 65536   //Grows one allocation far past the arena with my_realloc
+ memtest -m 16 -t 8 -x 2000 -y 200   //Shows what short lived churn leaves of the largest free block, with and without hints
+ memtest -m 16 -t 9 -x 20000 -y 200   //Fragments handle memory, then compacts it in slices
+ memtest -m 1 -t 10 -x 2000 -y 60000   //Allocates far more than fits, waiting for another thread to free it
+ memtest -m 64 -t 2 -x 20 -y 1 -M 6 -N 3 -P 1   //Counts cache, TLB and branch misses per allocator call of each phase
+ memtest -m 16 -t 11 -x 10000 -y 65536   //Recycles page aligned I/O buffers for a scatter-gather read
+ memtest -m 64 -t 12 -x 33000 -y 48   //Checks maintenance leaves no merging of hinted churn to a large hinted request
 */
 
 
@@ -34,8 +75,41 @@ typedef struct Options{
     unsigned int testAfterAckermann;
     unsigned int basicBlockSize;
     unsigned int memorySize;
+    unsigned int ackermanN;
+    unsigned int ackermanM;
+    unsigned int lazyThreshold;
+    unsigned int sizeClasses;
+    unsigned int engine;
+    unsigned int numaArenas;
+    char* heapFile;
+    unsigned int reserveOnly;
+    unsigned int sampleRate;
+    unsigned int maintenanceInterval;
+    unsigned int largeThreshold;
+    unsigned int concurrent;        //Set per engine: whether my_malloc may be called from several threads.
+    unsigned int perfCounters;
 } Options;
 
+/*
+    A phase of the run, timed and, where perf_event_open allows it, counted.
+ */
+typedef struct Phase {
+    PerfSample sample;
+    unsigned long calls;            //my_malloc and my_free calls made before the phase started.
+} Phase;
+
+#define PROFILE_PATH "memtest.heap"
+
+#define ENGINE_SET_COUNT 9     //Values of -e, each a set of engines, see engineSets in main.
+
+#define THREAD_LIVE_BLOCKS 64
+#define THREAD_MAX_SIZE 512
+#define LATENCY_BUCKETS 40
+#define IO_VECTOR_LENGTH 16
+#define HINT_PROBE_LENGTH (256 KB)
+#define HINT_MAINTENANCE_INTERVAL 200   //Microseconds, when -w didn't start the maintenance thread already.
+#define HINT_PROBE_LIMIT 1000000        //Nanoseconds the large hinted request may take, far above a split and far below merging the churn.
+
 /*
     Rapidly consumes the input at a time, causing indexes to split.
  
@@ -99,6 +173,654 @@ int recursiveTest(unsigned int memory, unsigned int endingMemory)
     return 0;
 }
 
+/*
+    Fills a region with objectCount objects of objectSize bytes, then resets it, over a number of rounds.
+ 
+    Only the blocks the region chained on are returned on each reset, not the objects.
+ */
+int regionTest(unsigned int objectCount, unsigned int objectSize)
+{
+    Region* region = region_create(0);
+    
+    if(region == 0){
+        return 1;
+    }
+    
+    for(int round = 0; round < 1000; round++)
+    {
+        for(int i = 0; i < objectCount; i++)
+        {
+            if(region_alloc(region, objectSize) == 0){
+                region_destroy(region);
+                return 1;
+            }
+        }
+        
+        region_reset(region);
+    }
+    
+    region_destroy(region);
+    
+    return 0;
+}
+
+/*
+    Allocates objectCount objects of objectSize bytes from a pool, then frees them, over a number of rounds.
+ 
+    After the first round every object comes straight off the pool's free list.
+ */
+int poolTest(unsigned int objectCount, unsigned int objectSize)
+{
+    Pool* pool = pool_create(objectSize, 64);
+    Addr* objects = my_malloc(objectCount * sizeof(Addr));
+    
+    if(pool == 0 || objects == 0){
+        return 1;
+    }
+    
+    for(int round = 0; round < 1000; round++)
+    {
+        for(int i = 0; i < objectCount; i++)
+        {
+            objects[i] = pool_alloc(pool);
+        }
+        
+        for(int i = 0; i < objectCount; i++)
+        {
+            pool_free(pool, objects[i]);
+        }
+    }
+    
+    my_free(objects);
+    pool_destroy(pool);
+    
+    return 0;
+}
+
+/*
+    Per thread state of the threads test. Latencies are counted in power of two buckets of nanoseconds.
+ */
+typedef struct ThreadRun {
+    pthread_t thread;
+    unsigned int operationCount;
+    unsigned int seed;
+    unsigned long latencies[LATENCY_BUCKETS];
+} ThreadRun;
+
+unsigned long elapsedNanoseconds(struct timespec* start, struct timespec* end)
+{
+    return ((end->tv_sec - start->tv_sec) * 1000000000UL) + end->tv_nsec - start->tv_nsec;
+}
+
+/*
+    Each thread keeps a few blocks of random sizes live, and replaces a random one on every step, timing each my_malloc.
+ */
+void* threadWorker(void* argument)
+{
+    ThreadRun* run = argument;
+    Addr blocks[THREAD_LIVE_BLOCKS] = { 0 };
+    struct timespec start, end;
+    
+    for(unsigned int i = 0; i < run->operationCount; i++)
+    {
+        unsigned int slot = rand_r(&run->seed) % THREAD_LIVE_BLOCKS;
+        unsigned int length = 1 + (rand_r(&run->seed) % THREAD_MAX_SIZE);
+        
+        if(blocks[slot] != 0){
+            my_free(blocks[slot]);
+        }
+        
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        blocks[slot] = my_malloc(length);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        
+        unsigned long nanoseconds = elapsedNanoseconds(&start, &end);
+        unsigned int bucket = 0;
+        
+        while(bucket < LATENCY_BUCKETS - 1 && (1UL << (bucket + 1)) <= nanoseconds)
+        {
+            bucket++;
+        }
+        
+        run->latencies[bucket] += 1;
+    }
+    
+    for(unsigned int slot = 0; slot < THREAD_LIVE_BLOCKS; slot++)
+    {
+        if(blocks[slot] != 0){
+            my_free(blocks[slot]);
+        }
+    }
+    
+    return 0;
+}
+
+/*
+    Returns the upper bound, in nanoseconds, of the bucket the given fraction of the latencies falls under.
+ */
+unsigned long latencyPercentile(unsigned long* latencies, unsigned long total, double fraction)
+{
+    unsigned long wanted = (unsigned long)(total * fraction);
+    unsigned long seen = 0;
+    
+    for(unsigned int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        seen += latencies[bucket];
+        
+        if(seen > wanted){
+            return (1UL << (bucket + 1));
+        }
+    }
+    
+    return (1UL << LATENCY_BUCKETS);
+}
+
+/*
+    Runs threadCount threads against the allocator at once and prints the mallocs per second of all of them,
+    and the latency percentiles of a single my_malloc.
+ 
+    Engines that need a lock around my_malloc get a single thread.
+ */
+int threadTest(unsigned int threadCount, unsigned int operationCount, unsigned int concurrent)
+{
+    if(threadCount == 0 || !concurrent){
+        threadCount = 1;
+    }
+    
+    ThreadRun* runs = calloc(threadCount, sizeof(ThreadRun));
+    unsigned long latencies[LATENCY_BUCKETS] = { 0 };
+    struct timespec start, end;
+    
+    if(runs == 0){
+        return 1;
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for(unsigned int i = 0; i < threadCount; i++)
+    {
+        runs[i].operationCount = operationCount;
+        runs[i].seed = i + 1;
+        pthread_create(&runs[i].thread, 0, threadWorker, &runs[i]);
+    }
+    
+    for(unsigned int i = 0; i < threadCount; i++)
+    {
+        pthread_join(runs[i].thread, 0);
+        
+        for(unsigned int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+        {
+            latencies[bucket] += runs[i].latencies[bucket];
+        }
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    free(runs);
+    
+    unsigned long total = (unsigned long)threadCount * operationCount;
+    double seconds = elapsedNanoseconds(&start, &end) / 1e9;
+    
+    printf("\nthreads: %u, %.0f mallocs/s\n", threadCount, total / seconds);
+    printf("my_malloc latency: p50 < %lu ns, p99 < %lu ns, p99.9 < %lu ns\n", latencyPercentile(latencies, total, 0.5), latencyPercentile(latencies, total, 0.99), latencyPercentile(latencies, total, 0.999));
+    
+    return 0;
+}
+
+/*
+    Grows one allocation with my_realloc, doubling it on every step, and checks its first and last bytes survive.
+ 
+    Past the largest block the allocation is mapped on its own and keeps growing with mremap.
+ */
+int reallocTest(unsigned int steps, unsigned int initialSize)
+{
+    unsigned int size = (initialSize > 0) ? initialSize : 1;
+    char* memory = my_realloc(0, size);
+    
+    if(memory == 0){
+        return 1;
+    }
+    
+    memory[0] = 'a';
+    memory[size - 1] = 'z';
+    
+    for(unsigned int i = 0; i < steps && size <= (~0U / 2); i++)
+    {
+        char* grown = my_realloc(memory, size * 2);
+        
+        if(grown == 0 || grown[0] != 'a' || grown[size - 1] != 'z'){
+            printf("\nrealloc to %u bytes failed\n", size * 2);
+            my_free((grown != 0) ? grown : memory);
+            return 1;
+        }
+        
+        memory = grown;
+        size *= 2;
+        memory[size - 1] = 'z';
+    }
+    
+    AllocatorStats stats;
+    
+    if(my_allocator_stats(&stats) == 0){
+        printf("\nrealloc grew to %u bytes, large allocations: %lu (%lu KB)\n", size, stats.largeBlocks, stats.largeBytes / 1024);
+    }
+    
+    my_free(memory);
+    
+    return 0;
+}
+
+/*
+    Interleaves one long lived allocation with 15 short lived ones per round, then frees the short lived ones and
+    prints the largest free block and the free bytes left. Hinted, the long lived ones don't pin the blocks the
+    short lived ones were split from.
+ */
+int lifetimePhase(unsigned int rounds, unsigned int size, int hinted)
+{
+    Addr* longLived = malloc(rounds * sizeof(Addr));
+    Addr* shortLived = malloc(rounds * 15 * sizeof(Addr));
+    
+    if(longLived == 0 || shortLived == 0){
+        free(longLived);
+        free(shortLived);
+        return 1;
+    }
+    
+    for(unsigned int i = 0; i < rounds; i++)
+    {
+        longLived[i] = my_malloc_hint(size, hinted ? ALLOCATION_HINT_LONG_LIVED : ALLOCATION_HINT_NONE);
+        
+        for(unsigned int j = 0; j < 15; j++)
+        {
+            shortLived[i * 15 + j] = my_malloc_hint(size, hinted ? ALLOCATION_HINT_SHORT_LIVED : ALLOCATION_HINT_NONE);
+        }
+    }
+    
+    for(unsigned int i = 0; i < rounds * 15; i++)
+    {
+        my_free(shortLived[i]);
+    }
+    
+    AllocatorStats stats;
+    
+    if(my_allocator_stats(&stats) == 0)
+    {
+        unsigned int largest = 0;
+        unsigned long scattered = 0;
+        
+        for(unsigned int i = 0; i < stats.orderCount; i++)
+        {
+            largest = (stats.freeBlocks[i] > 0) ? stats.orderSize[i] : largest;
+            scattered += (stats.orderSize[i] < 64 KB) ? (unsigned long)stats.freeBlocks[i] * stats.orderSize[i] : 0;
+        }
+        
+        printf("\n%s: largest free block %u KB, free %lu KB, %lu KB of it in blocks under 64 KB, sub-heaps %lu (%lu KB)\n",
+               hinted ? "hinted" : "plain", largest / 1024, stats.freeBytes / 1024, scattered / 1024, stats.lifetimeHeaps, stats.lifetimeBytes / 1024);
+    }
+    
+    for(unsigned int i = 0; i < rounds; i++)
+    {
+        my_free(longLived[i]);
+    }
+    
+    free(longLived);
+    free(shortLived);
+    
+    return 0;
+}
+
+int lifetimeTest(unsigned int rounds, unsigned int size)
+{
+    int result = lifetimePhase(rounds, size, 0);
+    
+    return (result == 0) ? lifetimePhase(rounds, size, 1) : result;
+}
+
+/*
+    Prints the largest free block and how much free memory is in blocks under 64 KB.
+ */
+void printFragmentation(const char* label)
+{
+    AllocatorStats stats;
+    
+    if(my_allocator_stats(&stats) != 0){
+        return;
+    }
+    
+    unsigned int largest = 0;
+    unsigned long scattered = 0;
+    
+    for(unsigned int i = 0; i < stats.orderCount; i++)
+    {
+        largest = (stats.freeBlocks[i] > 0) ? stats.orderSize[i] : largest;
+        scattered += (stats.orderSize[i] < 64 KB) ? (unsigned long)stats.freeBlocks[i] * stats.orderSize[i] : 0;
+    }
+    
+    printf("\n%s: largest free block %u KB, free %lu KB, %lu KB of it in blocks under 64 KB, handles %lu, moved %lu\n",
+           label, largest / 1024, stats.freeBytes / 1024, scattered / 1024, stats.handles, stats.handleMoves);
+}
+
+/*
+    Allocates handles and frees every other one, which leaves one live block in each buddy pair, then compacts
+    in 100 microsecond slices until nothing moves, and checks every handle still holds what was written to it.
+ */
+int handleTest(unsigned int count, unsigned int length)
+{
+    unsigned int size = (length > 0) ? length : 1;
+    Handle* handles = malloc(count * sizeof(Handle));
+    
+    if(handles == 0){
+        return 1;
+    }
+    
+    for(unsigned int i = 0; i < count; i++)
+    {
+        handles[i] = my_halloc(size);
+        char* memory = my_hlock(handles[i]);
+        
+        if(memory != 0){
+            memset(memory, (char)i, size);
+        }
+        
+        my_hunlock(handles[i]);
+    }
+    
+    for(unsigned int i = 0; i < count; i += 2)
+    {
+        my_hfree(handles[i]);
+        handles[i] = 0;
+    }
+    
+    printFragmentation("fragmented");
+    
+    struct timespec start, end;
+    unsigned int slices = 0;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    do {
+        slices++;
+    } while(my_allocator_compact(100) != 0);
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    printFragmentation("compacted");
+    printf("%u slices, %.3f ms\n", slices, elapsedNanoseconds(&start, &end) / 1e6);
+    
+    int result = 0;
+    
+    for(unsigned int i = 1; i < count; i += 2)
+    {
+        char* memory = my_hlock(handles[i]);
+        
+        if(memory == 0 || memory[0] != (char)i || memory[size - 1] != (char)i)
+        {
+            printf("\nhandle %u lost its memory\n", i);
+            result = 1;
+        }
+        
+        my_hunlock(handles[i]);
+        my_hfree(handles[i]);
+    }
+    
+    free(handles);
+    
+    return result;
+}
+
+/*
+    Blocks handed from the producer to the consumer of the waiting test, in the order they were allocated.
+ */
+typedef struct WaitRun {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t produced;
+    Addr* blocks;
+    unsigned int count;
+    unsigned int length;
+    unsigned int producedCount;
+    int result;
+} WaitRun;
+
+/*
+    Frees the producer's blocks as they come, a little after each, so the producer keeps running into a full arena.
+ */
+void* waitConsumer(void* argument)
+{
+    WaitRun* run = argument;
+    struct timespec delay = { 0, 20000 };
+    
+    for(unsigned int i = 0; i < run->count; i++)
+    {
+        pthread_mutex_lock(&run->lock);
+        
+        while(run->producedCount <= i)
+        {
+            pthread_cond_wait(&run->produced, &run->lock);
+        }
+        
+        char* memory = run->blocks[i];
+        pthread_mutex_unlock(&run->lock);
+        
+        nanosleep(&delay, 0);
+        
+        if(memory == 0 || memory[0] != (char)i || memory[run->length - 1] != (char)i)
+        {
+            printf("\nblock %u lost its memory\n", i);
+            run->result = 1;
+        }
+        
+        my_free(memory);
+    }
+    
+    return 0;
+}
+
+/*
+    One thread allocates count blocks of length bytes with my_malloc_wait while another frees them behind it.
+    With an arena that holds only a few of them, most allocations wait for a free.
+ */
+int waitTest(unsigned int count, unsigned int length)
+{
+    WaitRun run = { 0 };
+    
+    run.length = (length > 0) ? length : 1;
+    run.count = count;
+    run.blocks = malloc(count * sizeof(Addr));
+    
+    if(run.blocks == 0){
+        return 1;
+    }
+    
+    if(my_allocator_set_waiting(1) != 0)
+    {
+        printf("\nwaiting isn't supported here\n");
+        free(run.blocks);
+        return 1;
+    }
+    
+    pthread_mutex_init(&run.lock, 0);
+    pthread_cond_init(&run.produced, 0);
+    pthread_create(&run.thread, 0, waitConsumer, &run);
+    
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for(unsigned int i = 0; i < count; i++)
+    {
+        char* memory = my_malloc_wait(run.length, ALLOCATOR_WAIT_FOREVER);
+        
+        if(memory != 0){
+            memset(memory, (char)i, run.length);
+        }
+        
+        pthread_mutex_lock(&run.lock);
+        run.blocks[i] = memory;
+        run.producedCount = i + 1;
+        pthread_cond_signal(&run.produced);
+        pthread_mutex_unlock(&run.lock);
+    }
+    
+    pthread_join(run.thread, 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    AllocatorStats stats;
+    my_allocator_stats(&stats);
+    
+    double seconds = elapsedNanoseconds(&start, &end) / 1e9;
+    printf("\n%u allocations, %lu waited for memory, %lu failed, %.0f allocations/s\n", count, stats.waitedRequests, stats.failedCount, count / seconds);
+    
+    my_allocator_set_waiting(0);
+    pthread_cond_destroy(&run.produced);
+    pthread_mutex_destroy(&run.lock);
+    free(run.blocks);
+    
+    return run.result;
+}
+
+/*
+    Over count rounds, fills a readv list of IO_VECTOR_LENGTH buffers of length bytes, writes to every buffer as a
+    read would, then frees the list. After the first round the buffers come from the per size cache.
+ */
+int ioBufferTest(unsigned int count, unsigned int length)
+{
+    struct iovec vector[IO_VECTOR_LENGTH];
+    unsigned long listLength = (unsigned long)IO_VECTOR_LENGTH * length;
+    struct timespec start, end;
+    unsigned int bufferSize = 0;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for(unsigned int round = 0; round < count; round++)
+    {
+        unsigned int filled = my_iobuf_vector(vector, IO_VECTOR_LENGTH, listLength, length);
+        
+        if(filled == 0)
+        {
+            printf("\nno I/O buffers of %u bytes here\n", length);
+            return 1;
+        }
+        
+        for(unsigned int i = 0; i < filled; i++)
+        {
+            ((char*)vector[i].iov_base)[0] = (char)round;
+            ((char*)vector[i].iov_base)[vector[i].iov_len - 1] = (char)round;
+        }
+        
+        bufferSize = my_iobuf_size(vector[0].iov_base);
+        my_iobuf_vector_free(vector, filled);
+    }
+    
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    AllocatorStats stats;
+    my_allocator_stats(&stats);
+    
+    double buffers = (double)count * IO_VECTOR_LENGTH;
+    printf("\n%.0f buffers of %u bytes, %.1f ns each, %lu KB cached for reuse\n", buffers, bufferSize, elapsedNanoseconds(&start, &end) / buffers, stats.ioCachedBytes / 1024);
+    
+    return 0;
+}
+
+/*
+    Allocates count short lived hinted blocks of length bytes and frees them with the maintenance thread running,
+    newest first, so the sub-heap kept is the oldest one, full of freed blocks. Once maintenance had time to pass
+    over the heap, one large short lived request is timed. It fails if that request had to merge the churn itself.
+ */
+int hintMaintenanceTest(unsigned int count, unsigned int length, unsigned int maintenanceInterval)
+{
+    Addr* blocks = malloc(sizeof(Addr) * (count > 0 ? count : 1));
+    struct timespec start, end;
+    
+    if(maintenanceInterval == 0 && my_allocator_set_maintenance(HINT_MAINTENANCE_INTERVAL) != 0)
+    {
+        printf("\nno maintenance thread for this engine\n");
+        free(blocks);
+        return 0;
+    }
+    
+    for(unsigned int i = 0; i < count; i++)
+    {
+        blocks[i] = my_malloc_hint(length, ALLOCATION_HINT_SHORT_LIVED);
+    }
+    
+    for(unsigned int i = count; i > 0; i--)
+    {
+        my_free(blocks[i - 1]);
+    }
+    
+    usleep(100 * HINT_MAINTENANCE_INTERVAL);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Addr probe = my_malloc_hint(HINT_PROBE_LENGTH, ALLOCATION_HINT_SHORT_LIVED);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    
+    unsigned long nanoseconds = elapsedNanoseconds(&start, &end);
+    
+    AllocatorStats stats;
+    my_allocator_stats(&stats);
+    
+    printf("\n%u hinted blocks of %u bytes freed, then %u KB hinted in %.1f us, sub-heaps %lu\n",
+           count, length, HINT_PROBE_LENGTH / 1024, nanoseconds / 1e3, stats.lifetimeHeaps);
+    
+    my_free(probe);
+    free(blocks);
+    
+    if(maintenanceInterval == 0){
+        my_allocator_set_maintenance(0);
+    }
+    
+    if(probe == 0 || nanoseconds > HINT_PROBE_LIMIT)
+    {
+        printf("ERROR> The large hinted request %s.\n", (probe == 0) ? "failed" : "merged the churn in the foreground");
+        return 1;
+    }
+    
+    return 0;
+}
+
+unsigned long allocatorCalls(void)
+{
+    AllocatorStats stats;
+    
+    return (my_allocator_stats(&stats) == 0) ? stats.mallocCount + stats.freeCount : 0;
+}
+
+void startPhase(Phase* phase)
+{
+    phase->calls = allocatorCalls();
+    perf_counters_start(&phase->sample);
+}
+
+/*
+    Stops the phase, and prints its time and counted events divided by the allocator calls made during it.
+    Events the machine didn't count are left out, so without perf_event_open only the time is there.
+ */
+void reportPhase(Phase* phase, const char* name)
+{
+    perf_counters_stop(&phase->sample);
+    
+    unsigned long calls = allocatorCalls() - phase->calls;
+    double divisor = (calls > 0) ? calls : 1;
+    PerfSample* sample = &phase->sample;
+    
+    printf("%s: %lu allocator calls, %.1f ns/call", name, calls, sample->nanoseconds / divisor);
+    
+    for(unsigned int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        if(sample->counted & (1u << c)){
+            printf(", %s %.2f/call", perf_counter_name(c), sample->values[c] / divisor);
+        }
+    }
+    
+    unsigned int instructionsPerCycle = (1u << PERF_COUNTER_CYCLES) | (1u << PERF_COUNTER_INSTRUCTIONS);
+    
+    if((sample->counted & instructionsPerCycle) == instructionsPerCycle && sample->values[PERF_COUNTER_CYCLES] > 0){
+        printf(", IPC %.2f", (double)sample->values[PERF_COUNTER_INSTRUCTIONS] / sample->values[PERF_COUNTER_CYCLES]);
+    }
+    
+    printf("\n");
+}
+
 int runTest(Options options)
 {
     unsigned int testIdentifier = options.testIdentifier;
@@ -117,6 +839,33 @@ int runTest(Options options)
         case 3:{
             return recursiveTest(parameterA, parameterB);
         }break;
+        case 4:{
+            return regionTest(parameterA, parameterB);
+        }break;
+        case 5:{
+            return poolTest(parameterA, parameterB);
+        }break;
+        case 6:{
+            return threadTest(parameterA, parameterB, options.concurrent);
+        }break;
+        case 7:{
+            return reallocTest(parameterA, parameterB);
+        }break;
+        case 8:{
+            return lifetimeTest(parameterA, parameterB);
+        }break;
+        case 9:{
+            return handleTest(parameterA, parameterB);
+        }break;
+        case 10:{
+            return waitTest(parameterA, parameterB);
+        }break;
+        case 11:{
+            return ioBufferTest(parameterA, parameterB);
+        }break;
+        case 12:{
+            return hintMaintenanceTest(parameterA, parameterB, options.maintenanceInterval);
+        }break;
     }
     
     return 0;
@@ -132,6 +881,19 @@ Options buildOptions(int argc, char ** argv)
     options.testParamA = 2;
     options.testParamB = 128 KB;
     options.testAfterAckermann = 0;
+    options.ackermanN = 2;
+    options.ackermanM = 3;
+    options.lazyThreshold = 0;
+    options.sizeClasses = 0;
+    options.engine = ALLOCATOR_ENGINE_BUDDY;
+    options.numaArenas = 0;
+    options.heapFile = 0;
+    options.reserveOnly = 0;
+    options.sampleRate = 0;
+    options.maintenanceInterval = 0;
+    options.largeThreshold = 0;
+    options.concurrent = 0;
+    options.perfCounters = 0;
     
     
     for (int i = 1; i < argc; i += 2)
@@ -154,6 +916,18 @@ Options buildOptions(int argc, char ** argv)
             case 'x': options.testParamA = atoi(argv[i+1]); break;          //Test Parameter A
             case 'y': options.testParamB = atoi(argv[i+1]); break;          //Test Parameter B
             case 'z': options.testAfterAckermann = atoi(argv[i+1]); break;  //Run before/after ackermann mem test.
+            case 'N': options.ackermanN = atoi(argv[i+1]); break;           //Ackermann n
+            case 'M': options.ackermanM = atoi(argv[i+1]); break;           //Ackermann m
+            case 'l': options.lazyThreshold = atoi(argv[i+1]); break;       //Lazy coalescing threshold
+            case 'c': options.sizeClasses = atoi(argv[i+1]); break;         //Size class slabs
+            case 'e': options.engine = atoi(argv[i+1]); break;              //Allocator engine
+            case 'n': options.numaArenas = atoi(argv[i+1]); break;          //NUMA arenas
+            case 'f': options.heapFile = argv[i+1]; break;                  //Mapped heap file
+            case 'r': options.reserveOnly = atoi(argv[i+1]); break;         //Reserve, then commit
+            case 'p': options.sampleRate = atoi(argv[i+1]); break;          //Heap profile sampling rate
+            case 'w': options.maintenanceInterval = atoi(argv[i+1]); break; //Maintenance thread interval
+            case 'L': options.largeThreshold = atoi(argv[i+1]); break;      //Large allocation threshold
+            case 'P': options.perfCounters = atoi(argv[i+1]); break;        //Hardware counters per phase
             default : { options.error = 1; return options; }
         }
     }
@@ -172,29 +946,152 @@ int main(int argc, char ** argv) {
     printf("-k : Memory Size in Kilobytes to use in this test.\n");
     printf("-m : Memory Size in Megabytes to use in this test.\n");
     printf("-t : Identifier of more simple test to run before ackermann memtest.\n");
+    printf("     (1 = maw, 2 = for, 3 = recursive, 4 = region, 5 = pool, 6 = threads: x threads doing y mallocs each,\n");
+    printf("      7 = realloc: one allocation grown from y bytes, doubling x times,\n");
+    printf("      8 = lifetimes: x rounds of one long and 15 short lived allocations of y bytes, without and with hints,\n");
+    printf("      9 = handles: x handles of y bytes, every other one freed, then compacted,\n");
+    printf("      10 = wait: x blocks of y bytes allocated with my_malloc_wait while another thread frees them,\n");
+    printf("      11 = iobuf: x rounds of a readv list of 16 I/O buffers of y bytes, allocated and freed,\n");
+    printf("      12 = hint maintenance: x short lived hinted blocks of y bytes freed with maintenance on, then one of 256 KB timed)\n");
     printf("-x : First parameter of simple memtest.\n");
     printf("-y : Second parameter of simple memtest.\n");
     printf("-z : When to run the simple memtest. (Will not run if -t = 0);\n");
+    printf("-N : Ackermann parameter n.\n");
+    printf("-M : Ackermann parameter m.\n");
+    printf("-l : Lazy coalescing threshold. (0 merges on every free)\n");
+    printf("-c : Serve small requests from size class slabs. (0 = off, 1 = on)\n");
+    printf("-e : Engine. (0 = buddy, 1 = tlsf, 2 = buddy and tlsf, 3 = lock-free, 4 = all of them, 5 = template, 6 = buddy and template, 7 = tree, 8 = buddy and tree, one after the other on the same workload)\n");
+    printf("-n : One buddy arena of the memory size per NUMA node. (0 = off, 1 = on)\n");
+    printf("-f : File to keep the buddy arena in. Reused as it was left if it already holds one.\n");
+    printf("-r : Only reserve the buddy arena, committing it as blocks are first handed out. (0 = off, 1 = on)\n");
+    printf("-p : Sample an allocation about every this many bytes, and write the profile to memtest.heap. (0 = off)\n");
+    printf("-w : Run the buddy maintenance thread, waking up every this many microseconds. (0 = off)\n");
+    printf("-L : Map requests of this many bytes or more on their own. (0 = only those too large for any block)\n");
+    printf("-P : Count cycles, instructions, cache, dTLB and branch misses of each phase, per allocator call. (0 = off, 1 = on)\n");
     printf("Example: memtest -b 5 -m 128\n\n\n");
     
     unsigned int memorySize = options.memorySize;
     unsigned int basic_block_size = options.basicBlockSize;
     
-    printf("memtest options:\n - memory: ~%d KB\n - block size: %d B\n - testId: %d\n\n", options.memorySize / 1024, options.basicBlockSize, options.testIdentifier);
+    printf("memtest options:\n - memory: ~%d KB\n - block size: %d B\n - testId: %d\n - ackermann: n=%d m=%d\n\n", options.memorySize / 1024, options.basicBlockSize, options.testIdentifier, options.ackermanN, options.ackermanM);
+    
+    const char* engineNames[] = { "buddy", "tlsf", "lock-free", "template", "tree" };
+    AllocatorEngine engines[] = { ALLOCATOR_ENGINE_BUDDY, ALLOCATOR_ENGINE_TLSF, ALLOCATOR_ENGINE_LOCKFREE, ALLOCATOR_ENGINE_TEMPLATE, ALLOCATOR_ENGINE_TREE };
     
-    init_allocator(basic_block_size, memorySize);
+    //Bit e of a set runs engines[e]. Values 0 to 3 keep the meaning they had before the template and tree engines.
+    const unsigned int engineSets[ENGINE_SET_COUNT] = { 0x1, 0x2, 0x3, 0x4, 0x1f, 0x8, 0x9, 0x10, 0x11 };
+    int ackermanResult = 0;
     
-    if(options.testIdentifier > 0 && options.testAfterAckermann == 0){
-        runTest(options);
+    if(options.engine >= ENGINE_SET_COUNT){
+        printf("ERROR> Unknown engine %u.\n", options.engine);
+        return 1;
     }
     
-    ackerman_main();
+    //Opened once, before any thread starts, so every thread of the tests is counted.
+    if(options.perfCounters && perf_counters_open() == 0){
+        printf("hardware counters unavailable (perf_event_open: %s), timing only\n\n", strerror(errno));
+    }
+    
+    Phase phase;
     
-    if(options.testIdentifier > 0 && options.testAfterAckermann == 1){
-        runTest(options);
+    for(unsigned int e = 0; e < sizeof(engines) / sizeof(engines[0]); e++)
+    {
+        if((engineSets[options.engine] & (1u << e)) == 0){
+            continue;
+        }
+        
+        AllocatorEngine engine = engines[e];
+        printf("engine: %s\n", engineNames[e]);
+        
+        //Same seed for every engine, so each one sees the same sizes.
+        srand(1);
+        
+        unsigned int numaArenas = (options.numaArenas && engine == ALLOCATOR_ENGINE_BUDDY);
+        unsigned int mappedHeap = (options.heapFile != 0 && engine == ALLOCATOR_ENGINE_BUDDY);
+        unsigned int initialized = 0;
+        
+        if(mappedHeap){
+            initialized = init_allocator_mapped(options.heapFile, basic_block_size, memorySize);
+        } else if(numaArenas){
+            initialized = init_allocator_numa(basic_block_size, memorySize);
+        } else if(options.reserveOnly && engine == ALLOCATOR_ENGINE_BUDDY){
+            initialized = init_allocator_reserved(basic_block_size, memorySize);
+        } else {
+            initialized = init_allocator_with_engine(engine, basic_block_size, memorySize);
+        }
+        
+        if(initialized == 0)
+        {
+            printf("ERROR> Could not initialize the allocator.\n");
+            return 1;
+        }
+        
+        my_allocator_set_lazy_coalescing(options.lazyThreshold);
+        my_allocator_set_size_classes(options.sizeClasses);
+        my_allocator_set_sampling(options.sampleRate);
+        my_allocator_set_large_threshold(options.largeThreshold);
+        
+        unsigned int maintenance = (options.maintenanceInterval > 0 && engine == ALLOCATOR_ENGINE_BUDDY);
+        
+        if(maintenance && my_allocator_set_maintenance(options.maintenanceInterval) != 0)
+        {
+            printf("ERROR> Could not start the maintenance thread.\n");
+            maintenance = 0;
+        }
+        
+        AllocatorStats stats;
+        
+        if(my_allocator_stats(&stats) == 0 && stats.arenaCount > 1){
+            printf("arenas: %u (one per NUMA node)\n", stats.arenaCount);
+        }
+        
+        if(options.reserveOnly && engine == ALLOCATOR_ENGINE_BUDDY && my_allocator_stats(&stats) == 0){
+            printf("committed at init: %lu KB\n", stats.committedBytes / 1024);
+        }
+        
+        options.concurrent = (engine == ALLOCATOR_ENGINE_LOCKFREE || numaArenas || maintenance);
+        
+        if(options.testIdentifier > 0 && options.testAfterAckermann == 0)
+        {
+            startPhase(&phase);
+            runTest(options);
+            
+            if(options.perfCounters){
+                printf("\n");
+                reportPhase(&phase, "test");
+            }
+        }
+        
+        startPhase(&phase);
+        ackermanResult |= ackerman_main(options.ackermanN, options.ackermanM);
+        
+        if(options.perfCounters){
+            reportPhase(&phase, "ackermann");
+        }
+        
+        if(options.testIdentifier > 0 && options.testAfterAckermann == 1)
+        {
+            startPhase(&phase);
+            runTest(options);
+            
+            if(options.perfCounters){
+                printf("\n");
+                reportPhase(&phase, "test");
+            }
+        }
+        
+        //With several engines, the profile written last is the last engine's, but it holds the sites of every run.
+        if(options.sampleRate > 0 && my_allocator_dump_profile(PROFILE_PATH) == 0){
+            printf("heap profile: %s\n", PROFILE_PATH);
+        }
+        
+        release_allocator();
+        printf("\n");
     }
     
-    release_allocator();
+    perf_counters_close();
+    
+    return ackermanResult;
 }
 
 
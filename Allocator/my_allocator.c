@@ -23,6 +23,38 @@
 #define maxValue(a, b) (a > b) ? a : b;
 #define withinValues(val, upper, lower) val <= upper && val >= lower
 #define adjustedIndex(index, min) (index - min)
+#define EMPTY_OFFSET 0
+
+#define SIZE_CLASS_GRANULE 16           //Step between the smallest size classes.
+#define SIZE_CLASS_FINE_SHIFT 7
+#define SIZE_CLASS_FINE_LIMIT (1 << SIZE_CLASS_FINE_SHIFT)
+#define SIZE_CLASS_FINE_COUNT (SIZE_CLASS_FINE_LIMIT / SIZE_CLASS_GRANULE)
+#define SIZE_CLASS_STEP_SHIFT 2
+#define SIZE_CLASSES_PER_POWER (1 << SIZE_CLASS_STEP_SHIFT)
+#define SIZE_CLASS_LIMIT (256 * 1024)   //Largest size served from a slab.
+#define MAX_SIZE_CLASSES 64
+#define SLAB_MIN_SIZE (16 * 1024)       //Smallest slab, and the granule of the slab map.
+#define SLAB_MIN_SLOTS 8
+#define ALLOCATION_GRANULE_SHIFT 4       //The allocation bitmap has a bit per 16 bytes, the least any two memory starts are apart.
+#define BITMAP_WORD_BITS (8 * sizeof(unsigned long))
+#define MAX_ARENAS 16                   //Most NUMA nodes that get an arena of their own.
+#define COMMIT_CHUNK_SIZE (1024 * 1024) //Reserved memory is committed this much at a time. Large, to keep the mappings few.
+#define MAPPED_HEAP_MAGIC 0x50414548594442UL   //"BDYHEAP"
+#define MAPPED_HEAP_VERSION 2
+#define MAINTENANCE_MAX_RESERVE 256     //Most free blocks kept ready at one index.
+#define MAINTENANCE_SPLIT_BATCH 16      //Splits done per hold of the arena lock, so allocations never wait on a long refill.
+#define LIFETIME_CLASSES 3              //Short lived, long lived and hot, see my_malloc_hint.
+#define LIFETIME_NONE LIFETIME_CLASSES
+#define LIFETIME_MAX_HEAPS 16           //Most sub-heaps one lifetime holds at once.
+#define LIFETIME_HEAP_SHIFT 4           //A sub-heap is a block a sixteenth the size of the largest one.
+#define LIFETIME_MIN_HEAP_SIZE (64 * 1024)
+#define HANDLE_TABLE_GROWTH 256         //Entries added to the handle table each time it fills up.
+#define COMPACTION_CHECK_INTERVAL 16    //Handles visited without a move between looks at the clock.
+#define COMPACTION_SLICE 200            //Microseconds the maintenance thread compacts for on an idle pass.
+
+#define IO_BUFFER_MIN_SIZE 4096         //I/O buffers come in whole pages, so O_DIRECT can read into them.
+#define IO_BUFFER_ORDERS 9              //4 KiB up to 1 MiB.
+#define IO_BUFFER_CACHE_DEPTH 8         //Freed 4 KiB buffers kept for the next request. Each order up keeps half as many, and at least one.
 
 typedef enum { false, true } bool;
 typedef enum { left, right, neither } side;
@@ -32,7 +64,26 @@ typedef enum { left, right, neither } side;
 /*--------------------------------------------------------------------------*/
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include "my_allocator.h"
+#include "tlsf_allocator.h"
+#include "lockfree_buddy.h"
+#include "buddy_heap.h"
+#include "tree_buddy.h"
+#include "numa_support.h"
+#include "heap_profiler.h"
+#include "large_allocations.h"
 
 /*--------------------------------------------------------------------------*/
 /* DATA STRUCTURES */ 
@@ -64,46 +115,258 @@ typedef enum { left, right, neither } side;
     The freestore will adjust it's indexes so the index 0 holds value 1.
  */
 
+/*
+    Everything stored inside the memory points at other parts of it by Offset from the start of the arena,
+    never by address, so a mapped arena still makes sense when it's mapped at another address.
+ 
+    Offset 0 is the freestore itself, which is never handed out, so EMPTY_OFFSET stands in for EMPTY_ADDRESS.
+ */
+typedef unsigned long Offset;
+
 typedef struct FreestoreBlock {
-    Addr address;
-    struct FreestoreBlock* nextBlock;
+    Offset address;
+    Offset nextBlock;
 } FreestoreBlock;
 
 typedef FreestoreBlock* Freestore;  //The freestore is just an array of FreestoreBlocks.
 
+/*
+    An allocation waiting for room, see my_malloc_async. Once served, it sits on a list of its own until the
+    callback is run, outside the arena lock.
+ */
+typedef struct WaitRequest {
+    unsigned int length;
+    AllocationCallback callback;
+    void* context;
+    Addr address;
+    struct WaitRequest* next;
+} WaitRequest;
+
+/*
+    One entry of the handle table. Handles are entry indexes plus one, so 0 is never a handle.
+ */
+typedef struct HandleEntry {
+    Addr address;                       //EMPTY_ADDRESS while the entry is free.
+    unsigned int lockCount;
+    unsigned int nextFree;              //Handle of the next free entry, while this one is free.
+    bool movable;                       //A header block of the main arena, which compaction may move.
+} HandleEntry;
+
 typedef struct MemoryHeader {
     int index;
+    unsigned int length;    //Requested length. Sits in the padding after index, so the header size is unchanged.
     //Addr buddyHeader;     //Couldn't be set due to separation of MemoryHeader and FreestoreBlock methods.
                             //Buddy still can be calculated using index and physical memory address location.
-    Addr memoryStart;       //This value here just to keep MemoryHeader the same size as Freestore Block.
+    Offset memoryStart;     //This value here just to keep MemoryHeader the same size as Freestore Block.
 } MemoryHeader;
 
+typedef struct SlabHeader {
+    Offset nextSlab;                    //Slabs of the same class with free slots.
+    Offset previousSlab;
+    Offset freeSlot;                    //Freed slots, chained through their first word.
+    Offset unusedSlot;
+    unsigned int sizeClass;
+    unsigned int index;                 //Adjusted index of the slab's buddy block.
+    unsigned int slotSize;
+    unsigned int slotCount;
+    unsigned int freeSlots;
+} SlabHeader;
+
+/*
+    Everything one buddy arena needs. There is a single arena unless NUMA placement is on,
+    and the functions below work on whichever one _arena points at.
+ */
+typedef struct Arena {
+/* -- Definitions -- */
+    unsigned int basicBlockSize;
+    unsigned int length;
+
+    unsigned int headerSize;
+    unsigned int minFreestoreIndex;
+    unsigned int maxFreestoreIndex;
+
+    unsigned int minFreestoreIndexMemorySize;
+    unsigned int maxFreestoreIndexMemorySize;
+
+    long freestoreDistance;         //From the arena to its freestore, so it holds wherever a shared arena is mapped. 0 when unset.
+    unsigned long mappedLength;     //Length mapped for a NUMA arena, or 0 when the memory came from malloc.
+    unsigned int node;
+    pthread_mutex_t lock;           //Only taken while arenas are locked, see _lockedArenas.
+
+/* -- Sizes -- */
+    unsigned int freestoreIndex;    //Index that the freestore fits into. Use to retrieve size and protect freestore.
+    unsigned int freestoreRange;
+
+/* -- Statistics -- */
+    unsigned long allocatedBlocks;
+    unsigned long allocatedBytes;
+    unsigned long requestedBytes;
+    unsigned long mallocCount;
+    unsigned long freeCount;
+    unsigned long failedCount;
+    unsigned long splitCount;
+    unsigned long mergeCount;
+
+/* -- Lazy Coalescing -- */
+    unsigned int lazyThreshold;     //Lazily freed blocks an index may hold before it is coalesced. 0 merges on every free.
+    unsigned int lazyCount[MAX_ALLOCATOR_ORDERS];
+
+/* -- Maintenance -- */
+    unsigned long demandCount[MAX_ALLOCATOR_ORDERS];    //Blocks asked for at each index since the last maintenance pass.
+
+/* -- Size Classes -- */
+    bool sizeClassesEnabled;
+    unsigned int sizeClassCount;                //Classes small enough to be served from slabs in this memory.
+    unsigned int sizeClassSlabIndex[MAX_SIZE_CLASSES];
+    Offset partialSlabs[MAX_SIZE_CLASSES];
+    unsigned int slabGranuleIndex;
+    Offset slabMap;                             //Array of slab Offsets, one per slab granule.
+    unsigned int slabMapCount;
+    unsigned long slabBytes;
+    unsigned long slotBytes;
+    unsigned long headerBytes;
+
+/* -- Allocation Bitmap -- */
+    Offset allocationBitmap;            //Bit set where the memory of a live allocation starts.
+    unsigned int allocationBitmapIndex;
+
+/* -- Reserved Memory -- */
+    unsigned long reservedLength;       //Length reserved with no access, or 0 when all of the memory is usable.
+    unsigned long* committedChunks;     //Bit set for each COMMIT_CHUNK_SIZE of reserved memory made usable.
+    unsigned long committedBytes;
+
+/* -- Root -- */
+    Offset rootObject;                  //Where a reopened heap's data structures start.
+} Arena;
+
+/*
+    First page of a mapped heap file. The arena itself is kept here, so the file holds all of the heap's state
+    and reopening it, or mapping it in another process, only needs the lock set up.
+ */
+typedef struct MappedHeapHeader {
+    unsigned long magic;
+    unsigned int version;
+    unsigned int headerLength;          //Bytes before the freestore, a whole number of pages.
+    unsigned long arenaSize;            //sizeof(Arena) when the file was made, so a file from another build is refused.
+    Arena arena;
+} MappedHeapHeader;
+
+/*
+    What the allocator calls on an engine other than the buddy freestore, one entry per engine.
+    Entries left NULL are things the engine doesn't keep: without a requested size it stays out of requestedBytes,
+    without a header size its blocks have none, and without an order count the whole memory is one range, as with TLSF.
+ */
+typedef struct EngineOps {
+    unsigned int (*init)(Addr memory, unsigned int length, unsigned int basicBlockSize);
+    Addr (*malloc)(unsigned int length);
+    Addr (*mallocAligned)(unsigned int length, unsigned int alignment);
+    int (*free)(Addr address);
+    unsigned int (*blockSize)(Addr address);
+    unsigned int (*usableSize)(Addr address);
+    unsigned int (*requestedSize)(Addr address);
+    unsigned int (*headerSize)(void);
+    unsigned int (*orderCount)(void);
+    unsigned int (*orderSize)(unsigned int order);
+    unsigned long (*freeBlocks)(unsigned int order);
+    unsigned long (*freeBytes)(void);
+    unsigned long (*splitCount)(void);
+    unsigned long (*mergeCount)(void);
+    bool atomicCounters;            //Any number of threads call the engine at once, so the counters are only changed atomically.
+} EngineOps;
+
 /*--------------------------------------------------------------------------*/
 /* CONSTANTS */
 /*--------------------------------------------------------------------------*/
 
-/* -- Definitions -- */
-    unsigned int _basic_block_size;
-    unsigned int _length;
+/* -- Arenas -- */
+    Arena _arenaStorage[MAX_ARENAS];
+    Arena* _arenas[MAX_ARENAS] = { &_arenaStorage[0] };   //A mapped arena lives in its file instead of the storage.
+    unsigned int _arenaCount;       //Arenas set up by init. More than one only with NUMA placement.
+    bool _numaArenas;
+    bool _lockedArenas;             //Arenas are shared by threads of NUMA nodes, or by processes, and take their lock.
+    __thread Arena* _arena = &_arenaStorage[0];
 
-    unsigned int _headerSize;
-    unsigned int _minFreestoreIndex;
-    unsigned int _maxFreestoreIndex;
+/* -- Mapped Heap -- */
+    MappedHeapHeader* _mappedHeap;  //Start of the mapped file, when the heap lives in one.
+    unsigned long _mappedHeapLength;
+    int _mappedHeapFile = -1;
+    bool _mappedHeapShared;         //Mapped by other processes too, which keep using its lock after release.
 
-    unsigned int _minFreestoreIndexMemorySize;
-    unsigned int _maxFreestoreIndexMemorySize;
+/* -- Profiling -- */
+    bool _heapSampling;             //Set once sampling was turned on. Samples outlive it, so frees keep checking.
 
-    Freestore _freestoreAddress;
+/* -- Maintenance -- */
+    pthread_t _maintenanceThread;
+    unsigned int _maintenanceInterval;      //Microseconds between passes. 0 when no maintenance thread runs.
+    bool _maintenanceStopping;
+    bool _maintenanceLockedArenas;          //Whether arenas were locked anyway before maintenance started.
+    pthread_mutex_t _maintenanceLock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t _maintenanceWakeup = PTHREAD_COND_INITIALIZER;
+    unsigned long _maintenanceActivity[MAX_ARENAS];     //Mallocs and frees of each arena at the last pass, to tell when it's idle.
+    unsigned int _reserveTargets[MAX_ARENAS][MAX_ALLOCATOR_ORDERS];
 
-/* -- Sizes -- */
-    unsigned int _freestoreIndex;   //Index that the freestore fits into. Use to retrieve size and protect freestore.
-    unsigned int _maxFreestoreIndexMemorySize;
-    unsigned int _freestoreRange;
+/* -- Large Allocations -- */
+    unsigned int _largeThreshold;           //Requests this large are mapped on their own. 0 maps only those no block can hold.
+
+/* -- Lifetime Heaps -- */
+    Arena _lifetimeArenaStorage[LIFETIME_CLASSES][LIFETIME_MAX_HEAPS];
+    Arena* _lifetimeHeaps[LIFETIME_CLASSES][LIFETIME_MAX_HEAPS];    //The first _lifetimeHeapCounts are in use, in the order they were made.
+    unsigned int _lifetimeHeapCounts[LIFETIME_CLASSES];
+    unsigned int _lifetimeHeapTotal;
+
+/* -- Handles -- */
+    HandleEntry* _handles;                  //Kept in malloc'ed memory, so growing it never takes from the arena.
+    unsigned int _handleCapacity;
+    unsigned int _handleCount;              //Live handles.
+    unsigned int _handleFree;               //First free entry's handle, or 0 when the table is full.
+    unsigned int _handleCursor;             //Where the next compaction slice picks up, counted from the end of the table.
+    unsigned long _handleMoves;             //Blocks moved by compaction since init.
+    unsigned int _roundMoves;               //Blocks moved since the cursor last passed the start of the table.
+    bool _compactionPending;                //The maintenance thread compacts on idle passes until a slice moves nothing.
+
+/* -- Waiting Allocations -- */
+    bool _waitingEnabled;
+    bool _waitingLockedArenas;              //Waiting turned the main arena's lock on, and turns it off again.
+    pthread_cond_t _waitQueues[MAX_ALLOCATOR_ORDERS];      //Threads parked for a block of each index, on the main arena's lock.
+    unsigned int _parkedThreads[MAX_ALLOCATOR_ORDERS];
+    WaitRequest* _pendingRequests[MAX_ALLOCATOR_ORDERS];   //Callbacks waiting at each index, oldest first.
+    WaitRequest* _pendingTails[MAX_ALLOCATOR_ORDERS];
+    unsigned long _waitingCount;            //Parked threads and pending callbacks.
+    unsigned long _waitedCount;             //Allocations served after waiting, since waiting was turned on.
+
+/* -- I/O Buffers -- */
+    unsigned char* _ioBufferOrders;         //Order plus one of the live buffer starting at each IO_BUFFER_MIN_SIZE of the main arena, 0 elsewhere.
+    unsigned long _ioBufferSlots;           //Entries of _ioBufferOrders, malloc'ed on first use.
+    Addr _ioBufferCache[IO_BUFFER_ORDERS][IO_BUFFER_CACHE_DEPTH];
+    unsigned int _ioBufferCached[IO_BUFFER_ORDERS];
+    unsigned long _ioBufferCount;           //Live buffers.
+    unsigned long _ioBufferBytes;
+
+/* -- Engine -- */
+    AllocatorEngine _engine;
+    Addr _engineMemory;             //Memory handed to the TLSF, lock-free, template or tree engine, when one is selected.
 
 /*--------------------------------------------------------------------------*/
 /* FORWARDS */
 /*--------------------------------------------------------------------------*/
 
+/* Offsets */
+Freestore getArenaFreestore(Arena* arena);
+void setArenaFreestore(Arena* arena, Addr freestoreAddress);
+Addr addressForOffset(Offset offset);
+Offset offsetForAddress(Addr memoryAddress);
+unsigned long* getAllocationBitmap(void);
+Offset* getSlabMap(void);
+
+/* Reserved Memory */
+bool commitArenaRange(Addr memoryAddress, unsigned long length);
+
+/* Allocation Bitmap */
+bool initAllocationBitmap(void);
+bool isAllocationAtAddress(Addr memoryAddress);
+void markAllocationAtAddress(Addr memoryAddress);
+void clearAllocationAtAddress(Addr memoryAddress);
+
 /* Freestore Support Functions */
 void resetFreestore(Freestore freestore, unsigned int range);
 
@@ -122,27 +385,60 @@ unsigned int getAdjustedMinFreestoreIndexForRequestedSize(unsigned int requested
 
 //Freestore Accessors
 FreestoreBlock* getFirstFreestoreBlockAtIndex(unsigned int index);
-FreestoreBlock* getLastFreestoreBlockAtIndex(unsigned int index);
 FreestoreBlock* getFirstFreestoreBlockAtAdjustedIndex(unsigned int index);
-FreestoreBlock* getLastFreestoreBlockAtAdjustedIndex(unsigned int index);
 bool addAddressToFreestoreForIndex(unsigned int index, Addr memoryAddress);
 bool addAddressToFreestoreForAdjustedIndex(unsigned int adjustedIndex, Addr memoryAddress);
-bool removeLastFreestoreBlockAtIndex(unsigned int index);
-bool removeLastFreestoreBlockAtAdjustedIndex(unsigned int index);
+void appendAddressToFreestoreForAdjustedIndex(unsigned int adjustedIndex, Addr memoryAddress);
+Addr popFreestoreBlockAtAdjustedIndex(unsigned int index);
 bool containsFreeSpaceAtAdjustedIndex(unsigned int index);
 
-bool createFreestoreBlockAtAdjustedIndex(unsigned int index);
-
 //Freestore Header Functions
-bool containsFreestoreBlockAtAdjustedIndexWithAddress(unsigned int index, Addr memoryAddress);
-
 FreestoreBlock* createFreestoreHeaderAtAddress(Addr memoryAddress, FreestoreBlock* nextBlock);
 bool removeFreestoreBlockAtIndexWithAddress(unsigned int index, Addr memoryAddress);
 bool removeFreestoreBlockAtAdjustedIndexWithAddress(unsigned int index, Addr memoryAddress);
 
-Addr getAddressAtSide(unsigned int index, Addr memoryAddress, side side);
-bool mergeBuddiesAtAddress(unsigned int index, Addr firstAddress, Addr secondAddress);
-bool attemptBuddyMergeAtAdjustedIndexWithAddress(unsigned int index, Addr memoryAddress);
+//Split and Merge
+Addr getBuddyAddressForAdjustedIndex(unsigned int index, Addr memoryAddress);
+Addr getBlockStartForAdjustedIndex(unsigned int index, Addr memoryAddress);
+Addr takeFreestoreBlockAtAdjustedIndex(unsigned int index);
+bool releaseHeldMemory(void);
+void releaseFreestoreBlockAtAdjustedIndex(unsigned int index, Addr memoryAddress);
+Addr mergeFreestoreBlockAtAdjustedIndex(unsigned int* index, Addr memoryAddress);
+unsigned int getFirstFreeAdjustedIndexFromAdjustedIndex(unsigned int index);
+
+//Lazy Coalescing
+FreestoreBlock* detachFreestoreChainAtAdjustedIndex(unsigned int index);
+FreestoreBlock* sortFreestoreChain(FreestoreBlock* chain);
+unsigned int coalesceFreestoreAtAdjustedIndex(unsigned int index);
+void coalesceFreestore(void);
+void parkFreestoreBlockAtAdjustedIndex(unsigned int index, Addr memoryAddress);
+void returnFreestoreBlockAtAdjustedIndex(unsigned int index, Addr memoryAddress);
+
+//Maintenance
+unsigned int countFreestoreBlocksAtAdjustedIndex(unsigned int index, unsigned int limit);
+bool splitFreestoreBlockIntoAdjustedIndex(unsigned int index);
+void updateReserveTargets(unsigned int arenaIndex);
+void coalesceParkedBlocks(void);
+void refillReserves(unsigned int arenaIndex);
+void* maintenanceMain(void* argument);
+void stopMaintenance(void);
+
+//Size Classes
+unsigned int getSizeClassForLength(unsigned int length);
+unsigned int getSizeForSizeClass(unsigned int sizeClass);
+unsigned int getSlabHeaderSize(void);
+void initSizeClasses(void);
+bool ensureSlabMap(void);
+unsigned int getSlabMapIndexForAddress(Addr memoryAddress);
+SlabHeader* slabForAddress(Addr memoryAddress);
+void setSlabMapEntriesForSlab(SlabHeader* slab, SlabHeader* value);
+void linkPartialSlab(SlabHeader* slab);
+void unlinkPartialSlab(SlabHeader* slab);
+SlabHeader* createSlabForSizeClass(unsigned int sizeClass);
+void releaseSlab(SlabHeader* slab);
+bool releaseEmptySlabs(void);
+Addr allocateSlotForSize(unsigned int size);
+bool deallocateSlotAtAddress(SlabHeader* slab, Addr memoryAddress);
 
 //Freestore Initialization
 Addr subAddressForAdjustedIndex(Addr address, unsigned int index, side splitSide);
@@ -153,16 +449,129 @@ Addr initFreestoreHeader(Addr startAddress, unsigned int minFreestoreIndex, unsi
 unsigned int minFreestoreIndexForSize(unsigned int basic_block_size, unsigned int headerSize);
 unsigned int maxFreestoreIndexForSize(unsigned int basic_block_size, unsigned int length, unsigned int headerSize);
 unsigned int init_allocator(unsigned int basic_block_size, unsigned int length);
+unsigned int init_allocator_with_engine(AllocatorEngine engine, unsigned int basic_block_size, unsigned int length);
+unsigned int init_allocator_numa(unsigned int basic_block_size, unsigned int length);
+unsigned int init_allocator_reserved(unsigned int basic_block_size, unsigned int length);
+unsigned int initArenaWithMemory(unsigned int basic_block_size, unsigned int length, Addr startAddress);
+void resetStatistics(void);
+
+//Mapped Heap
+unsigned int init_allocator_mapped(const char* path, unsigned int basic_block_size, unsigned int length);
+unsigned int init_allocator_shared(const char* name, unsigned int basic_block_size, unsigned int length);
+unsigned int init_allocator_shared_fd(int file, unsigned int basic_block_size, unsigned int length);
+unsigned int initMappedHeapOnFile(int file, unsigned int basic_block_size, unsigned int length, bool shared);
+bool initSharedArenaLock(void);
+bool isMappedHeapHeaderValid(MappedHeapHeader* header, unsigned int basic_block_size, unsigned int length);
+void releaseMappedHeap(void);
+
+//Arenas
+Arena* arenaForAddress(Addr memoryAddress);
+Addr allocateInNodeArena(unsigned int length, unsigned int alignment);
+Addr allocateInLockedArena(unsigned int length, unsigned int alignment);
+void lockArena(void);
+void unlockArena(void);
+void accumulateArenaStats(AllocatorStats* total, AllocatorStats* stats);
 int release_allocator();
 
 //Allocation
-bool canMeetMemoryRequest(unsigned int size);
 MemoryHeader* allocateHeaderForSize(unsigned int size);
+MemoryHeader* allocateAlignedHeaderForSize(unsigned int size, unsigned int alignment);
+unsigned int initTlsfEngine(Addr memory, unsigned int length, unsigned int basicBlockSize);
+unsigned int tlsfOrderSize(unsigned int order);
+void addToCounter(unsigned long* counter, unsigned long amount, bool atomic);
+void subtractFromCounter(unsigned long* counter, unsigned long amount, bool atomic);
+Addr recordEngineAllocation(const EngineOps* ops, Addr address, unsigned int length);
+void recordEngineFree(const EngineOps* ops, unsigned int blockSize, unsigned int requestedSize);
+Addr recordHeaderAllocation(MemoryHeader* header, unsigned int length);
+Addr allocateInArena(unsigned int length);
+Addr allocateAlignedInArena(unsigned int length, unsigned int alignment);
+bool deallocateInArena(Addr memoryAddress);
+int collectArenaStats(AllocatorStats* stats);
+bool isArenaAddress(Addr memoryAddress);
+unsigned int usableSizeInArena(Addr memoryAddress);
+
+//Lifetime Heaps
+unsigned int lifetimeForFlags(unsigned int flags);
+unsigned int lifetimeHeapIndex(void);
+bool lifetimeHeapsAvailable(void);
+Arena* createLifetimeHeap(unsigned int lifetime);
+void releaseLifetimeHeap(unsigned int lifetime, unsigned int slot);
+bool releaseEmptyLifetimeHeaps(void);
+bool isLifetimeHeap(Arena* arena);
+Arena* lifetimeHeapForAddress(Addr memoryAddress, unsigned int* lifetime, unsigned int* slot);
+Addr allocateInLifetimeHeaps(unsigned int lifetime, unsigned int length);
+int deallocateInLifetimeHeap(Addr memoryAddress);
+void collectLifetimeStats(AllocatorStats* stats);
+
+//Handles
+HandleEntry* entryForHandle(Handle handle);
+Handle createHandle(Addr address, bool movable);
+void sortFreestoreAtAdjustedIndex(unsigned int index);
+bool moveHandleBlock(HandleEntry* entry);
+bool compactHandles(unsigned int microseconds);
+void releaseHandles(void);
+
+//Waiting Allocations
+void stopWaiting(void);
+unsigned int highestFreeAdjustedIndex(void);
+Addr allocateWaitingRequest(unsigned int length);
+WaitRequest* serveWaitingAllocations(void);
+void completeWaitingAllocations(WaitRequest* ready);
+
+//I/O Buffers
+bool ioBuffersAvailable(void);
+unsigned int ioBufferOrderForLength(unsigned int length);
+unsigned int ioBufferIndexForOrder(unsigned int order);
+unsigned int ioBufferCacheDepth(unsigned int order);
+unsigned long ioBufferSlotForAddress(Addr memoryAddress);
+bool flushIoBufferCache(void);
+Addr allocateIoBuffer(unsigned int order);
+bool deallocateIoBuffer(Addr memoryAddress);
+void releaseIoBuffers(void);
+
+//Large Allocations
+unsigned long largestArenaRequest(void);
+bool isLargeRequest(unsigned int length);
+Addr allocateLarge(unsigned int length, unsigned int alignment);
 
 MemoryHeader* memoryHeaderForAddress(Addr memoryAddress);
 bool deallocateHeaderAtAddress(Addr memoryAddress);
 bool deallocateHeader(MemoryHeader* header);
 
+/*--------------------------------------------------------------------------*/
+// OFFSETS
+/*--------------------------------------------------------------------------*/
+
+Freestore getArenaFreestore(Arena* arena)
+{
+    return (arena->freestoreDistance != 0) ? (Freestore)((Addr)arena + arena->freestoreDistance) : EMPTY_ADDRESS;
+}
+
+void setArenaFreestore(Arena* arena, Addr freestoreAddress)
+{
+    arena->freestoreDistance = (freestoreAddress != EMPTY_ADDRESS) ? (freestoreAddress - (Addr)arena) : 0;
+}
+
+Addr addressForOffset(Offset offset)
+{
+    return (offset != EMPTY_OFFSET) ? ((Addr)getArenaFreestore(_arena) + offset) : EMPTY_ADDRESS;
+}
+
+Offset offsetForAddress(Addr memoryAddress)
+{
+    return (memoryAddress != EMPTY_ADDRESS) ? (Offset)(memoryAddress - (Addr)getArenaFreestore(_arena)) : EMPTY_OFFSET;
+}
+
+unsigned long* getAllocationBitmap(void)
+{
+    return addressForOffset(_arena->allocationBitmap);
+}
+
+Offset* getSlabMap(void)
+{
+    return addressForOffset(_arena->slabMap);
+}
+
 /*--------------------------------------------------------------------------*/
 // SUPPORT FUNCTIONS FOR FREESTORE
 /*--------------------------------------------------------------------------*/
@@ -174,8 +583,8 @@ void resetFreestore(Freestore freestore, unsigned int range)
     for(int i = 0; i <= range; i++)
     {
         FreestoreBlock* block = &freestore[i];   //Reset all values.
-        block->address = EMPTY_ADDRESS;
-        block->nextBlock = EMPTY_ADDRESS;
+        block->address = EMPTY_OFFSET;
+        block->nextBlock = EMPTY_OFFSET;
         //printf("Reset FreestoreBlock[%d] : Address: %p NextBlock: %p \n", i, block->address, block->nextBlock);
     }
     //printf("-\n\n");
@@ -183,8 +592,8 @@ void resetFreestore(Freestore freestore, unsigned int range)
 
 void printFreestoreBlock(FreestoreBlock* block, unsigned int index)
 {
-    Addr blockAddress = block->address;
-    Addr nextBlockAddress = block->nextBlock;
+    Addr blockAddress = addressForOffset(block->address);
+    Addr nextBlockAddress = addressForOffset(block->nextBlock);
     unsigned int indexSize = getSizeForAdjustedFreestoreIndex(index);
     printf("FreestoreBlock (Size:%d) : Address: %p NextBlock: %p \n", indexSize, blockAddress, nextBlockAddress);
 }
@@ -195,8 +604,8 @@ void printFreestore(Freestore freestore, unsigned int range)
     for(int i = 0; i <= range; i++)
     {
         FreestoreBlock* block = &freestore[i];
-        Addr blockAddress = block->address;
-        Addr nextBlockAddress = block->nextBlock;
+        Addr blockAddress = addressForOffset(block->address);
+        Addr nextBlockAddress = addressForOffset(block->nextBlock);
         unsigned int indexSize = getSizeForAdjustedFreestoreIndex(i);
         printf("FreestoreBlock[%d] (Size:%d) (Addr:%p) : Address: %p NextBlock: %p \n", i, indexSize, block, blockAddress, nextBlockAddress);
     }
@@ -205,15 +614,15 @@ void printFreestore(Freestore freestore, unsigned int range)
 
 void printDefaultFreestore(void)
 {
-    Freestore freestore = _freestoreAddress;
-    unsigned int range = _freestoreRange;
+    Freestore freestore = getArenaFreestore(_arena);
+    unsigned int range = _arena->freestoreRange;
     
     printf("-Printing Freestore Headers: Range(%d) \n",range);
     for(int i = 0; i <= range; i++)
     {
         FreestoreBlock* block = &freestore[i];
-        Addr blockAddress = block->address;
-        Addr nextBlockAddress = block->nextBlock;
+        Addr blockAddress = addressForOffset(block->address);
+        Addr nextBlockAddress = addressForOffset(block->nextBlock);
         unsigned int indexSize = getSizeForAdjustedFreestoreIndex(i);
         printf("FreestoreBlock[%d] (Size:%d) (Addr:%p) : Address: %p NextBlock: %p \n", i, indexSize, block, blockAddress, nextBlockAddress);
     }
@@ -226,12 +635,12 @@ void printDefaultFreestore(void)
  */
 unsigned int getSizeForFreestoreIndex(unsigned int index)
 {
-    unsigned int size = _basic_block_size;
+    unsigned int size = _arena->basicBlockSize;
     
     if(index > 0)
     {
         unsigned int exponent = (1 << index);   //2^3 = 8
-        size = (exponent * _basic_block_size);
+        size = (exponent * _arena->basicBlockSize);
     }
     
     return size;
@@ -241,11 +650,11 @@ unsigned int getFreestoreIndexForSize(unsigned int size)
 {
     unsigned int index = 0;
     
-    if(_basic_block_size < size)
+    if(_arena->basicBlockSize < size)
     {
         //If BBS = 128, and size = 256, index will be 1 (2^i * BBS).
         //If BBS = 128 and size = 512, index will be 2 (2^2 * 128) = 512.
-        double reducedSize = (size / (_basic_block_size * 1.0)); //2^i = (512/128) => 2^i = 4
+        double reducedSize = (size / (_arena->basicBlockSize * 1.0)); //2^i = (512/128) => 2^i = 4
         double logSize = log2(reducedSize); //log2(4) = i
         index = ceil(logSize);
     }
@@ -258,7 +667,7 @@ unsigned int getFreestoreIndexForSize(unsigned int size)
 //Adjusted for space-saving technique described above.
 unsigned int getSizeForAdjustedFreestoreIndex(unsigned int index)
 {
-    unsigned int adjustedIndex = (index + _minFreestoreIndex);  //Unadjust the size
+    unsigned int adjustedIndex = (index + _arena->minFreestoreIndex);  //Unadjust the size
     unsigned int size = getSizeForFreestoreIndex(adjustedIndex);
     return size;
 }
@@ -267,9 +676,9 @@ unsigned int getAdjustedFreestoreIndexForSize(unsigned int size)
 {
     unsigned int index = 0;
     
-    if(_minFreestoreIndexMemorySize < size){
+    if(_arena->minFreestoreIndexMemorySize < size){
         index = getFreestoreIndexForSize(size);
-        index = adjustedIndex(index, _minFreestoreIndex);
+        index = adjustedIndex(index, _arena->minFreestoreIndex);
     }
     
     return index;
@@ -277,80 +686,50 @@ unsigned int getAdjustedFreestoreIndexForSize(unsigned int size)
 
 unsigned int getAdjustedMinFreestoreIndexForRequestedSize(unsigned int requestedSized)
 {
-    unsigned int completeSize = requestedSized + _headerSize;
+    unsigned int completeSize = requestedSized + _arena->headerSize;
     unsigned int minimum = getFreestoreIndexForSize(completeSize);
-    minimum = adjustedIndex(minimum, _minFreestoreIndex);
+    minimum = adjustedIndex(minimum, _arena->minFreestoreIndex);
     return minimum;
 }
 
 FreestoreBlock* getFirstFreestoreBlockAtIndex(unsigned int index)
 {
-    unsigned int adjustedIndex = adjustedIndex(index, _minFreestoreIndex);
+    unsigned int adjustedIndex = adjustedIndex(index, _arena->minFreestoreIndex);
     return getFirstFreestoreBlockAtAdjustedIndex(adjustedIndex);
 }
 
-/*
-    Returns the last freestore block in the chain.
- */
-FreestoreBlock* getLastFreestoreBlockAtIndex(unsigned int index)
-{
-    unsigned int adjustedIndex = adjustedIndex(index, _minFreestoreIndex);
-    return getLastFreestoreBlockAtAdjustedIndex(adjustedIndex);
-}
-
 FreestoreBlock* getFirstFreestoreBlockAtAdjustedIndex(unsigned int adjustedIndex)
 {
-    Freestore freestore = _freestoreAddress;
+    Freestore freestore = getArenaFreestore(_arena);
     FreestoreBlock* block = &freestore[adjustedIndex];
     return block;
 }
 
-FreestoreBlock* getLastFreestoreBlockAtAdjustedIndex(unsigned int adjustedIndex)
-{
-    Freestore freestore = _freestoreAddress;
-    FreestoreBlock* block = 0x0;
-
-    block = &freestore[adjustedIndex];
-    FreestoreBlock* nextBlock = block->nextBlock;
-    
-    //Iterate to the last block.
-        while(nextBlock != 0x0)
-        {
-            nextBlock = block->nextBlock;
-            if(nextBlock != 0x0)
-            {
-                block = nextBlock;
-            }
-        }
-    
-    return block;
-}
-
 bool addAddressToFreestoreForIndex(unsigned int index, Addr memoryAddress)
 {
-    unsigned int adjustedIndex = adjustedIndex(index, _minFreestoreIndex);
+    unsigned int adjustedIndex = adjustedIndex(index, _arena->minFreestoreIndex);
     return addAddressToFreestoreForAdjustedIndex(adjustedIndex, memoryAddress);
 }
 
+/*
+    Chains the address into the freestore in constant time.
+ 
+    The index's first block lives in the freestore array itself, so the new block is linked in right behind it.
+    Order within an index doesn't matter to the allocator.
+ */
 bool addAddressToFreestoreForAdjustedIndex(unsigned int adjustedIndex, Addr memoryAddress)
 {
     bool success = false;
-    FreestoreBlock* lastBlock = getLastFreestoreBlockAtAdjustedIndex(adjustedIndex);
+    FreestoreBlock* firstBlock = getFirstFreestoreBlockAtAdjustedIndex(adjustedIndex);
     
     //Check to see if it is the default block.
-    Addr lastBlockAddressValue = lastBlock->address;
-    
-    if(lastBlockAddressValue == 0x0)
+    if(firstBlock->address == EMPTY_OFFSET)
     {
-        lastBlock->address = memoryAddress; //Just set the address. Easy.
+        firstBlock->address = offsetForAddress(memoryAddress); //Just set the address. Easy.
     } else {
-        
-        FreestoreBlock* newBlock = memoryAddress;   //Create the new block at the address.
-        
-        newBlock->address = memoryAddress;
-        newBlock->nextBlock = EMPTY_ADDRESS;
-        
-        lastBlock->nextBlock = newBlock;            //Make the last block point to this one.
+        //Create the new block at the address, and put it behind the first.
+        FreestoreBlock* newBlock = createFreestoreHeaderAtAddress(memoryAddress, addressForOffset(firstBlock->nextBlock));
+        firstBlock->nextBlock = offsetForAddress(newBlock);
     }
 
     success = true;
@@ -358,138 +737,76 @@ bool addAddressToFreestoreForAdjustedIndex(unsigned int adjustedIndex, Addr memo
     return success;
 }
 
-bool removeLastFreestoreBlockAtIndex(unsigned int index)
+/*
+    Chains the block in as the last one of the index, so blocks kept in order by address stay that way
+    when the block is above them all. Walks the chain.
+ */
+void appendAddressToFreestoreForAdjustedIndex(unsigned int adjustedIndex, Addr memoryAddress)
 {
-    unsigned int adjustedIndex = adjustedIndex(index, _minFreestoreIndex);
-    return removeLastFreestoreBlockAtAdjustedIndex(adjustedIndex);
+    FreestoreBlock* block = getFirstFreestoreBlockAtAdjustedIndex(adjustedIndex);
+    
+    if(block->address == EMPTY_OFFSET)
+    {
+        block->address = offsetForAddress(memoryAddress);
+        return;
+    }
+    
+    while(block->nextBlock != EMPTY_OFFSET)
+    {
+        block = addressForOffset(block->nextBlock);
+    }
+    
+    block->nextBlock = offsetForAddress(createFreestoreHeaderAtAddress(memoryAddress, EMPTY_ADDRESS));
 }
 
-bool removeLastFreestoreBlockAtAdjustedIndex(unsigned int index)
+/*
+    Removes the first free block at the index in constant time, and returns its address.
+ 
+    Returns EMPTY_ADDRESS if the index has no free blocks.
+ */
+Addr popFreestoreBlockAtAdjustedIndex(unsigned int adjustedIndex)
 {
-    bool success = false;
+    FreestoreBlock* firstBlock = getFirstFreestoreBlockAtAdjustedIndex(adjustedIndex);
+    Addr address = addressForOffset(firstBlock->address);
+    FreestoreBlock* nextBlock = addressForOffset(firstBlock->nextBlock);
     
-    Freestore freestore = _freestoreAddress;
-    FreestoreBlock* block = &freestore[index];
-    FreestoreBlock* lastBlock = block->nextBlock;
-    
-    //The Freestore Index Header block is first.
-    if(lastBlock == 0x0)
+    if(nextBlock != 0x0)
     {
-        //Clear the address.
-        block->address = EMPTY_ADDRESS;
-    } else {
-        
-        //Find the last block in the chain, then remove it.
-        FreestoreBlock* nextToLastBlock = block;
-        lastBlock = block->nextBlock;
-    
-        while(true)
-        {
-            FreestoreBlock* nextBlock = lastBlock->nextBlock;
-            if(nextBlock != 0x0)
-            {
-                nextToLastBlock = lastBlock;
-                lastBlock = nextBlock;
-            } else {
-                break;
-            }
-        }
-        
-        //Clear Last Block
-        lastBlock->address = EMPTY_ADDRESS;
-        lastBlock->nextBlock = EMPTY_ADDRESS;
+        //Move the second block up into the freestore array.
+        firstBlock->address = nextBlock->address;
+        firstBlock->nextBlock = nextBlock->nextBlock;
         
-        //Clear Next To Last Block's pointer.
-        nextToLastBlock->nextBlock = EMPTY_ADDRESS;
+        nextBlock->address = EMPTY_OFFSET;
+        nextBlock->nextBlock = EMPTY_OFFSET;
+    } else {
+        firstBlock->address = EMPTY_OFFSET;
     }
     
-    return success;
+    return address;
 }
 
 bool containsFreeSpaceAtAdjustedIndex(unsigned int index)
 {
     bool contained = false;
     
-    Freestore freestore = _freestoreAddress;
+    Freestore freestore = getArenaFreestore(_arena);
     FreestoreBlock* block = &freestore[index];
-    contained = (block->address != 0x0);
+    contained = (block->address != EMPTY_OFFSET);
     
     return contained;
 }
 
-bool createFreestoreBlockAtAdjustedIndex(unsigned int adjustedIndex)
-{
-    //Will create a new one, regardless if one already exists at this index.
-    bool success = false;
-
-    //Check to see if freespace at the upper index exists.
-    //If one doesn't exist, recursively call this to create one at the next index.
-    unsigned int splitIndex = adjustedIndex + 1;
-    
-    //Bug Patch: Keeps the program from crashing when it attempts to split the largest value.
-    if(splitIndex >= _freestoreRange){
-        return false;
-    }
-    
-    bool splitIndexContainsBlock = containsFreeSpaceAtAdjustedIndex(splitIndex);
-    bool splitSuccess = false;
-    
-    if(splitIndexContainsBlock == false)
-    {
-        //Recursively split the next block.
-        splitSuccess = createFreestoreBlockAtAdjustedIndex(splitIndex);
-    }
-
-        //This code is executed when either a split occurs or the index contains a block.
-    if (splitSuccess || splitIndexContainsBlock)
-    {
-        FreestoreBlock* lastBlock = getLastFreestoreBlockAtAdjustedIndex(splitIndex);
-        Addr address = lastBlock->address;
-        
-        //Remove this from the chain.
-        removeLastFreestoreBlockAtAdjustedIndex(splitIndex);
-        
-        //Split this address into two next Freestore blocks.
-        Addr leftAddress = subAddressForAdjustedIndex(address, splitIndex, left);
-        Addr rightAddress = subAddressForAdjustedIndex(address, splitIndex, right);
-        
-        //Add these addresses to the freestore
-        addAddressToFreestoreForAdjustedIndex(adjustedIndex, leftAddress);
-        addAddressToFreestoreForAdjustedIndex(adjustedIndex, rightAddress);
-        
-        //Mark our success.
-        success = true;
-    }
-    
-    return success;
-}
-
 FreestoreBlock* createFreestoreHeaderAtAddress(Addr memoryAddress, FreestoreBlock* nextBlock)
 {
     FreestoreBlock* block = memoryAddress;
-    block->address = memoryAddress;
-    block->nextBlock = nextBlock;
+    block->address = offsetForAddress(memoryAddress);
+    block->nextBlock = offsetForAddress(nextBlock);
     return block;
 }
 
-bool containsFreestoreBlockAtAdjustedIndexWithAddress(unsigned int index, Addr memoryAddress)
-{
-    bool contained = false;
-
-    Freestore freestore = _freestoreAddress;
-    FreestoreBlock* block = &freestore[index];
-    
-    while (block != 0x0 && (contained == false)) {
-        contained = (block->address == memoryAddress);
-        block = block->nextBlock;
-    }
-
-    return contained;
-}
-
 bool removeFreestoreBlockAtIndexWithAddress(unsigned int index, Addr memoryAddress)
 {
-    unsigned int adjustedIndex = adjustedIndex(index, _minFreestoreIndex);
+    unsigned int adjustedIndex = adjustedIndex(index, _arena->minFreestoreIndex);
     return removeFreestoreBlockAtAdjustedIndexWithAddress(adjustedIndex, memoryAddress);
 }
 
@@ -497,57 +814,57 @@ bool removeFreestoreBlockAtAdjustedIndexWithAddress(unsigned int index, Addr mem
 {
     bool success = false;
 
-    Freestore freestore = _freestoreAddress;
+    Freestore freestore = getArenaFreestore(_arena);
     FreestoreBlock* initialBlock = &freestore[index];
     
-    if(initialBlock->address == memoryAddress)
+    if(addressForOffset(initialBlock->address) == memoryAddress)
     {
-        initialBlock->address = 0x0;
+        initialBlock->address = EMPTY_OFFSET;
         
         //Now we'll have to remove the first chained block, if it exists.
         //If it doesn't exist, we're done.
         
-        FreestoreBlock* nextBlock = initialBlock->nextBlock;
+        FreestoreBlock* nextBlock = addressForOffset(initialBlock->nextBlock);
         
         if(nextBlock != 0x0)
         {
-            Addr nextAddress = nextBlock->address;
-            initialBlock->address = nextAddress;
+            Addr nextAddress = addressForOffset(nextBlock->address);
+            initialBlock->address = offsetForAddress(nextAddress);
             
             //Now remove the "nextBlock" from the link.
-            FreestoreBlock* continueBlock = nextBlock->nextBlock;
-            initialBlock->nextBlock = continueBlock;
+            FreestoreBlock* continueBlock = addressForOffset(nextBlock->nextBlock);
+            initialBlock->nextBlock = offsetForAddress(continueBlock);
             
             //Clear the rest of nextBlock. It shouldn't be referenced anymore at this point.
-            nextBlock->nextBlock = EMPTY_ADDRESS;
-            nextBlock->address = EMPTY_ADDRESS;
+            nextBlock->nextBlock = EMPTY_OFFSET;
+            nextBlock->address = EMPTY_OFFSET;
         }
         
         success = true;
     } else {
         
-        FreestoreBlock* currentBlock = initialBlock->nextBlock;
+        FreestoreBlock* currentBlock = addressForOffset(initialBlock->nextBlock);
         FreestoreBlock* nextBlock = 0x0;
         FreestoreBlock* nextToLastBlock = initialBlock;
         
         while (currentBlock != 0x0) {
             
-            nextBlock = currentBlock->nextBlock;
+            nextBlock = addressForOffset(currentBlock->nextBlock);
             
-            Addr blockAddress = currentBlock->address;
+            Addr blockAddress = addressForOffset(currentBlock->address);
             if(blockAddress == memoryAddress)
             {
                 //Remove this block.
-                currentBlock->address = EMPTY_ADDRESS;
-                currentBlock->nextBlock = EMPTY_ADDRESS;
+                currentBlock->address = EMPTY_OFFSET;
+                currentBlock->nextBlock = EMPTY_OFFSET;
                 
                 //Patch the link between nextBlock and lastBlock
-                nextToLastBlock->nextBlock = nextBlock;
+                nextToLastBlock->nextBlock = offsetForAddress(nextBlock);
                 success = true;
                 
             } else {
                 nextToLastBlock = currentBlock;
-                currentBlock = currentBlock->nextBlock;
+                currentBlock = addressForOffset(currentBlock->nextBlock);
             }
         }
     }
@@ -555,489 +872,4266 @@ bool removeFreestoreBlockAtAdjustedIndexWithAddress(unsigned int index, Addr mem
     return success;
 }
 
-Addr getContiguousAddressAtSide(unsigned int index, Addr memoryAddress, side side)
+/*
+    Returns the address of the buddy of the block at memoryAddress, or EMPTY_ADDRESS if it has none.
+ 
+    Every block is aligned to its own size relative to the start of the freestore, counted in basic blocks,
+    so the buddy is found by flipping the bit for the index in the block's offset.
+    The leftover blocks past the largest index follow the same rule; their buddies just never come free whole.
+ */
+Addr getBuddyAddressForAdjustedIndex(unsigned int index, Addr memoryAddress)
 {
     unsigned int indexSize = getSizeForAdjustedFreestoreIndex(index);
-    Addr buddyAddress = EMPTY_ADDRESS;
+    unsigned long indexBlocks = (indexSize / _arena->basicBlockSize);
     
-    switch (side) {
-        case left:
-        {
-            buddyAddress = (memoryAddress - indexSize);
-        }break;
-        case right:
-        {
-            buddyAddress = (memoryAddress + indexSize);
-        }break;
-        default: break;
+    Addr startAddress = getArenaFreestore(_arena);
+    unsigned long offsetBlocks = ((memoryAddress - startAddress) / _arena->basicBlockSize);
+    unsigned long buddyOffset = ((offsetBlocks ^ indexBlocks) * _arena->basicBlockSize);
+    
+    //Past the end of the memory there is nothing to merge with.
+    if((buddyOffset + indexSize) > _arena->length)
+    {
+        return EMPTY_ADDRESS;
     }
     
-    return buddyAddress;
+    return (startAddress + buddyOffset);
 }
 
-bool mergeBuddiesAtAddress(unsigned int adjustedIndex, Addr firstAddress, Addr secondAddress)
+/*
+    Returns the start of the block at the given index that holds the address.
+ 
+    Blocks always start at a multiple of their own size from the start of the memory, so the offset only has to be masked.
+ */
+Addr getBlockStartForAdjustedIndex(unsigned int index, Addr memoryAddress)
 {
-    bool success = false;
+    unsigned long indexBlocks = (getSizeForAdjustedFreestoreIndex(index) / _arena->basicBlockSize);
     
-    /*
-        This function will not check to see if firstAddress and secondAddress are even connected.
-     
-        Used attemptBuddyMergeAtAdjustedIndexWithAddress to handle that.
-     */
-    bool removedFirst = removeFreestoreBlockAtAdjustedIndexWithAddress(adjustedIndex, firstAddress);
-    bool removedSecond = removeFreestoreBlockAtAdjustedIndexWithAddress(adjustedIndex, secondAddress);
+    Addr startAddress = getArenaFreestore(_arena);
+    unsigned long offsetBlocks = ((memoryAddress - startAddress) / _arena->basicBlockSize);
+    
+    return (startAddress + ((offsetBlocks & ~(indexBlocks - 1)) * _arena->basicBlockSize));
+}
+
+/*
+    Removes a free block from the given index and returns its address, splitting a larger block if needed.
+ 
+    The larger block is taken from the lowest index above that has one, then split on the way down:
+    each step keeps the lower half and chains the upper half into the index below.
+ 
+    Returns EMPTY_ADDRESS if no index at or above the given one has free space.
+ */
+Addr takeFreestoreBlockAtAdjustedIndex(unsigned int adjustedIndex)
+{
+    unsigned int index = getFirstFreeAdjustedIndexFromAdjustedIndex(adjustedIndex);
+    
+    if(index > _arena->freestoreRange && releaseHeldMemory())
+    {
+        index = getFirstFreeAdjustedIndexFromAdjustedIndex(adjustedIndex);
+    }
     
-    if(!removedFirst || !removedSecond)
+    if(index > _arena->freestoreRange)
     {
-        printf("ERROR> Merge Failed. One or more buddy(s) could not be removed from the freestore. \n");
+        return EMPTY_ADDRESS;
     }
     
-    //The Lowest Address is the Right-most address that will encompass both.
-    Addr nextAddress = (firstAddress < secondAddress) ? firstAddress : secondAddress;
+    //Commit the block handed out and the headers of the upper halves before anything is written,
+    //so a failed commit leaves the freestore as it was.
+    Addr blockAddress = addressForOffset(getFirstFreestoreBlockAtAdjustedIndex(index)->address);
     
-    unsigned superIndex = adjustedIndex + 1;
-    success = addAddressToFreestoreForAdjustedIndex(superIndex, nextAddress);
-    return success;
+    if(_arena->reservedLength > 0)
+    {
+        bool committed = commitArenaRange(blockAddress, getSizeForAdjustedFreestoreIndex(adjustedIndex));
+        
+        for(unsigned int i = adjustedIndex; committed == true && i < index; i++)
+        {
+            committed = commitArenaRange(blockAddress + getSizeForAdjustedFreestoreIndex(i), sizeof(FreestoreBlock));
+        }
+        
+        if(committed == false)
+        {
+            return EMPTY_ADDRESS;
+        }
+    }
+    
+    Addr address = popFreestoreBlockAtAdjustedIndex(index);
+    
+    if(_arena->lazyCount[index] > 0)
+    {
+        _arena->lazyCount[index] -= 1;
+    }
+    
+    while(index > adjustedIndex)
+    {
+        index--;
+        Addr upperAddress = (address + getSizeForAdjustedFreestoreIndex(index));
+        addAddressToFreestoreForAdjustedIndex(index, upperAddress);
+        _arena->splitCount += 1;
+    }
+    
+    return address;
 }
 
-side getBuddySideForAddress(unsigned int index, Addr memoryAddress)
+/*
+    Gives the current arena back the memory held on to for later requests, before one fails:
+    the main arena's cached I/O buffers and empty sub-heaps, the empty slabs of each size class, and lazily
+    freed blocks, merged with whatever came back.
+ 
+    Returns whether anything may have been freed up.
+ */
+bool releaseHeldMemory(void)
 {
+    bool released = false;
     
-    //First, we need to protect the freestore with a quick check.
-    //If the starting address matches the buddy address here, stop, since we don't want to corrupt our freestore.
-    unsigned int indexSize = getSizeForAdjustedFreestoreIndex(index);
-    bool buddyIsFreestore = (_freestoreAddress == (memoryAddress - indexSize));
-
-    if (buddyIsFreestore)
+    if(_arena == _arenas[0] && flushIoBufferCache())
     {
-        return neither;
+        released = true;
     }
     
-    /*
-     The buddy for this address is continguous, so it is either before or after this address.
-     To figure this out, we need to check the bit the index coordinates to.
-     
-     Since we just need to know left or right (we know how far in either direction to reach the FreestoreHeader),
-     we can use what we know to find this.
-     
-     What we know:
-     - Start Address
-     - Current Address
-     - Distance from start address
-     - Index
-     
-     Using these alone, we can see whether or not this is odd or even by comparing them to the initial address.
-     If our address is even, then:
-     If it is odd, this is the left block; if it's even, we're the right block.
-     
-     Simple Binary Example:
-     00 01
-     
-     We'll use math to reduce the address into an even or odd value.
-     
-     */
-    
-    
-    Addr startAddress = _freestoreAddress;
-    /*
-    long startAddressValue = (long)startAddress;    //Long to support 64bit systems.
-    bool startAddressIsEven = ((startAddressValue%1) == 0);
-    */
+    if(_arena == _arenas[0] && _lifetimeHeapTotal > 0 && releaseEmptyLifetimeHeaps())
+    {
+        released = true;
+    }
     
-    //Now that we know whether or not the address is even, we can now see the difference.
-    //long memoryAddressValue = (long)memoryAddress;
-    long difference = (memoryAddress - startAddress); //Difference from the start address to this address.
+    if(releaseEmptySlabs())
+    {
+        released = true;
+    }
     
-    //Since difference was computed with the basic block size, remove that.
-    long basicDifference = (difference / _basic_block_size);
+    if(_arena->lazyThreshold > 0 || (_maintenanceInterval > 0 && !isLifetimeHeap(_arena)))
+    {
+        coalesceFreestore();
+        released = true;
+    }
     
-    //This basic difference means if everything were in index 0, it would be this many blocks of BBS over.
-    bool basicDifferenceIsEven = ((basicDifference%1) == 0);
+    return released;
+}
+
+/*
+    Returns the block at memoryAddress to the freestore, merging it with its buddies on the way up.
+ 
+    Each step removes the buddy from its index if it is free; otherwise the merged block is chained in there.
+    The block must not already be in the freestore.
+ */
+void releaseFreestoreBlockAtAdjustedIndex(unsigned int adjustedIndex, Addr memoryAddress)
+{
+    unsigned int index = adjustedIndex;
+    Addr address = mergeFreestoreBlockAtAdjustedIndex(&index, memoryAddress);
     
-    side memorySide = ((basicDifferenceIsEven) ? right : left);
-    return memorySide;
+    addAddressToFreestoreForAdjustedIndex(index, address);
 }
 
-bool attemptBuddyMergeAtAdjustedIndexWithAddress(unsigned int index, Addr memoryAddress)
+/*
+    Merges the block at memoryAddress with its free buddies, taking them out of the freestore, and returns the
+    start of the merged block, with its index left in index. The merged block itself isn't chained in.
+ */
+Addr mergeFreestoreBlockAtAdjustedIndex(unsigned int* index, Addr memoryAddress)
 {
-    bool mergeSuccess = true;
-    side buddySide = getBuddySideForAddress(index, memoryAddress);
+    Addr address = memoryAddress;
     
-    if(buddySide != neither)
+    while(*index < _arena->freestoreRange)
     {
-        //Continue to attempt to merge buddies.
-        Addr buddyAddress = getContiguousAddressAtSide(index, memoryAddress, buddySide);
+        Addr buddyAddress = getBuddyAddressForAdjustedIndex(*index, address);
         
-        if(buddyAddress != EMPTY_ADDRESS)
+        if(buddyAddress == EMPTY_ADDRESS || removeFreestoreBlockAtAdjustedIndexWithAddress(*index, buddyAddress) == false)
         {
-            //Once last check to see they exist in the freestore.
-            bool memoryAddressExistsInFreestore = containsFreestoreBlockAtAdjustedIndexWithAddress(index, memoryAddress);
-            bool buddyAddressExistsInFreestore = containsFreestoreBlockAtAdjustedIndexWithAddress(index, buddyAddress);
-            
-            if(memoryAddressExistsInFreestore && buddyAddressExistsInFreestore)
-            {
-                mergeSuccess = mergeBuddiesAtAddress(index, memoryAddress, buddyAddress);
-                
-                if(mergeSuccess)
-                {
-                    unsigned int upperIndex = index + 1;
-                    if(buddySide == left)
-                    {
-                        attemptBuddyMergeAtAdjustedIndexWithAddress(upperIndex, buddyAddress);
-                    } else {
-                        attemptBuddyMergeAtAdjustedIndexWithAddress(upperIndex, memoryAddress);
-                    }
-                }
-            }
+            break;
         }
+        
+        //The lower address is the start of the merged block.
+        address = (address < buddyAddress) ? address : buddyAddress;
+        *index += 1;
+        _arena->mergeCount += 1;
     }
     
-    return mergeSuccess;
+    return address;
 }
 
-/*--------------------------------------------------------------------------*/
-// INITIALIZATION FUNCTIONS FOR FREESTORE
-/*--------------------------------------------------------------------------*/
-
-Addr subAddressForAdjustedIndex(Addr address, unsigned int index, side splitSide)
+/*
+    Returns the lowest index at or above the given one with a free block, or an index past _arena->freestoreRange if none has one.
+ */
+unsigned int getFirstFreeAdjustedIndexFromAdjustedIndex(unsigned int adjustedIndex)
 {
-    Addr returnAddress = address;
+    unsigned int index = adjustedIndex;
     
-    if(splitSide == right)
+    while(index <= _arena->freestoreRange && containsFreeSpaceAtAdjustedIndex(index) == false)
     {
-        unsigned int size = getSizeForAdjustedFreestoreIndex(index);
-        unsigned int splitSize = size/2;
-        returnAddress = (address + splitSize);
+        index++;
     }
     
-    return returnAddress;
+    return index;
 }
 
+/*--------------------------------------------------------------------------*/
+// LAZY COALESCING
+/*--------------------------------------------------------------------------*/
+
 /*
-    We'll protect the header by permanently allocating a chunk of the memory to the freestore header.
+    In lazy mode a freed block is parked at its own index without looking for its buddy, 
+    so a block that is freed and requested again at the same size is never merged and split back down.
  
-    We'll attempt to minimize the memory usage by storing it in the smallest index possible.
- 
-    The header is incomplete here, since no headers have been written yet.
+    An index is coalesced once it holds more than _arena->lazyThreshold lazily freed blocks, and everything is
+    coalesced before an allocation is allowed to fail.
  */
-bool protectFreestoreHeader(Freestore freestore, unsigned int minFreestoreIndex, unsigned int maxFreestoreIndex)
+
+/*
+    Empties the index and returns its free blocks as one chain, with every block's header written at its own address.
+ */
+FreestoreBlock* detachFreestoreChainAtAdjustedIndex(unsigned int adjustedIndex)
 {
-    unsigned int freestoreRange = adjustedIndex(maxFreestoreIndex, minFreestoreIndex);
-    unsigned int adjustedMaxFreestoreIndex = freestoreRange;
+    FreestoreBlock* firstBlock = getFirstFreestoreBlockAtAdjustedIndex(adjustedIndex);
+    FreestoreBlock* chain = EMPTY_ADDRESS;
     
-    //Calculate size of the array
-    unsigned int blockSize = sizeof(FreestoreBlock);
-    unsigned int arraySize = blockSize * freestoreRange;
-    
-    //Retrieve the minimum Memory Block Index we can fit this freestore block into.
-    unsigned int storeIndex = getAdjustedMinFreestoreIndexForRequestedSize(arraySize);
-    _freestoreIndex = storeIndex;
-    
-    unsigned int maxIndexSize = getSizeForFreestoreIndex(maxFreestoreIndex);
+    if(firstBlock->address != EMPTY_OFFSET)
+    {
+        chain = createFreestoreHeaderAtAddress(addressForOffset(firstBlock->address), addressForOffset(firstBlock->nextBlock));
+        firstBlock->address = EMPTY_OFFSET;
+        firstBlock->nextBlock = EMPTY_OFFSET;
+    }
     
-    //Start building the free memory blocks space and the freestore by recursively splitting the open space.
-    //We treat this area as the size of the maximum index.
+    return chain;
+}
+
+/*
+    Merge sorts the chain by address, so that buddies end up next to each other.
+ */
+FreestoreBlock* sortFreestoreChain(FreestoreBlock* chain)
+{
+    if(chain == 0x0 || chain->nextBlock == EMPTY_OFFSET)
+    {
+        return chain;
+    }
     
-    //Freestore marks the start of the allocated memory.
-    Addr currentLeftAddress = freestore;
+    //Split the chain in half.
+    FreestoreBlock* slowBlock = chain;
+    FreestoreBlock* fastBlock = addressForOffset(chain->nextBlock);
     
-    //Break up the blocks to fit into this, and give those blocks headers and put them into the freestore.
-    for(unsigned int i = adjustedMaxFreestoreIndex; i > storeIndex; i -= 1)
+    while(fastBlock != 0x0 && fastBlock->nextBlock != EMPTY_OFFSET)
     {
-        unsigned int subIndex = i - 1;
-        
-        //Split up the greatest index first into the left and right.
-        Addr leftAddress = subAddressForAdjustedIndex(currentLeftAddress, i, left);
-        Addr rightAddress = subAddressForAdjustedIndex(currentLeftAddress, i, right);
-        
-        FreestoreBlock* rightBlock = &freestore[subIndex];
-        rightBlock->address = rightAddress; //Assign the Right address into the freestore.
-        rightBlock->nextBlock = 0x0;
-        
-        //Add the right address to the freestore at the given index.
-        currentLeftAddress = leftAddress;
+        slowBlock = addressForOffset(slowBlock->nextBlock);
+        fastBlock = addressForOffset(((FreestoreBlock*)addressForOffset(fastBlock->nextBlock))->nextBlock);
     }
-
-    //Now the freestore should be initialized fully.
-    //We have only addressed half of our memory at this point, so we need to address the rest.
-    if(maxIndexSize < _length)
+    
+    FreestoreBlock* rightChain = addressForOffset(slowBlock->nextBlock);
+    slowBlock->nextBlock = EMPTY_OFFSET;
+    
+    FreestoreBlock* leftBlock = sortFreestoreChain(chain);
+    FreestoreBlock* rightBlock = sortFreestoreChain(rightChain);
+    
+    //Merge the halves back together. Links are offsets into the memory, so the merged chain can't start from a block on the stack.
+    FreestoreBlock* sortedHead = EMPTY_ADDRESS;
+    FreestoreBlock* sortedTail = EMPTY_ADDRESS;
+    
+    while(leftBlock != 0x0 && rightBlock != 0x0)
     {
-        unsigned int totalLeftoverSpace = _length - maxIndexSize;
-        unsigned int currentLeftoverSpace = totalLeftoverSpace;
-        unsigned int minimumIndexSize = _minFreestoreIndexMemorySize;
-        Addr freestoreAddress = freestore;
-        Addr currentLeftoverAddress = (freestoreAddress + _maxFreestoreIndexMemorySize);
+        FreestoreBlock* lowerBlock;
         
-        while(currentLeftoverSpace > minimumIndexSize)
+        if(leftBlock->address < rightBlock->address)
         {
-            unsigned int currentLeftoverIndex = getAdjustedFreestoreIndexForSize(currentLeftoverSpace);
-            unsigned int sizeForLeftoverIndex = getSizeForAdjustedFreestoreIndex(currentLeftoverIndex);
-            unsigned int storageIndex = (sizeForLeftoverIndex > currentLeftoverSpace) ? (currentLeftoverIndex - 1) : currentLeftoverIndex;
-            unsigned int sizeForStorageIndex = getSizeForAdjustedFreestoreIndex(storageIndex);
-            
-            addAddressToFreestoreForAdjustedIndex(storageIndex, currentLeftoverAddress);
-            
-            currentLeftoverAddress = currentLeftoverAddress + sizeForStorageIndex;
-            currentLeftoverSpace = currentLeftoverSpace - sizeForStorageIndex;
+            lowerBlock = leftBlock;
+            leftBlock = addressForOffset(leftBlock->nextBlock);
+        } else {
+            lowerBlock = rightBlock;
+            rightBlock = addressForOffset(rightBlock->nextBlock);
         }
         
-        
-        if(currentLeftoverSpace > 0)
+        if(sortedTail != EMPTY_ADDRESS)
         {
-            printf("WARNING: A small amount of memory of size '%d' was unable to fit into the freestore. \n\n", currentLeftoverSpace);
+            sortedTail->nextBlock = offsetForAddress(lowerBlock);
+        } else {
+            sortedHead = lowerBlock;
         }
+        
+        sortedTail = lowerBlock;
     }
-
-    return true;
+    
+    sortedTail->nextBlock = offsetForAddress((leftBlock != 0x0) ? leftBlock : rightBlock);
+    
+    return sortedHead;
 }
 
 /*
- Build the freestore header that keeps track of free blocks.
+    Merges every pair of free buddies at the index, chaining the merged blocks into the index above.
  
- The freestore header is built at the front of the allocated space.
+    Returns the number of merged blocks.
  */
-Addr initFreestoreHeader(Addr startAddress, unsigned int minFreestoreIndex, unsigned int maxFreestoreIndex)
+unsigned int coalesceFreestoreAtAdjustedIndex(unsigned int adjustedIndex)
 {
-    //The pointer to pointers of the freestore block now start at the startAddress.
-    unsigned int freestoreRange = maxFreestoreIndex - minFreestoreIndex;
+    unsigned int merged = 0;
     
-    if(freestoreRange == 0){
-        return 0;   //If there is no freestore range, then function fails.
+    if(adjustedIndex >= _arena->freestoreRange)
+    {
+        return merged;
     }
     
-    Freestore freestore = startAddress;
-    
-    resetFreestore(freestore, freestoreRange);
-    
-    _freestoreRange = freestoreRange;
-    _maxFreestoreIndexMemorySize = getSizeForAdjustedFreestoreIndex(freestoreRange);
-    
-    protectFreestoreHeader(freestore, minFreestoreIndex, maxFreestoreIndex);
+    FreestoreBlock* block = sortFreestoreChain(detachFreestoreChainAtAdjustedIndex(adjustedIndex));
     
+    while(block != 0x0)
+    {
+        FreestoreBlock* nextBlock = addressForOffset(block->nextBlock);
+        Addr address = addressForOffset(block->address);
+        
+        //Sorted, so a block is only ever followed by its buddy when it is the lower half.
+        if(nextBlock != 0x0 && addressForOffset(nextBlock->address) == getBuddyAddressForAdjustedIndex(adjustedIndex, address) && address < addressForOffset(nextBlock->address))
+        {
+            FreestoreBlock* continueBlock = addressForOffset(nextBlock->nextBlock);
+            
+            addAddressToFreestoreForAdjustedIndex(adjustedIndex + 1, address);
+            merged += 1;
+            
+            block = continueBlock;
+        } else {
+            addAddressToFreestoreForAdjustedIndex(adjustedIndex, address);
+            block = nextBlock;
+        }
+    }
     
+    _arena->mergeCount += merged;
+    _arena->lazyCount[adjustedIndex] = 0;
+    _arena->lazyCount[adjustedIndex + 1] += merged;
     
-    return startAddress;
+    return merged;
 }
 
-unsigned int minFreestoreIndexForSize(unsigned int basic_block_size, unsigned int headerSize)
+/*
+    Coalesces every index, from the bottom up, so merged blocks are merged again on the way.
+ */
+void coalesceFreestore(void)
 {
-    unsigned int minIndex = 0;
-    
-    if(headerSize > basic_block_size)
+    for(unsigned int i = 0; i < _arena->freestoreRange; i++)
     {
-        double reducedSize = (headerSize / (_basic_block_size * 1.0));
-        double logSize = log2(reducedSize);
-        unsigned int fitIndex = ceil(logSize);
-        
-        minIndex = fitIndex;
-    }
-    
-    //Make sure that we can fit more than the header in fitIndexSize.
-    unsigned int fitIndexSize = getSizeForFreestoreIndex(minIndex);
-    if(fitIndexSize <= headerSize)
-    {
-        minIndex += 1;
+        coalesceFreestoreAtAdjustedIndex(i);
     }
     
-    return minIndex;
+    _arena->lazyCount[_arena->freestoreRange] = 0;
 }
 
-unsigned int maxFreestoreIndexForSize(unsigned int basic_block_size, unsigned int length, unsigned int headerSize)
+/*
+    Chains the block in at its index without merging, coalescing the indexes that go over the threshold.
+ */
+void parkFreestoreBlockAtAdjustedIndex(unsigned int adjustedIndex, Addr memoryAddress)
 {
-    unsigned int maxIndex = 0;
+    addAddressToFreestoreForAdjustedIndex(adjustedIndex, memoryAddress);
+    _arena->lazyCount[adjustedIndex] += 1;
     
-    double reducedSize = ((length - headerSize) / (_basic_block_size * 1.0));
-    double logSize = log2(reducedSize);
-    maxIndex = floor(logSize);             //We want the lowest index to ensure it will fit.
+    unsigned int index = adjustedIndex;
     
-    return maxIndex;
+    while(index < _arena->freestoreRange && _arena->lazyCount[index] > _arena->lazyThreshold)
+    {
+        coalesceFreestoreAtAdjustedIndex(index);
+        index++;
+    }
 }
 
-/*--------------------------------------------------------------------------*/
-/* SUPPORT FUNCTIONS FOR MODULE MY_ALLOCATOR */
-/*--------------------------------------------------------------------------*/
-bool indexCanMeetMemoryRequest(unsigned int index)
+/*
+    Gives a block back to the freestore, parking it when merging is deferred and merging it right away otherwise.
+ */
+void returnFreestoreBlockAtAdjustedIndex(unsigned int adjustedIndex, Addr memoryAddress)
 {
-    return containsFreeSpaceAtAdjustedIndex(index);
+    //The maintenance thread only walks the arenas, so sub-heaps merge as they would without it.
+    if(_maintenanceInterval > 0 && !isLifetimeHeap(_arena))
+    {
+        //Parked with no threshold at all, the maintenance thread merges it once the arena goes idle.
+        addAddressToFreestoreForAdjustedIndex(adjustedIndex, memoryAddress);
+        _arena->lazyCount[adjustedIndex] += 1;
+    } else if(_arena->lazyThreshold > 0)
+    {
+        parkFreestoreBlockAtAdjustedIndex(adjustedIndex, memoryAddress);
+    } else {
+        releaseFreestoreBlockAtAdjustedIndex(adjustedIndex, memoryAddress);
+    }
 }
 
-bool canMeetMemoryRequest(unsigned int size)
+/*--------------------------------------------------------------------------*/
+// MAINTENANCE
+/*--------------------------------------------------------------------------*/
+
+/*
+    With maintenance on, a background thread does the splitting and merging that would otherwise make
+    the odd my_malloc or my_free take much longer than the rest.
+ 
+    On every pass it looks at how many blocks each index was asked for since the last one, and splits
+    larger blocks ahead of time until each index holds about that many, so the next requests find a block
+    of their size ready. Frees are parked without merging, and once a pass finds an arena with no mallocs
+    or frees since the one before, it coalesces what was parked. Lifetime sub-heaps aren't among the arenas
+    it walks, so frees in them keep merging right away.
+ 
+    Arenas take their lock while maintenance runs. The thread only ever holds it for one index at a time.
+ */
+
+/*
+    Returns the free blocks at the index, counting no further than the limit.
+ */
+unsigned int countFreestoreBlocksAtAdjustedIndex(unsigned int adjustedIndex, unsigned int limit)
 {
-    bool canMeet = false;
+    unsigned int count = 0;
+    FreestoreBlock* block = getFirstFreestoreBlockAtAdjustedIndex(adjustedIndex);
     
-    //First check the index, then recursively go up
-    unsigned int minIndex = getAdjustedFreestoreIndexForSize(size);
-    unsigned int currentIndex = minIndex;
-    unsigned int maxAdjustedIndex = _freestoreRange;
-    while(canMeet == false && currentIndex <= maxAdjustedIndex)
+    if(block->address == EMPTY_OFFSET)
     {
-        canMeet = containsFreeSpaceAtAdjustedIndex(currentIndex);
-        currentIndex++;
+        return count;
     }
     
-    return canMeet;
+    while(block != 0x0 && count < limit)
+    {
+        count++;
+        block = addressForOffset(block->nextBlock);
+    }
+    
+    return count;
 }
 
-MemoryHeader* allocateHeaderForSize(unsigned int size)
+/*
+    Splits a block of the index above, or one split down from further up, into two free blocks at the index.
+ 
+    Returns false if there is no larger free block. Never coalesces to find one, that would merge the reserves back.
+ */
+bool splitFreestoreBlockIntoAdjustedIndex(unsigned int adjustedIndex)
 {
-    MemoryHeader* header = 0x0;
-    
-    unsigned int combinedSize = size + _headerSize;
-    
-    if(canMeetMemoryRequest(combinedSize) == false){
-        return EMPTY_ADDRESS;   //Can't allocate more than is available.
+    if(adjustedIndex >= _arena->freestoreRange || getFirstFreeAdjustedIndexFromAdjustedIndex(adjustedIndex + 1) > _arena->freestoreRange)
+    {
+        return false;
     }
-
-    unsigned int targetIndex = getAdjustedFreestoreIndexForSize(combinedSize);
-    bool freeAvailable = containsFreeSpaceAtAdjustedIndex(targetIndex);
-    bool created = freeAvailable;
     
-    if(freeAvailable == false)
+    Addr address = takeFreestoreBlockAtAdjustedIndex(adjustedIndex + 1);
+    
+    if(address == EMPTY_ADDRESS)
     {
-        //Create a new block.
-        created = createFreestoreBlockAtAdjustedIndex(targetIndex);
+        return false;
     }
     
-    //Retrieve our new block if created. If created is false, we've run out of memory.
-    if(created == true)
+    addAddressToFreestoreForAdjustedIndex(adjustedIndex, address + getSizeForAdjustedFreestoreIndex(adjustedIndex));
+    addAddressToFreestoreForAdjustedIndex(adjustedIndex, address);
+    _arena->splitCount += 1;
+    
+    return true;
+}
+
+/*
+    Moves each index's reserve toward the blocks it was asked for since the last pass, enough to last until the next one.
+ 
+    Averaged over a few passes, so a single burst doesn't pin a large reserve. The caller holds the lock.
+ */
+void updateReserveTargets(unsigned int arenaIndex)
+{
+    for(unsigned int i = 0; i < _arena->freestoreRange; i++)
     {
-        FreestoreBlock* freeblock = getLastFreestoreBlockAtAdjustedIndex(targetIndex);
-        Addr freeblockAddress = freeblock->address;
-        
-        //Delete our free block.
-        //Values for this block are reset in this function so it can be used as a header now.
-        removeLastFreestoreBlockAtAdjustedIndex(targetIndex);
-        
-        header = freeblockAddress;    //Treat the target address as a header now.
-        
-        MemoryHeader testBlock = *header;
-        testBlock.index = 0;
-        testBlock.memoryStart = 0;
+        unsigned long demand = _arena->demandCount[i];
+        unsigned long target = (3 * (unsigned long)_reserveTargets[arenaIndex][i]) + demand;
         
-        header->index = targetIndex;
-        void* memoryStartAddress = (freeblockAddress + _headerSize);
-        header->memoryStart = memoryStartAddress;
+        //Rounded up while there is demand, and down once it stops, so an unused reserve dies out.
+        target = (demand > 0) ? ((target + 3) / 4) : (target / 4);
+        _reserveTargets[arenaIndex][i] = minValue(target, MAINTENANCE_MAX_RESERVE);
     }
     
-    return header;
+    for(unsigned int i = 0; i <= _arena->freestoreRange; i++)
+    {
+        _arena->demandCount[i] = 0;
+    }
 }
 
-MemoryHeader* memoryHeaderForAddress(Addr memoryAddress)
+/*
+    Coalesces the parked blocks of the current arena, one index per hold of its lock.
+ 
+    Skipped if nothing was parked since it last ran, so the reserves aren't merged and split again on every idle pass.
+ */
+void coalesceParkedBlocks(void)
 {
-    unsigned int headerSize = _headerSize;
-    Addr address = (memoryAddress - headerSize);
+    unsigned long parkedBlocks = 0;
     
-    //Verify MemoryHeader integrity.
-    MemoryHeader* header = address;
+    lockArena();
     
-    if(header != 0x0)
+    for(unsigned int i = 0; i <= _arena->freestoreRange; i++)
     {
-        bool valid = (header->memoryStart == memoryAddress);
-        
-        if(!valid){
-            header = 0x0;
-        }
+        parkedBlocks += _arena->lazyCount[i];
     }
     
-    return header;
-}
-
-bool deallocateHeaderAtAddress(Addr memoryAddress)
-{
-    bool success = false;
-    MemoryHeader* header = memoryHeaderForAddress(memoryAddress);
+    unlockArena();
     
-    if(header != 0x0){
-        success = deallocateHeader(header);
+    if(parkedBlocks == 0)
+    {
+        return;
     }
     
-    return success;
+    for(unsigned int i = 0; i < _arena->freestoreRange; i++)
+    {
+        lockArena();
+        coalesceFreestoreAtAdjustedIndex(i);
+        unlockArena();
+    }
+    
+    lockArena();
+    _arena->lazyCount[_arena->freestoreRange] = 0;
+    unlockArena();
 }
 
-bool deallocateHeader(MemoryHeader* header)
+/*
+    Splits blocks until every index of the current arena holds its reserve, or there is nothing left to split.
+ 
+    Goes from the smallest index up, so the blocks taken from an index's reserve are made up for in the same pass.
+ */
+void refillReserves(unsigned int arenaIndex)
 {
-    bool success = false;
-    
-    if(header != 0x0){
-        unsigned int adjustedIndex = header->index;
-        Addr startAddress = header;
-        
-        //Clear the header.
-        header->memoryStart = EMPTY_ADDRESS;
-        header->index = EMPTY_VALUE;
-        
-        //Address is returned to the freestore. We still need to check for buddies though.
-        bool addSuccess = addAddressToFreestoreForAdjustedIndex(adjustedIndex, startAddress);
+    for(unsigned int i = 0; i < _arena->freestoreRange; i++)
+    {
+        bool refilling = true;
         
-        if(!addSuccess){
-            printf("ERROR> Reinsert Failure: Could not reinsert address(%p) into freestore. \n",startAddress);
+        while(refilling)
+        {
+            lockArena();
+            
+            unsigned int target = _reserveTargets[arenaIndex][i];
+            unsigned int count = countFreestoreBlocksAtAdjustedIndex(i, target);
+            unsigned int splits = 0;
+            
+            while(count < target && splits < MAINTENANCE_SPLIT_BATCH && splitFreestoreBlockIntoAdjustedIndex(i))
+            {
+                count += 2;
+                splits++;
+            }
+            
+            //Only a full batch may have left the reserve short with blocks still to split.
+            refilling = (count < target && splits == MAINTENANCE_SPLIT_BATCH) ? true : false;
+            
+            unlockArena();
         }
-        
-        //Attempt to merge buddies, if it's buddy is free.
-        attemptBuddyMergeAtAdjustedIndexWithAddress(adjustedIndex, startAddress);
     }
-
-    return success;
 }
 
-/*--------------------------------------------------------------------------*/
-/* MAIN FUNCTIONS FOR MODULE MY_ALLOCATOR */
-/*--------------------------------------------------------------------------*/
-
-unsigned int init_allocator(unsigned int basic_block_size, unsigned int length){
-    
-    int allocatedSize = 0;
+void* maintenanceMain(void* argument)
+{
+    pthread_mutex_lock(&_maintenanceLock);
     
-    if(basic_block_size < length){
+    while(_maintenanceStopping == false)
+    {
+        struct timespec wakeup;
+        clock_gettime(CLOCK_REALTIME, &wakeup);
         
-        size_t size = (size_t)length;
-        Addr startAddress = malloc(size);
+        unsigned long nanoseconds = (unsigned long)wakeup.tv_nsec + ((unsigned long)_maintenanceInterval * 1000);
+        wakeup.tv_sec += (nanoseconds / 1000000000);
+        wakeup.tv_nsec = (nanoseconds % 1000000000);
         
-        _basic_block_size = basic_block_size;
-        _length = length;
-        _headerSize = sizeof(FreestoreBlock);
+        pthread_cond_timedwait(&_maintenanceWakeup, &_maintenanceLock, &wakeup);
         
-        _minFreestoreIndex = minFreestoreIndexForSize(basic_block_size, _headerSize);
-        _minFreestoreIndexMemorySize = getSizeForFreestoreIndex(_minFreestoreIndex);
-        _maxFreestoreIndex = maxFreestoreIndexForSize(basic_block_size, length, _headerSize);
-        _maxFreestoreIndexMemorySize = getSizeForFreestoreIndex(_minFreestoreIndex);
-        _freestoreAddress = startAddress;
+        if(_maintenanceStopping)
+        {
+            break;
+        }
         
-        Addr freestoreAddress = initFreestoreHeader(startAddress, _minFreestoreIndex, _maxFreestoreIndex);
-        _freestoreAddress = freestoreAddress;
+        pthread_mutex_unlock(&_maintenanceLock);
         
-        if(_freestoreAddress == EMPTY_ADDRESS)
+        for(unsigned int i = 0; i < _arenaCount; i++)
         {
-            free(startAddress);
+            _arena = _arenas[i];
+            
+            lockArena();
+            
+            unsigned long activity = _arena->mallocCount + _arena->freeCount;
+            bool idle = (activity == _maintenanceActivity[i]) ? true : false;
+            _maintenanceActivity[i] = activity;
+            
+            //An idle pass keeps the reserves as they were, for whenever the arena gets busy again.
+            if(idle == false)
+            {
+                updateReserveTargets(i);
+                _compactionPending = (i == 0) ? true : _compactionPending;
+            }
+            
+            unlockArena();
+            
+            if(idle)
+            {
+                coalesceParkedBlocks();
+            }
+            
+            //Handle memory is only ever in the main arena.
+            if(idle && i == 0 && _compactionPending && _handleCount > 0)
+            {
+                lockArena();
+                _compactionPending = compactHandles(COMPACTION_SLICE);
+                unlockArena();
+            }
+            
+            refillReserves(i);
         }
         
-        allocatedSize = _length;
+        pthread_mutex_lock(&_maintenanceLock);
     }
     
-    return allocatedSize;
-}
-
-int release_allocator(){
-    free(_freestoreAddress);
-    return 0;
+    pthread_mutex_unlock(&_maintenanceLock);
+    
+    return EMPTY_ADDRESS;
 }
 
-extern Addr my_malloc(unsigned int length) {
-    MemoryHeader* header = allocateHeaderForSize(length);
-    Addr address = 0x0;
-    
+/*
+    Stops the maintenance thread, if one runs, and merges everything it left parked.
+ */
+void stopMaintenance(void)
+{
+    if(_maintenanceInterval == 0)
+    {
+        return;
+    }
+    
+    pthread_mutex_lock(&_maintenanceLock);
+    _maintenanceStopping = true;
+    pthread_cond_signal(&_maintenanceWakeup);
+    pthread_mutex_unlock(&_maintenanceLock);
+    
+    pthread_join(_maintenanceThread, EMPTY_ADDRESS);
+    
+    _maintenanceStopping = false;
+    _maintenanceInterval = 0;
+    
+    for(unsigned int i = 0; i < _arenaCount; i++)
+    {
+        _arena = _arenas[i];
+        
+        lockArena();
+        
+        //Lazy coalescing, if it is on, takes over the parked blocks.
+        if(_arena->lazyThreshold == 0)
+        {
+            coalesceFreestore();
+        }
+        
+        unlockArena();
+        
+        if(_maintenanceLockedArenas == false)
+        {
+            pthread_mutex_destroy(&_arena->lock);
+        }
+    }
+    
+    _lockedArenas = _maintenanceLockedArenas;
+}
+
+/*--------------------------------------------------------------------------*/
+// SIZE CLASSES
+/*--------------------------------------------------------------------------*/
+
+/*
+    With size classes on, small requests are not rounded up to the next power of two.
+ 
+    Sizes up to SIZE_CLASS_FINE_LIMIT step by SIZE_CLASS_GRANULE, and above that every power of two is split
+    into four classes (160, 192, 224, 256, 320, ...), so at most a quarter of a slot is ever wasted.
+ 
+    Each class is served from slabs: a buddy block whose header is followed by equal slots of the class size.
+    Slots carry no MemoryHeader. The slab map has an entry for every slab-granule sized piece of the memory,
+    pointing at the slab that covers it, so my_free finds the slab of a slot in constant time.
+ 
+    {[SlabHeader][slot][slot][slot]...}
+ */
+
+/*
+    Returns the size class a length falls into. The length must not be 0.
+ */
+unsigned int getSizeClassForLength(unsigned int length)
+{
+    if(length <= SIZE_CLASS_FINE_LIMIT)
+    {
+        return ((length + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE) - 1;
+    }
+    
+    unsigned int power = 31 - __builtin_clz(length - 1);        //2^power < length <= 2^(power + 1)
+    unsigned int step = (1 << (power - SIZE_CLASS_STEP_SHIFT));
+    unsigned int offset = ((length - 1 - (1 << power)) / step);
+    
+    return SIZE_CLASS_FINE_COUNT + ((power - SIZE_CLASS_FINE_SHIFT) * SIZE_CLASSES_PER_POWER) + offset;
+}
+
+unsigned int getSizeForSizeClass(unsigned int sizeClass)
+{
+    if(sizeClass < SIZE_CLASS_FINE_COUNT)
+    {
+        return ((sizeClass + 1) * SIZE_CLASS_GRANULE);
+    }
+    
+    unsigned int coarseClass = (sizeClass - SIZE_CLASS_FINE_COUNT);
+    unsigned int power = SIZE_CLASS_FINE_SHIFT + (coarseClass / SIZE_CLASSES_PER_POWER);
+    unsigned int step = (1 << (power - SIZE_CLASS_STEP_SHIFT));
+    
+    return (1 << power) + (((coarseClass % SIZE_CLASSES_PER_POWER) + 1) * step);
+}
+
+unsigned int getSlabHeaderSize(void)
+{
+    return ((sizeof(SlabHeader) + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE) * SIZE_CLASS_GRANULE;
+}
+
+/*
+    Works out the slab index of every class, and how many classes are served at all.
+ 
+    A slab holds at least SLAB_MIN_SLOTS slots, and is never larger than a sixteenth of the largest index,
+    so the slabs of the larger classes can't take over a small memory.
+ */
+void initSizeClasses(void)
+{
+    unsigned int slabHeaderSize = getSlabHeaderSize();
+    unsigned int maxSlabSize = (getSizeForAdjustedFreestoreIndex(_arena->freestoreRange) / 16);
+    
+    _arena->slabGranuleIndex = getAdjustedFreestoreIndexForSize(SLAB_MIN_SIZE);
+    _arena->sizeClassCount = 0;
+    
+    for(unsigned int i = 0; i < MAX_SIZE_CLASSES; i++)
+    {
+        unsigned int slotSize = getSizeForSizeClass(i);
+        unsigned int slabSize = slabHeaderSize + (slotSize * SLAB_MIN_SLOTS);
+        unsigned int slabIndex = getAdjustedFreestoreIndexForSize((slabSize > SLAB_MIN_SIZE) ? slabSize : SLAB_MIN_SIZE);
+        
+        if(slotSize > SIZE_CLASS_LIMIT || getSizeForAdjustedFreestoreIndex(slabIndex) > maxSlabSize)
+        {
+            break;
+        }
+        
+        _arena->sizeClassSlabIndex[i] = slabIndex;
+        _arena->partialSlabs[i] = EMPTY_OFFSET;
+        _arena->sizeClassCount = i + 1;
+    }
+    
+    _arena->slabMap = EMPTY_OFFSET;
+    _arena->slabBytes = 0;
+    _arena->slotBytes = 0;
+}
+
+/*
+    The slab map is carved out of the memory itself the first time a slab is made, and kept until release.
+ */
+bool ensureSlabMap(void)
+{
+    if(_arena->slabMap != EMPTY_OFFSET)
+    {
+        return true;
+    }
+    
+    unsigned int granuleSize = getSizeForAdjustedFreestoreIndex(_arena->slabGranuleIndex);
+    _arena->slabMapCount = (_arena->length / granuleSize) + 1;
+    
+    unsigned int mapSize = (_arena->slabMapCount * sizeof(Offset));
+    unsigned int mapIndex = getAdjustedFreestoreIndexForSize(mapSize);
+    Addr mapAddress = (mapIndex <= _arena->freestoreRange) ? takeFreestoreBlockAtAdjustedIndex(mapIndex) : EMPTY_ADDRESS;
+    
+    if(mapAddress == EMPTY_ADDRESS)
+    {
+        return false;
+    }
+    
+    _arena->slabMap = offsetForAddress(mapAddress);
+    
+    Offset* slabMap = mapAddress;
+    
+    for(unsigned int i = 0; i < _arena->slabMapCount; i++)
+    {
+        slabMap[i] = EMPTY_OFFSET;
+    }
+    
+    return true;
+}
+
+unsigned int getSlabMapIndexForAddress(Addr memoryAddress)
+{
+    Addr startAddress = getArenaFreestore(_arena);
+    unsigned int granuleSize = getSizeForAdjustedFreestoreIndex(_arena->slabGranuleIndex);
+    return (unsigned int)((memoryAddress - startAddress) / granuleSize);
+}
+
+/*
+    Returns the slab a slot belongs to, or EMPTY_ADDRESS if the address isn't in a slab.
+ */
+SlabHeader* slabForAddress(Addr memoryAddress)
+{
+    Addr startAddress = getArenaFreestore(_arena);
+    
+    if(_arena->slabMap == EMPTY_OFFSET || memoryAddress < startAddress || memoryAddress >= (startAddress + _arena->length))
+    {
+        return EMPTY_ADDRESS;
+    }
+    
+    return addressForOffset(getSlabMap()[getSlabMapIndexForAddress(memoryAddress)]);
+}
+
+void setSlabMapEntriesForSlab(SlabHeader* slab, SlabHeader* value)
+{
+    unsigned int granuleSize = getSizeForAdjustedFreestoreIndex(_arena->slabGranuleIndex);
+    unsigned int granules = (getSizeForAdjustedFreestoreIndex(slab->index) / granuleSize);
+    unsigned int firstEntry = getSlabMapIndexForAddress(slab);
+    Offset* slabMap = getSlabMap();
+    Offset valueOffset = offsetForAddress(value);
+    
+    for(unsigned int i = 0; i < granules; i++)
+    {
+        slabMap[firstEntry + i] = valueOffset;
+    }
+}
+
+void linkPartialSlab(SlabHeader* slab)
+{
+    SlabHeader* firstSlab = addressForOffset(_arena->partialSlabs[slab->sizeClass]);
+    Offset slabOffset = offsetForAddress(slab);
+    
+    slab->previousSlab = EMPTY_OFFSET;
+    slab->nextSlab = offsetForAddress(firstSlab);
+    
+    if(firstSlab != EMPTY_ADDRESS)
+    {
+        firstSlab->previousSlab = slabOffset;
+    }
+    
+    _arena->partialSlabs[slab->sizeClass] = slabOffset;
+}
+
+void unlinkPartialSlab(SlabHeader* slab)
+{
+    SlabHeader* previousSlab = addressForOffset(slab->previousSlab);
+    SlabHeader* nextSlab = addressForOffset(slab->nextSlab);
+    
+    if(previousSlab != EMPTY_ADDRESS)
+    {
+        previousSlab->nextSlab = slab->nextSlab;
+    } else {
+        _arena->partialSlabs[slab->sizeClass] = slab->nextSlab;
+    }
+    
+    if(nextSlab != EMPTY_ADDRESS)
+    {
+        nextSlab->previousSlab = slab->previousSlab;
+    }
+    
+    slab->nextSlab = EMPTY_OFFSET;
+    slab->previousSlab = EMPTY_OFFSET;
+}
+
+SlabHeader* createSlabForSizeClass(unsigned int sizeClass)
+{
+    if(ensureSlabMap() == false)
+    {
+        return EMPTY_ADDRESS;
+    }
+    
+    unsigned int slabIndex = _arena->sizeClassSlabIndex[sizeClass];
+    SlabHeader* slab = takeFreestoreBlockAtAdjustedIndex(slabIndex);
+    
+    if(slab == EMPTY_ADDRESS)
+    {
+        return EMPTY_ADDRESS;
+    }
+    
+    unsigned int slabSize = getSizeForAdjustedFreestoreIndex(slabIndex);
+    unsigned int slabHeaderSize = getSlabHeaderSize();
+    
+    slab->sizeClass = sizeClass;
+    slab->index = slabIndex;
+    slab->slotSize = getSizeForSizeClass(sizeClass);
+    slab->slotCount = ((slabSize - slabHeaderSize) / slab->slotSize);
+    slab->freeSlots = slab->slotCount;
+    slab->freeSlot = EMPTY_OFFSET;
+    slab->unusedSlot = offsetForAddress((Addr)slab + slabHeaderSize);  //Slots past this one have never been handed out.
+    
+    setSlabMapEntriesForSlab(slab, slab);
+    linkPartialSlab(slab);
+    
+    _arena->slabBytes += slabSize;
+    
+    return slab;
+}
+
+void releaseSlab(SlabHeader* slab)
+{
+    unlinkPartialSlab(slab);
+    setSlabMapEntriesForSlab(slab, EMPTY_ADDRESS);
+    
+    _arena->slabBytes -= getSizeForAdjustedFreestoreIndex(slab->index);
+    
+    returnFreestoreBlockAtAdjustedIndex(slab->index, slab);
+}
+
+/*
+    Gives the empty slabs every class kept around back to the buddy system. Returns whether there were any.
+ */
+bool releaseEmptySlabs(void)
+{
+    bool released = false;
+    
+    for(unsigned int sizeClass = 0; sizeClass < _arena->sizeClassCount; sizeClass++)
+    {
+        SlabHeader* slab = addressForOffset(_arena->partialSlabs[sizeClass]);
+        
+        while(slab != EMPTY_ADDRESS)
+        {
+            SlabHeader* nextSlab = addressForOffset(slab->nextSlab);
+            
+            if(slab->freeSlots == slab->slotCount)
+            {
+                releaseSlab(slab);
+                released = true;
+            }
+            
+            slab = nextSlab;
+        }
+    }
+    
+    return released;
+}
+
+Addr allocateSlotForSize(unsigned int size)
+{
+    unsigned int sizeClass = getSizeClassForLength((size > 0) ? size : 1);
+    SlabHeader* slab = addressForOffset(_arena->partialSlabs[sizeClass]);
+    
+    if(slab == EMPTY_ADDRESS)
+    {
+        slab = createSlabForSizeClass(sizeClass);
+        
+        if(slab == EMPTY_ADDRESS){
+            return EMPTY_ADDRESS;
+        }
+    }
+    
+    Addr slot = addressForOffset(slab->freeSlot);
+    
+    if(slot != EMPTY_ADDRESS)
+    {
+        slab->freeSlot = *((Offset*)slot);
+    } else {
+        slot = addressForOffset(slab->unusedSlot);
+        slab->unusedSlot += slab->slotSize;
+    }
+    
+    slab->freeSlots -= 1;
+    
+    //A full slab leaves the partial list until one of its slots is freed.
+    if(slab->freeSlots == 0)
+    {
+        unlinkPartialSlab(slab);
+    }
+    
+    _arena->slotBytes += slab->slotSize;
+    
+    return slot;
+}
+
+bool deallocateSlotAtAddress(SlabHeader* slab, Addr memoryAddress)
+{
+    Addr firstSlot = ((Addr)slab + getSlabHeaderSize());
+    
+    //Anything not at the start of a handed out slot can't have come from my_malloc.
+    if(memoryAddress < firstSlot || memoryAddress >= addressForOffset(slab->unusedSlot) || ((memoryAddress - firstSlot) % slab->slotSize) != 0)
+    {
+        return false;
+    }
+    
+    if(slab->freeSlots == 0)
+    {
+        linkPartialSlab(slab);
+    }
+    
+    *((Offset*)memoryAddress) = slab->freeSlot;
+    slab->freeSlot = offsetForAddress(memoryAddress);
+    slab->freeSlots += 1;
+    
+    _arena->slotBytes -= slab->slotSize;
+    
+    //Give empty slabs back to the buddy system, but keep the last one of the class around until the arena runs out.
+    if(slab->freeSlots == slab->slotCount && (slab->previousSlab != EMPTY_OFFSET || slab->nextSlab != EMPTY_OFFSET))
+    {
+        releaseSlab(slab);
+    }
+    
+    return true;
+}
+
+/*--------------------------------------------------------------------------*/
+// RESERVED MEMORY
+/*--------------------------------------------------------------------------*/
+
+/*
+    Makes the reserved memory under the range usable, a chunk at a time. Chunks stay committed until release.
+ 
+    Memory that wasn't reserved is always usable, so this only costs a check outside init_allocator_reserved.
+ */
+bool commitArenaRange(Addr memoryAddress, unsigned long length)
+{
+    if(_arena->reservedLength == 0 || length == 0)
+    {
+        return true;
+    }
+    
+    Addr startAddress = getArenaFreestore(_arena);
+    unsigned long firstChunk = (unsigned long)(memoryAddress - startAddress) / COMMIT_CHUNK_SIZE;
+    unsigned long lastChunk = ((unsigned long)(memoryAddress - startAddress) + length - 1) / COMMIT_CHUNK_SIZE;
+    
+    for(unsigned long chunk = firstChunk; chunk <= lastChunk; chunk++)
+    {
+        unsigned long word = chunk / BITMAP_WORD_BITS;
+        unsigned long bit = (1UL << (chunk % BITMAP_WORD_BITS));
+        
+        if((_arena->committedChunks[word] & bit) != 0)
+        {
+            continue;
+        }
+        
+        //The last chunk may run past the end of the reservation.
+        unsigned long chunkOffset = chunk * COMMIT_CHUNK_SIZE;
+        unsigned long chunkLength = minValue(COMMIT_CHUNK_SIZE, _arena->reservedLength - chunkOffset);
+        
+        if(mprotect(startAddress + chunkOffset, chunkLength, PROT_READ | PROT_WRITE) != 0)
+        {
+            return false;
+        }
+        
+        _arena->committedChunks[word] |= bit;
+        _arena->committedBytes += chunkLength;
+    }
+    
+    return true;
+}
+
+/*--------------------------------------------------------------------------*/
+// ALLOCATION BITMAP
+/*--------------------------------------------------------------------------*/
+
+/*
+    Carves the allocation bitmap out of the memory, right after the freestore is built.
+ 
+    It's what lets my_free turn away foreign pointers, interior pointers and double frees with one bit test,
+    before anything in the freestore or a slab is touched.
+ */
+bool initAllocationBitmap(void)
+{
+    unsigned long granules = (_arena->length >> ALLOCATION_GRANULE_SHIFT) + 1;
+    unsigned long words = (granules + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+    unsigned int bitmapIndex = getAdjustedFreestoreIndexForSize(words * sizeof(unsigned long));
+    unsigned long* bitmap = (bitmapIndex <= _arena->freestoreRange) ? takeFreestoreBlockAtAdjustedIndex(bitmapIndex) : EMPTY_ADDRESS;
+    
+    if(bitmap == EMPTY_ADDRESS)
+    {
+        return false;
+    }
+    
+    //Freshly committed memory is already zero, and writing it would make the whole bitmap resident.
+    for(unsigned long i = 0; _arena->reservedLength == 0 && i < words; i++)
+    {
+        bitmap[i] = 0;
+    }
+    
+    _arena->allocationBitmap = offsetForAddress(bitmap);
+    _arena->allocationBitmapIndex = bitmapIndex;
+    
+    return true;
+}
+
+bool isAllocationAtAddress(Addr memoryAddress)
+{
+    Addr startAddress = getArenaFreestore(_arena);
+    
+    if(memoryAddress < startAddress || memoryAddress >= (startAddress + _arena->length))
+    {
+        return false;
+    }
+    
+    unsigned long granule = ((memoryAddress - startAddress) >> ALLOCATION_GRANULE_SHIFT);
+    return (getAllocationBitmap()[granule / BITMAP_WORD_BITS] >> (granule % BITMAP_WORD_BITS)) & 1;
+}
+
+void markAllocationAtAddress(Addr memoryAddress)
+{
+    unsigned long granule = ((memoryAddress - (Addr)getArenaFreestore(_arena)) >> ALLOCATION_GRANULE_SHIFT);
+    getAllocationBitmap()[granule / BITMAP_WORD_BITS] |= (1UL << (granule % BITMAP_WORD_BITS));
+}
+
+void clearAllocationAtAddress(Addr memoryAddress)
+{
+    unsigned long granule = ((memoryAddress - (Addr)getArenaFreestore(_arena)) >> ALLOCATION_GRANULE_SHIFT);
+    getAllocationBitmap()[granule / BITMAP_WORD_BITS] &= ~(1UL << (granule % BITMAP_WORD_BITS));
+}
+
+/*--------------------------------------------------------------------------*/
+// INITIALIZATION FUNCTIONS FOR FREESTORE
+/*--------------------------------------------------------------------------*/
+
+Addr subAddressForAdjustedIndex(Addr address, unsigned int index, side splitSide)
+{
+    Addr returnAddress = address;
+    
+    if(splitSide == right)
+    {
+        unsigned int size = getSizeForAdjustedFreestoreIndex(index);
+        unsigned int splitSize = size/2;
+        returnAddress = (address + splitSize);
+    }
+    
+    return returnAddress;
+}
+
+/*
+    We'll protect the header by permanently allocating a chunk of the memory to the freestore header.
+ 
+    We'll attempt to minimize the memory usage by storing it in the smallest index possible.
+ 
+    The header is incomplete here, since no headers have been written yet.
+ */
+bool protectFreestoreHeader(Freestore freestore, unsigned int minFreestoreIndex, unsigned int maxFreestoreIndex)
+{
+    unsigned int freestoreRange = adjustedIndex(maxFreestoreIndex, minFreestoreIndex);
+    unsigned int adjustedMaxFreestoreIndex = freestoreRange;
+    
+    //Calculate size of the array
+    unsigned int blockSize = sizeof(FreestoreBlock);
+    unsigned int arraySize = blockSize * freestoreRange;
+    
+    //Retrieve the minimum Memory Block Index we can fit this freestore block into.
+    unsigned int storeIndex = getAdjustedMinFreestoreIndexForRequestedSize(arraySize);
+    _arena->freestoreIndex = storeIndex;
+    
+    unsigned int maxIndexSize = getSizeForFreestoreIndex(maxFreestoreIndex);
+    
+    //Start building the free memory blocks space and the freestore by recursively splitting the open space.
+    //We treat this area as the size of the maximum index.
+    
+    //Freestore marks the start of the allocated memory.
+    Addr currentLeftAddress = freestore;
+    
+    //Break up the blocks to fit into this, and give those blocks headers and put them into the freestore.
+    for(unsigned int i = adjustedMaxFreestoreIndex; i > storeIndex; i -= 1)
+    {
+        unsigned int subIndex = i - 1;
+        
+        //Split up the greatest index first into the left and right.
+        Addr leftAddress = subAddressForAdjustedIndex(currentLeftAddress, i, left);
+        Addr rightAddress = subAddressForAdjustedIndex(currentLeftAddress, i, right);
+        
+        FreestoreBlock* rightBlock = &freestore[subIndex];
+        commitArenaRange(rightAddress, sizeof(FreestoreBlock));
+        rightBlock->address = offsetForAddress(rightAddress); //Assign the Right address into the freestore.
+        rightBlock->nextBlock = EMPTY_OFFSET;
+        
+        //Add the right address to the freestore at the given index.
+        currentLeftAddress = leftAddress;
+    }
+
+    //Now the freestore should be initialized fully.
+    //We have only addressed half of our memory at this point, so we need to address the rest.
+    if(maxIndexSize < _arena->length)
+    {
+        unsigned int totalLeftoverSpace = _arena->length - maxIndexSize;
+        unsigned int currentLeftoverSpace = totalLeftoverSpace;
+        unsigned int minimumIndexSize = _arena->minFreestoreIndexMemorySize;
+        Addr freestoreAddress = freestore;
+        Addr currentLeftoverAddress = (freestoreAddress + _arena->maxFreestoreIndexMemorySize);
+        
+        while(currentLeftoverSpace > minimumIndexSize)
+        {
+            unsigned int currentLeftoverIndex = getAdjustedFreestoreIndexForSize(currentLeftoverSpace);
+            unsigned int sizeForLeftoverIndex = getSizeForAdjustedFreestoreIndex(currentLeftoverIndex);
+            unsigned int storageIndex = (sizeForLeftoverIndex > currentLeftoverSpace) ? (currentLeftoverIndex - 1) : currentLeftoverIndex;
+            unsigned int sizeForStorageIndex = getSizeForAdjustedFreestoreIndex(storageIndex);
+            
+            commitArenaRange(currentLeftoverAddress, sizeof(FreestoreBlock));
+            addAddressToFreestoreForAdjustedIndex(storageIndex, currentLeftoverAddress);
+            
+            currentLeftoverAddress = currentLeftoverAddress + sizeForStorageIndex;
+            currentLeftoverSpace = currentLeftoverSpace - sizeForStorageIndex;
+        }
+        
+        
+        if(currentLeftoverSpace > 0)
+        {
+            printf("WARNING: A small amount of memory of size '%d' was unable to fit into the freestore. \n\n", currentLeftoverSpace);
+        }
+    }
+
+    return true;
+}
+
+/*
+ Build the freestore header that keeps track of free blocks.
+ 
+ The freestore header is built at the front of the allocated space.
+ */
+Addr initFreestoreHeader(Addr startAddress, unsigned int minFreestoreIndex, unsigned int maxFreestoreIndex)
+{
+    //The pointer to pointers of the freestore block now start at the startAddress.
+    unsigned int freestoreRange = maxFreestoreIndex - minFreestoreIndex;
+    
+    if(freestoreRange == 0){
+        return 0;   //If there is no freestore range, then function fails.
+    }
+    
+    Freestore freestore = startAddress;
+    
+    if(commitArenaRange(startAddress, (freestoreRange + 1) * sizeof(FreestoreBlock)) == false){
+        return 0;
+    }
+    
+    resetFreestore(freestore, freestoreRange);
+    
+    _arena->freestoreRange = freestoreRange;
+    _arena->maxFreestoreIndexMemorySize = getSizeForAdjustedFreestoreIndex(freestoreRange);
+    
+    protectFreestoreHeader(freestore, minFreestoreIndex, maxFreestoreIndex);
+    
+    
+    
+    return startAddress;
+}
+
+unsigned int minFreestoreIndexForSize(unsigned int basic_block_size, unsigned int headerSize)
+{
+    unsigned int minIndex = 0;
+    
+    if(headerSize > basic_block_size)
+    {
+        double reducedSize = (headerSize / (_arena->basicBlockSize * 1.0));
+        double logSize = log2(reducedSize);
+        unsigned int fitIndex = ceil(logSize);
+        
+        minIndex = fitIndex;
+    }
+    
+    //Make sure that we can fit more than the header in fitIndexSize.
+    unsigned int fitIndexSize = getSizeForFreestoreIndex(minIndex);
+    if(fitIndexSize <= headerSize)
+    {
+        minIndex += 1;
+    }
+    
+    return minIndex;
+}
+
+unsigned int maxFreestoreIndexForSize(unsigned int basic_block_size, unsigned int length, unsigned int headerSize)
+{
+    unsigned int maxIndex = 0;
+    
+    double reducedSize = ((length - headerSize) / (_arena->basicBlockSize * 1.0));
+    double logSize = log2(reducedSize);
+    maxIndex = floor(logSize);             //We want the lowest index to ensure it will fit.
+    
+    return maxIndex;
+}
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS FOR MODULE MY_ALLOCATOR */
+/*--------------------------------------------------------------------------*/
+MemoryHeader* allocateHeaderForSize(unsigned int size)
+{
+    MemoryHeader* header = 0x0;
+    
+    unsigned int combinedSize = size + _arena->headerSize;
+    unsigned int targetIndex = getAdjustedFreestoreIndexForSize(combinedSize);
+    
+    if(targetIndex > _arena->freestoreRange){
+        return EMPTY_ADDRESS;   //Can't allocate more than is available.
+    }
+    
+    if(_maintenanceInterval > 0){
+        _arena->demandCount[targetIndex] += 1;
+    }
+    
+    //Retrieve our block, splitting a larger one if needed. If there is none, we've run out of memory.
+    Addr freeblockAddress = takeFreestoreBlockAtAdjustedIndex(targetIndex);
+    
+    if(freeblockAddress != EMPTY_ADDRESS)
+    {
+        header = freeblockAddress;    //Treat the target address as a header now.
+        
+        header->index = targetIndex;
+        header->length = size;
+        void* memoryStartAddress = (freeblockAddress + _arena->headerSize);
+        header->memoryStart = offsetForAddress(memoryStartAddress);
+    }
+    
+    return header;
+}
+
+/*
+    Allocates a block with room to move the memory start up to the alignment, and puts the header right before it.
+ 
+    The header is then somewhere inside the block instead of at its start, which deallocateHeader finds again from the index.
+ */
+MemoryHeader* allocateAlignedHeaderForSize(unsigned int size, unsigned int alignment)
+{
+    unsigned int paddedSize = size + (alignment - 1);
+    
+    if(paddedSize < size){
+        return EMPTY_ADDRESS;
+    }
+    
+    MemoryHeader* blockHeader = allocateHeaderForSize(paddedSize);
+    
+    if(blockHeader == EMPTY_ADDRESS){
+        return EMPTY_ADDRESS;
+    }
+    
+    Addr blockStart = blockHeader;
+    unsigned long firstStart = (unsigned long)(blockStart + _arena->headerSize);
+    Addr memoryStartAddress = (Addr)((firstStart + (alignment - 1)) & ~((unsigned long)alignment - 1));
+    unsigned int adjustedIndex = blockHeader->index;
+    
+    //Clear the header at the start of the block, unless the aligned header lands on it.
+    blockHeader->memoryStart = EMPTY_OFFSET;
+    
+    MemoryHeader* header = (memoryStartAddress - _arena->headerSize);
+    header->index = adjustedIndex;
+    header->length = size;
+    header->memoryStart = offsetForAddress(memoryStartAddress);
+    
+    return header;
+}
+
+MemoryHeader* memoryHeaderForAddress(Addr memoryAddress)
+{
+    unsigned int headerSize = _arena->headerSize;
+    Addr address = (memoryAddress - headerSize);
+    
+    //Verify MemoryHeader integrity.
+    MemoryHeader* header = address;
+    
     if(header != 0x0)
     {
-        address = header->memoryStart;
-    } else {
-        printf("ERROR> Allocation Failure: Could not deliver size(%d) for request. \n",length);
+        bool valid = (addressForOffset(header->memoryStart) == memoryAddress);
+        
+        if(!valid){
+            header = 0x0;
+        }
+    }
+    
+    return header;
+}
+
+bool deallocateHeaderAtAddress(Addr memoryAddress)
+{
+    bool success = false;
+    MemoryHeader* header = memoryHeaderForAddress(memoryAddress);
+    
+    if(header != 0x0){
+        success = deallocateHeader(header);
+    }
+    
+    return success;
+}
+
+bool deallocateHeader(MemoryHeader* header)
+{
+    bool success = false;
+    
+    if(header != 0x0){
+        unsigned int adjustedIndex = header->index;
+        Addr startAddress = getBlockStartForAdjustedIndex(adjustedIndex, header);   //Aligned headers sit inside their block.
+        
+        _arena->allocatedBlocks -= 1;
+        _arena->allocatedBytes -= getSizeForAdjustedFreestoreIndex(adjustedIndex);
+        _arena->requestedBytes -= header->length;
+        _arena->headerBytes -= _arena->headerSize;
+        _arena->freeCount += 1;
+        
+        //Clear the header.
+        header->memoryStart = EMPTY_OFFSET;
+        header->index = EMPTY_VALUE;
+        header->length = EMPTY_VALUE;
+        
+        //Address is returned to the freestore, merged with any free buddies unless merging is deferred.
+        returnFreestoreBlockAtAdjustedIndex(adjustedIndex, startAddress);
+        
+        success = true;
+    }
+
+    return success;
+}
+
+/*
+    TLSF takes no basic block size, and hands the whole memory out once it holds a single free block.
+ */
+unsigned int initTlsfEngine(Addr memory, unsigned int length, unsigned int basicBlockSize)
+{
+    return (tlsf_init(memory, length) > 0) ? length : 0;
+}
+
+/*
+    TLSF has no orders of its own. Requests are still sized against basic blocks doubled.
+ */
+unsigned int tlsfOrderSize(unsigned int order)
+{
+    return (order < 32) ? (_arenas[0]->basicBlockSize << order) : 0;
+}
+
+const EngineOps _engineTable[] = {
+    [ALLOCATOR_ENGINE_TLSF] = {
+        .init = initTlsfEngine, .malloc = tlsf_malloc, .mallocAligned = tlsf_malloc_aligned, .free = tlsf_free,
+        .blockSize = tlsf_block_size, .usableSize = tlsf_usable_size,
+        .orderSize = tlsfOrderSize, .freeBytes = tlsf_free_bytes
+    },
+    [ALLOCATOR_ENGINE_LOCKFREE] = {
+        .init = lockfree_init, .malloc = lockfree_malloc, .mallocAligned = lockfree_malloc_aligned, .free = lockfree_free,
+        .blockSize = lockfree_block_size, .usableSize = lockfree_usable_size, .requestedSize = lockfree_requested_size,
+        .headerSize = lockfree_header_size, .orderCount = lockfree_order_count, .orderSize = lockfree_order_size,
+        .freeBlocks = lockfree_free_blocks, .atomicCounters = true
+    },
+    [ALLOCATOR_ENGINE_TEMPLATE] = {
+        .init = buddy_heap_init, .malloc = buddy_heap_malloc, .mallocAligned = buddy_heap_malloc_aligned, .free = buddy_heap_free,
+        .blockSize = buddy_heap_block_size, .usableSize = buddy_heap_usable_size, .requestedSize = buddy_heap_requested_size,
+        .headerSize = buddy_heap_header_size, .orderCount = buddy_heap_order_count, .orderSize = buddy_heap_order_size,
+        .freeBlocks = buddy_heap_free_blocks, .freeBytes = buddy_heap_free_bytes,
+        .splitCount = buddy_heap_split_count, .mergeCount = buddy_heap_merge_count
+    },
+    [ALLOCATOR_ENGINE_TREE] = {
+        .init = tree_init, .malloc = tree_malloc, .mallocAligned = tree_malloc_aligned, .free = tree_free,
+        .blockSize = tree_block_size, .usableSize = tree_block_size,        //Blocks have no header, the whole block is usable.
+        .orderCount = tree_order_count, .orderSize = tree_order_size,
+        .freeBlocks = tree_free_blocks, .freeBytes = tree_free_bytes,
+        .splitCount = tree_split_count, .mergeCount = tree_merge_count
+    }
+};
+
+void addToCounter(unsigned long* counter, unsigned long amount, bool atomic)
+{
+    if(atomic){
+        __atomic_add_fetch(counter, amount, __ATOMIC_RELAXED);
+    } else {
+        *counter += amount;
+    }
+}
+
+void subtractFromCounter(unsigned long* counter, unsigned long amount, bool atomic)
+{
+    if(atomic){
+        __atomic_sub_fetch(counter, amount, __ATOMIC_RELAXED);
+    } else {
+        *counter -= amount;
+    }
+}
+
+/*
+    Counts an allocation made by an engine, or its failure, and returns the address.
+ */
+Addr recordEngineAllocation(const EngineOps* ops, Addr address, unsigned int length)
+{
+    if(address == EMPTY_ADDRESS)
+    {
+        addToCounter(&_arena->failedCount, 1, ops->atomicCounters);
+        printf("ERROR> Allocation Failure: Could not deliver size(%d) for request. \n",length);
+        return EMPTY_ADDRESS;
+    }
+    
+    addToCounter(&_arena->allocatedBlocks, 1, ops->atomicCounters);
+    addToCounter(&_arena->allocatedBytes, ops->blockSize(address), ops->atomicCounters);
+    addToCounter(&_arena->mallocCount, 1, ops->atomicCounters);
+    
+    if(ops->requestedSize != NULL){
+        addToCounter(&_arena->requestedBytes, length, ops->atomicCounters);
+    }
+    
+    return address;
+}
+
+/*
+    Counts a block an engine took back, with the sizes read before it went back.
+ */
+void recordEngineFree(const EngineOps* ops, unsigned int blockSize, unsigned int requestedSize)
+{
+    subtractFromCounter(&_arena->allocatedBlocks, 1, ops->atomicCounters);
+    subtractFromCounter(&_arena->allocatedBytes, blockSize, ops->atomicCounters);
+    subtractFromCounter(&_arena->requestedBytes, requestedSize, ops->atomicCounters);
+    addToCounter(&_arena->freeCount, 1, ops->atomicCounters);
+}
+
+/*
+    Counts an allocation made with a header, or its failure, and returns the memory start.
+ */
+Addr recordHeaderAllocation(MemoryHeader* header, unsigned int length)
+{
+    if(header == EMPTY_ADDRESS)
+    {
+        _arena->failedCount += 1;
+        printf("ERROR> Allocation Failure: Could not deliver size(%d) for request. \n",length);
+        return EMPTY_ADDRESS;
+    }
+    
+    _arena->allocatedBlocks += 1;
+    _arena->allocatedBytes += getSizeForAdjustedFreestoreIndex(header->index);
+    _arena->requestedBytes += length;
+    _arena->headerBytes += _arena->headerSize;
+    _arena->mallocCount += 1;
+    
+    Addr memoryStartAddress = addressForOffset(header->memoryStart);
+    
+    markAllocationAtAddress(memoryStartAddress);
+    
+    return memoryStartAddress;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE MY_ALLOCATOR */
+/*--------------------------------------------------------------------------*/
+
+void resetStatistics(void)
+{
+    _arena->allocatedBlocks = 0;
+    _arena->allocatedBytes = 0;
+    _arena->requestedBytes = 0;
+    _arena->mallocCount = 0;
+    _arena->freeCount = 0;
+    _arena->failedCount = 0;
+    _arena->splitCount = 0;
+    _arena->mergeCount = 0;
+    _arena->headerBytes = 0;
+}
+
+unsigned int init_allocator_with_engine(AllocatorEngine engine, unsigned int basic_block_size, unsigned int length){
+    
+    if(engine != ALLOCATOR_ENGINE_BUDDY && engine < (sizeof(_engineTable) / sizeof(EngineOps)))
+    {
+        const EngineOps* ops = &_engineTable[engine];
+        Addr memory = malloc((size_t)length);
+        unsigned int coveredLength = (memory != EMPTY_ADDRESS) ? ops->init(memory, length, basic_block_size) : 0;
+        
+        if(coveredLength == 0)
+        {
+            free(memory);
+            return 0;
+        }
+        
+        _engine = engine;
+        _engineMemory = memory;
+        _numaArenas = false;
+        _lockedArenas = false;  //Engines keep their own state, the arena is only there for the counters.
+        _arenaCount = 0;        //There's no buddy arena to release.
+        _arenas[0] = &_arenaStorage[0];
+        _arena = _arenas[0];
+        _arena->basicBlockSize = basic_block_size;
+        _arena->length = length;
+        _arena->headerSize = (ops->headerSize != NULL) ? ops->headerSize() : 0;
+        
+        resetStatistics();
+        
+        return coveredLength;
+    }
+    
+    _engine = ALLOCATOR_ENGINE_BUDDY;
+    return init_allocator(basic_block_size, length);
+}
+
+unsigned int init_allocator(unsigned int basic_block_size, unsigned int length){
+    
+    int allocatedSize = 0;
+    _engine = ALLOCATOR_ENGINE_BUDDY;
+    _numaArenas = false;
+    _lockedArenas = false;
+    _arenaCount = 1;
+    _arenas[0] = &_arenaStorage[0];
+    _arena = _arenas[0];
+    
+    if(basic_block_size < length){
+        
+        size_t size = (size_t)length;
+        Addr startAddress = EMPTY_ADDRESS;
+        
+        //Page aligned, so blocks of a page or more are too, see my_iobuf_alloc.
+        if(posix_memalign(&startAddress, IO_BUFFER_MIN_SIZE, size) != 0){
+            startAddress = EMPTY_ADDRESS;
+        }
+        
+        _arena->mappedLength = 0;
+        _arena->reservedLength = 0;
+        allocatedSize = initArenaWithMemory(basic_block_size, length, startAddress);
+        
+        if(allocatedSize == 0)
+        {
+            free(startAddress);
+        }
+    }
+    
+    return allocatedSize;
+}
+
+/*
+    Same as init_allocator, but the memory is only reserved up front, with no access, and is committed
+    as blocks are first handed out. Only the freestore and the headers of the blocks it starts with are
+    written by init, so neither its time nor the resident memory grow with the length.
+ */
+unsigned int init_allocator_reserved(unsigned int basic_block_size, unsigned int length){
+    
+    _engine = ALLOCATOR_ENGINE_BUDDY;
+    _numaArenas = false;
+    _lockedArenas = false;
+    _arenaCount = 1;
+    _arenas[0] = &_arenaStorage[0];
+    _arena = _arenas[0];
+    
+    if(basic_block_size >= length)
+    {
+        return 0;
+    }
+    
+    unsigned long chunkCount = (length + COMMIT_CHUNK_SIZE - 1) / COMMIT_CHUNK_SIZE;
+    unsigned long* committedChunks = calloc((chunkCount + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS, sizeof(unsigned long));
+    Addr startAddress = mmap(EMPTY_ADDRESS, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    
+    if(committedChunks == EMPTY_ADDRESS || startAddress == MAP_FAILED)
+    {
+        free(committedChunks);
+        
+        if(startAddress != MAP_FAILED){
+            munmap(startAddress, length);
+        }
+        
+        return 0;
+    }
+    
+    _arena->mappedLength = 0;
+    _arena->reservedLength = length;
+    _arena->committedChunks = committedChunks;
+    _arena->committedBytes = 0;
+    
+    unsigned int allocatedSize = initArenaWithMemory(basic_block_size, length, startAddress);
+    
+    if(allocatedSize == 0)
+    {
+        munmap(startAddress, length);
+        free(committedChunks);
+        _arena->committedChunks = EMPTY_ADDRESS;
+        _arena->reservedLength = 0;
+    }
+    
+    return allocatedSize;
+}
+
+/*
+    Builds one NUMA arena of the given length per node, each in memory bound to its node.
+ 
+    With a single node there's nothing to place, so this is the same as init_allocator.
+ */
+unsigned int init_allocator_numa(unsigned int basic_block_size, unsigned int length){
+    
+    unsigned int nodeCount = numa_node_count();
+    
+    if(nodeCount <= 1 || basic_block_size >= length)
+    {
+        return init_allocator(basic_block_size, length);
+    }
+    
+    nodeCount = minValue(nodeCount, MAX_ARENAS);
+    
+    _engine = ALLOCATOR_ENGINE_BUDDY;
+    _numaArenas = true;
+    _lockedArenas = true;
+    _arenaCount = 0;
+    
+    unsigned int allocatedSize = 0;
+    
+    for(unsigned int node = 0; node < nodeCount; node++)
+    {
+        _arenas[node] = &_arenaStorage[node];
+        _arena = _arenas[node];
+        
+        Addr startAddress = numa_map_on_node(length, node);
+        
+        if(startAddress == EMPTY_ADDRESS)
+        {
+            break;
+        }
+        
+        _arena->mappedLength = length;
+        _arena->reservedLength = 0;
+        _arena->node = node;
+        
+        if(initArenaWithMemory(basic_block_size, length, startAddress) == 0)
+        {
+            numa_unmap(startAddress, length);
+            break;
+        }
+        
+        pthread_mutex_init(&_arena->lock, EMPTY_ADDRESS);
+        _arenaCount += 1;
+        allocatedSize += length;
+    }
+    
+    if(_arenaCount < nodeCount)
+    {
+        release_allocator();
+        return 0;
+    }
+    
+    _arena = _arenas[0];
+    
+    return allocatedSize;
+}
+
+/*
+    Lays the freestore over the given memory and resets the current arena.
+ 
+    Returns the length made available, or 0 if no freestore fits in it. The memory stays the caller's to release on failure.
+ */
+unsigned int initArenaWithMemory(unsigned int basic_block_size, unsigned int length, Addr startAddress){
+    
+    int allocatedSize = 0;
+    
+    if(startAddress != EMPTY_ADDRESS){
+        
+        _arena->basicBlockSize = basic_block_size;
+        _arena->length = length;
+        _arena->headerSize = sizeof(FreestoreBlock);
+        
+        _arena->minFreestoreIndex = minFreestoreIndexForSize(basic_block_size, _arena->headerSize);
+        _arena->minFreestoreIndexMemorySize = getSizeForFreestoreIndex(_arena->minFreestoreIndex);
+        _arena->maxFreestoreIndex = maxFreestoreIndexForSize(basic_block_size, length, _arena->headerSize);
+        _arena->maxFreestoreIndexMemorySize = getSizeForFreestoreIndex(_arena->minFreestoreIndex);
+        setArenaFreestore(_arena, startAddress);
+        
+        resetStatistics();
+        
+        for(unsigned int i = 0; i < MAX_ALLOCATOR_ORDERS; i++)
+        {
+            _arena->lazyCount[i] = 0;
+        }
+        
+        Addr freestoreAddress = initFreestoreHeader(startAddress, _arena->minFreestoreIndex, _arena->maxFreestoreIndex);
+        setArenaFreestore(_arena, freestoreAddress);
+        
+        if(freestoreAddress == EMPTY_ADDRESS)
+        {
+            return 0;
+        }
+        
+        if(initAllocationBitmap() == false)
+        {
+            return 0;
+        }
+        
+        initSizeClasses();
+        
+        _arena->rootObject = EMPTY_OFFSET;
+        allocatedSize = _arena->length;
+    }
+    
+    return allocatedSize;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAPPED HEAP */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Opens, or creates, the heap file at path and makes it the only arena.
+ 
+    A new file is laid out like init_allocator would lay out malloc'ed memory. An existing one is used as it is,
+    with every block it held still allocated, as long as it was made with the same basic block size and length.
+ */
+unsigned int init_allocator_mapped(const char* path, unsigned int basic_block_size, unsigned int length){
+    
+    if(path == EMPTY_ADDRESS || basic_block_size >= length)
+    {
+        return 0;
+    }
+    
+    int file = open(path, O_RDWR | O_CREAT, 0600);
+    
+    if(file < 0)
+    {
+        return 0;
+    }
+    
+    unsigned int allocatedSize = initMappedHeapOnFile(file, basic_block_size, length, false);
+    
+    if(allocatedSize == 0)
+    {
+        close(file);
+    }
+    
+    return allocatedSize;
+}
+
+/*
+    Opens, or creates, the POSIX shared memory object called name and makes the heap in it the only arena.
+ 
+    Whoever creates the object lays the heap out. Everyone else attaches to it, and fails until it is laid out.
+ */
+unsigned int init_allocator_shared(const char* name, unsigned int basic_block_size, unsigned int length){
+    
+    if(name == EMPTY_ADDRESS || basic_block_size >= length)
+    {
+        return 0;
+    }
+    
+    int file = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    
+    if(file < 0 && errno == EEXIST)
+    {
+        file = shm_open(name, O_RDWR, 0600);
+        
+        //Still empty means the creator hasn't sized it yet, and an empty object would be laid out a second time.
+        struct stat fileStatus;
+        
+        if(file >= 0 && (fstat(file, &fileStatus) != 0 || fileStatus.st_size == 0))
+        {
+            close(file);
+            return 0;
+        }
+    }
+    
+    if(file < 0)
+    {
+        return 0;
+    }
+    
+    unsigned int allocatedSize = initMappedHeapOnFile(file, basic_block_size, length, true);
+    
+    if(allocatedSize == 0)
+    {
+        close(file);
+    }
+    
+    return allocatedSize;
+}
+
+/*
+    Same as init_allocator_shared, over a file the caller already has open, such as a memfd handed down or passed
+    over a socket. An empty file is laid out, anything else is attached to. The file is duplicated, so the caller
+    can close its own.
+ */
+unsigned int init_allocator_shared_fd(int file, unsigned int basic_block_size, unsigned int length){
+    
+    if(file < 0 || basic_block_size >= length)
+    {
+        return 0;
+    }
+    
+    int ownFile = dup(file);
+    
+    if(ownFile < 0)
+    {
+        return 0;
+    }
+    
+    unsigned int allocatedSize = initMappedHeapOnFile(ownFile, basic_block_size, length, true);
+    
+    if(allocatedSize == 0)
+    {
+        close(ownFile);
+    }
+    
+    return allocatedSize;
+}
+
+/*
+    Maps the heap kept in an open file, laying a fresh one over it if the file is empty.
+ 
+    A shared heap's lock lives in the file with the rest of it, and is only set up by whoever lays the heap out,
+    since other processes may be holding it.
+ 
+    Returns the length made available, or 0 on error. The file stays the caller's to close on failure.
+ */
+unsigned int initMappedHeapOnFile(int file, unsigned int basic_block_size, unsigned int length, bool shared){
+    
+    struct stat fileStatus;
+    unsigned long pageSize = (unsigned long)sysconf(_SC_PAGESIZE);
+    unsigned long headerLength = ((sizeof(MappedHeapHeader) + pageSize - 1) / pageSize) * pageSize;
+    unsigned long mappedLength = headerLength + length;
+    
+    if(fstat(file, &fileStatus) != 0)
+    {
+        return 0;
+    }
+    
+    bool created = (fileStatus.st_size == 0) ? true : false;
+    
+    if(created == false && (unsigned long)fileStatus.st_size != mappedLength)
+    {
+        return 0;
+    }
+    
+    if(created == true && ftruncate(file, (off_t)mappedLength) != 0)
+    {
+        return 0;
+    }
+    
+    MappedHeapHeader* header = mmap(EMPTY_ADDRESS, mappedLength, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    
+    if(header == MAP_FAILED)
+    {
+        return 0;
+    }
+    
+    if(created == false && isMappedHeapHeaderValid(header, basic_block_size, length) == false)
+    {
+        munmap(header, mappedLength);
+        return 0;
+    }
+    
+    _engine = ALLOCATOR_ENGINE_BUDDY;
+    _numaArenas = false;
+    _lockedArenas = shared;
+    _arenaCount = 1;
+    _arenas[0] = &header->arena;
+    _arena = _arenas[0];
+    
+    Addr startAddress = (Addr)header + headerLength;
+    
+    if(created == true)
+    {
+        //The magic goes in last, so a file that was cut short while being laid out is never taken for a heap.
+        header->version = MAPPED_HEAP_VERSION;
+        header->headerLength = (unsigned int)headerLength;
+        header->arenaSize = sizeof(Arena);
+        
+        if(initArenaWithMemory(basic_block_size, length, startAddress) == 0 || (shared == true && initSharedArenaLock() == false))
+        {
+            munmap(header, mappedLength);
+            _lockedArenas = false;
+            _arenas[0] = &_arenaStorage[0];
+            _arena = _arenas[0];
+            return 0;
+        }
+        
+        header->magic = MAPPED_HEAP_MAGIC;
+    }
+    
+    if(shared == false)
+    {
+        _arena->mappedLength = 0;
+        _arena->node = 0;
+        pthread_mutex_init(&_arena->lock, EMPTY_ADDRESS);
+    }
+    
+    _mappedHeap = header;
+    _mappedHeapLength = mappedLength;
+    _mappedHeapFile = file;
+    _mappedHeapShared = shared;
+    
+    return _arena->length;
+}
+
+/*
+    Sets up the current arena's lock so that it works across every process mapping the heap.
+ */
+bool initSharedArenaLock(void)
+{
+    pthread_mutexattr_t attributes;
+    
+    if(pthread_mutexattr_init(&attributes) != 0)
+    {
+        return false;
+    }
+    
+    int result = pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    
+    if(result == 0)
+    {
+        result = pthread_mutex_init(&_arena->lock, &attributes);
+    }
+    
+    pthread_mutexattr_destroy(&attributes);
+    
+    return (result == 0) ? true : false;
+}
+
+/*
+    Checks that a heap file was laid out by this build, with the given basic block size and length.
+ */
+bool isMappedHeapHeaderValid(MappedHeapHeader* header, unsigned int basic_block_size, unsigned int length)
+{
+    return (header->magic == MAPPED_HEAP_MAGIC &&
+            header->version == MAPPED_HEAP_VERSION &&
+            header->arenaSize == sizeof(Arena) &&
+            header->arena.basicBlockSize == basic_block_size &&
+            header->arena.length == length) ? true : false;
+}
+
+/*
+    Writes the mapped heap back to its file and unmaps it. The heap stays in the file for the next init_allocator_mapped,
+    or in the shared memory object for the processes still attached to it.
+ */
+void releaseMappedHeap(void)
+{
+    if(_mappedHeapShared == false)
+    {
+        pthread_mutex_destroy(&_mappedHeap->arena.lock);
+    }
+    
+    msync(_mappedHeap, _mappedHeapLength, MS_SYNC);
+    munmap(_mappedHeap, _mappedHeapLength);
+    close(_mappedHeapFile);
+    
+    _mappedHeap = EMPTY_ADDRESS;
+    _mappedHeapLength = 0;
+    _mappedHeapFile = -1;
+    _mappedHeapShared = false;
+}
+
+int release_allocator(){
+    stopMaintenance();
+    stopWaiting();
+    large_release_all();
+    
+    //Sub-heaps are blocks of the main arena, released along with it.
+    for(unsigned int i = 0; i < LIFETIME_CLASSES; i++)
+    {
+        _lifetimeHeapCounts[i] = 0;
+    }
+    
+    _lifetimeHeapTotal = 0;
+    releaseHandles();
+    releaseIoBuffers();
+    
+    if(_heapSampling)
+    {
+        heap_profiler_release_all();
+    }
+    
+    free(_engineMemory);
+    _engineMemory = EMPTY_ADDRESS;
+    
+    for(unsigned int i = 0; i < _arenaCount; i++)
+    {
+        Arena* arena = _arenas[i];
+        
+        if(_mappedHeap != EMPTY_ADDRESS && arena == &_mappedHeap->arena)
+        {
+            releaseMappedHeap();
+            continue;
+        }
+        
+        if(arena->reservedLength > 0)
+        {
+            munmap(getArenaFreestore(arena), arena->reservedLength);
+            free(arena->committedChunks);
+            arena->committedChunks = EMPTY_ADDRESS;
+            arena->reservedLength = 0;
+        } else if(arena->mappedLength > 0)
+        {
+            numa_unmap(getArenaFreestore(arena), arena->mappedLength);
+            pthread_mutex_destroy(&arena->lock);
+        } else {
+            free(getArenaFreestore(arena));
+        }
+        
+        setArenaFreestore(arena, EMPTY_ADDRESS);
+        arena->slabMap = EMPTY_OFFSET;
+        arena->mappedLength = 0;
+    }
+    
+    _numaArenas = false;
+    _lockedArenas = false;
+    _arenaCount = 1;
+    _arenas[0] = &_arenaStorage[0];
+    _arena = _arenas[0];
+    return 0;
+}
+
+/*
+    Allocates from the current arena. With NUMA arenas, the caller holds its lock.
+ */
+Addr allocateInArena(unsigned int length)
+{
+    Addr address = 0x0;
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY)
+    {
+        const EngineOps* ops = &_engineTable[_engine];
+        address = (_engineMemory != EMPTY_ADDRESS) ? ops->malloc(length) : EMPTY_ADDRESS;
+        return recordEngineAllocation(ops, address, length);
+    }
+    
+    //Small requests go to a slab of their size class, when those are on.
+    if(_arena->sizeClassesEnabled && _arena->sizeClassCount > 0 && length <= getSizeForSizeClass(_arena->sizeClassCount - 1))
+    {
+        address = allocateSlotForSize(length);
+        
+        if(address != 0x0)
+        {
+            markAllocationAtAddress(address);
+            
+            _arena->allocatedBlocks += 1;
+            _arena->allocatedBytes += getSizeForSizeClass(getSizeClassForLength((length > 0) ? length : 1));
+            _arena->mallocCount += 1;
+            return address;
+        }
+    }
+    
+    return recordHeaderAllocation(allocateHeaderForSize(length), length);
+}
+
+Addr allocateAlignedInArena(unsigned int length, unsigned int alignment)
+{
+    if(_engine != ALLOCATOR_ENGINE_BUDDY)
+    {
+        const EngineOps* ops = &_engineTable[_engine];
+        Addr address = (_engineMemory != EMPTY_ADDRESS) ? ops->mallocAligned(length, alignment) : EMPTY_ADDRESS;
+        return recordEngineAllocation(ops, address, length);
+    }
+    
+    //Blocks start at multiples of the basic block size, so with a header in front of it the memory already lines up.
+    if(alignment <= _arena->headerSize && (_arena->basicBlockSize % alignment) == 0)
+    {
+        return allocateInArena(length);
+    }
+    
+    return recordHeaderAllocation(allocateAlignedHeaderForSize(length, alignment), length);
+}
+
+/*
+    Frees memory of the current arena. With NUMA arenas, the caller holds its lock.
+ */
+bool deallocateInArena(Addr address)
+{
+    bool success = false;
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY)
+    {
+        const EngineOps* ops = &_engineTable[_engine];
+        
+        if(_engineMemory == EMPTY_ADDRESS){
+            return false;
+        }
+        
+        //Read before the block goes back, with the lock-free engine it may be handed out again right after.
+        unsigned int blockSize = ops->blockSize(address);
+        
+        if(blockSize == 0){
+            return false;
+        }
+        
+        unsigned int requestedSize = (ops->requestedSize != NULL) ? ops->requestedSize(address) : 0;
+        
+        if(ops->free(address) != 0){
+            return false;
+        }
+        
+        recordEngineFree(ops, blockSize, requestedSize);
+        return true;
+    }
+    
+    //Foreign pointers, interior pointers and double frees are turned away here, before any list is touched.
+    if(!isAllocationAtAddress(address)){
+        return false;
+    }
+    
+    //Slots have no header in front of them, so the slab map has to be checked first.
+    SlabHeader* slab = slabForAddress(address);
+    
+    if(slab != EMPTY_ADDRESS)
+    {
+        unsigned int slotSize = slab->slotSize;
+        success = deallocateSlotAtAddress(slab, address);
+        
+        if(success)
+        {
+            _arena->allocatedBlocks -= 1;
+            _arena->allocatedBytes -= slotSize;
+            _arena->freeCount += 1;
+        }
+    } else {
+        success = deallocateHeaderAtAddress(address);
+    }
+    
+    if(success){
+        clearAllocationAtAddress(address);
+    }
+    
+    return success;
+}
+
+/*
+    Fills the stats of the current arena.
+ */
+int collectArenaStats(AllocatorStats* stats)
+{
+    if(getArenaFreestore(_arena) == EMPTY_ADDRESS && _engineMemory == EMPTY_ADDRESS){
+        return 1;
+    }
+    
+    //TLSF has no orders to report, only its free bytes. The other engines report their own orders below.
+    unsigned int orderCount = (_engine != ALLOCATOR_ENGINE_BUDDY) ? 0 : minValue(_arena->freestoreRange + 1, MAX_ALLOCATOR_ORDERS);
+    
+    stats->basicBlockSize = _arena->basicBlockSize;
+    stats->headerSize = _arena->headerSize;
+    stats->orderCount = orderCount;
+    stats->freeBytes = 0;
+    
+    for(unsigned int i = 0; i < orderCount; i++)
+    {
+        unsigned int count = 0;
+        FreestoreBlock* block = getFirstFreestoreBlockAtAdjustedIndex(i);
+        
+        //The head block only counts if it holds an address.
+        if(block->address != EMPTY_OFFSET)
+        {
+            while(block != 0x0)
+            {
+                count++;
+                block = addressForOffset(block->nextBlock);
+            }
+        }
+        
+        stats->orderSize[i] = getSizeForAdjustedFreestoreIndex(i);
+        stats->freeBlocks[i] = count;
+        stats->freeBytes += ((unsigned long)count * stats->orderSize[i]);
+    }
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY)
+    {
+        const EngineOps* ops = &_engineTable[_engine];
+        unsigned int engineOrders = (ops->orderCount != NULL) ? ops->orderCount() : 0;
+        
+        stats->orderCount = minValue(engineOrders, MAX_ALLOCATOR_ORDERS);
+        
+        for(unsigned int i = 0; i < stats->orderCount; i++)
+        {
+            stats->orderSize[i] = ops->orderSize(i);
+            stats->freeBlocks[i] = (unsigned int)ops->freeBlocks(i);
+            stats->freeBytes += ((unsigned long)stats->freeBlocks[i] * stats->orderSize[i]);
+        }
+        
+        if(ops->freeBytes != NULL){
+            stats->freeBytes = ops->freeBytes();
+        }
+        
+        if(ops->splitCount != NULL)
+        {
+            _arena->splitCount = ops->splitCount();
+            _arena->mergeCount = ops->mergeCount();
+        }
+    }
+    
+    stats->allocatedBlocks = _arena->allocatedBlocks;
+    stats->allocatedBytes = _arena->allocatedBytes;
+    stats->requestedBytes = _arena->requestedBytes;
+    stats->mallocCount = _arena->mallocCount;
+    stats->freeCount = _arena->freeCount;
+    stats->failedCount = _arena->failedCount;
+    stats->splitCount = _arena->splitCount;
+    stats->mergeCount = _arena->mergeCount;
+    stats->headerBytes = _arena->headerBytes;
+    stats->slabBytes = _arena->slabBytes;
+    stats->slotBytes = _arena->slotBytes;
+    stats->lazyBlocks = 0;
+    
+    for(unsigned int i = 0; i < orderCount; i++)
+    {
+        stats->lazyBlocks += _arena->lazyCount[i];
+    }
+    
+    stats->committedBytes = (_arena->reservedLength > 0) ? _arena->committedBytes : _arena->length;
+    stats->arenaCount = 1;
+    
+    return 0;
+}
+
+/*
+    Returns whether the address lies in the memory of any arena, or of the TLSF, lock-free, template or tree engine.
+ */
+bool isArenaAddress(Addr memoryAddress)
+{
+    if(_engine != ALLOCATOR_ENGINE_BUDDY)
+    {
+        return (_engineMemory != EMPTY_ADDRESS && memoryAddress >= _engineMemory && memoryAddress < (_engineMemory + _arenas[0]->length)) ? true : false;
+    }
+    
+    return (arenaForAddress(memoryAddress) != EMPTY_ADDRESS) ? true : false;
+}
+
+/*
+    Returns the bytes the allocation at the address can hold from there on, or 0 if it isn't one.
+    With NUMA arenas, the caller holds the lock of the arena the address is in.
+ */
+unsigned int usableSizeInArena(Addr memoryAddress)
+{
+    if(_engine != ALLOCATOR_ENGINE_BUDDY)
+    {
+        return (_engineMemory != EMPTY_ADDRESS) ? _engineTable[_engine].usableSize(memoryAddress) : 0;
+    }
+    
+    if(!isAllocationAtAddress(memoryAddress)){
+        return 0;
+    }
+    
+    SlabHeader* slab = slabForAddress(memoryAddress);
+    
+    if(slab != EMPTY_ADDRESS){
+        return slab->slotSize;
+    }
+    
+    MemoryHeader* header = memoryHeaderForAddress(memoryAddress);
+    
+    if(header == EMPTY_ADDRESS){
+        return 0;
+    }
+    
+    //Aligned memory starts somewhere inside its block.
+    Addr blockAddress = getBlockStartForAdjustedIndex(header->index, header);
+    
+    return (unsigned int)((blockAddress + getSizeForAdjustedFreestoreIndex(header->index)) - memoryAddress);
+}
+
+/*--------------------------------------------------------------------------*/
+/* ARENA FUNCTIONS */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Returns the arena whose memory holds the address, or EMPTY_ADDRESS if none does.
+ */
+Arena* arenaForAddress(Addr memoryAddress)
+{
+    for(unsigned int i = 0; i < _arenaCount; i++)
+    {
+        Addr startAddress = getArenaFreestore(_arenas[i]);
+        
+        if(memoryAddress >= startAddress && memoryAddress < (startAddress + _arenas[i]->length))
+        {
+            return _arenas[i];
+        }
+    }
+    
+    return EMPTY_ADDRESS;
+}
+
+/*
+    Allocates from the arena of the node the calling thread runs on. An alignment of 0 allocates unaligned.
+ */
+Addr allocateInNodeArena(unsigned int length, unsigned int alignment)
+{
+    _arena = _arenas[numa_current_node() % _arenaCount];
+    
+    return allocateInLockedArena(length, alignment);
+}
+
+/*
+    Allocates from the current arena, holding its lock if arenas are locked. An alignment of 0 allocates unaligned.
+ */
+Addr allocateInLockedArena(unsigned int length, unsigned int alignment)
+{
+    lockArena();
+    Addr address = (alignment == 0) ? allocateInArena(length) : allocateAlignedInArena(length, alignment);
+    unlockArena();
+    
+    return address;
+}
+
+void lockArena(void)
+{
+    if(_lockedArenas)
+    {
+        pthread_mutex_lock(&_arena->lock);
+    }
+}
+
+void unlockArena(void)
+{
+    if(_lockedArenas)
+    {
+        pthread_mutex_unlock(&_arena->lock);
+    }
+}
+
+/*
+    Adds the stats of one arena to the running total. Orders are the same in every arena.
+ */
+void accumulateArenaStats(AllocatorStats* total, AllocatorStats* stats)
+{
+    if(total->arenaCount == 0)
+    {
+        *total = *stats;
+        return;
+    }
+    
+    for(unsigned int i = 0; i < stats->orderCount; i++)
+    {
+        total->freeBlocks[i] += stats->freeBlocks[i];
+    }
+    
+    total->arenaCount += stats->arenaCount;
+    total->freeBytes += stats->freeBytes;
+    total->allocatedBlocks += stats->allocatedBlocks;
+    total->allocatedBytes += stats->allocatedBytes;
+    total->requestedBytes += stats->requestedBytes;
+    total->headerBytes += stats->headerBytes;
+    total->slabBytes += stats->slabBytes;
+    total->slotBytes += stats->slotBytes;
+    total->mallocCount += stats->mallocCount;
+    total->freeCount += stats->freeCount;
+    total->failedCount += stats->failedCount;
+    total->splitCount += stats->splitCount;
+    total->mergeCount += stats->mergeCount;
+    total->lazyBlocks += stats->lazyBlocks;
+    total->committedBytes += stats->committedBytes;
+}
+
+/*--------------------------------------------------------------------------*/
+/* LIFETIME HEAPS */
+/*--------------------------------------------------------------------------*/
+
+/*
+    my_malloc_hint serves each lifetime from sub-heaps of its own. A sub-heap is one block of the main arena with
+    an arena of its own laid over it, so the churn of short lived requests splits and merges inside its sub-heaps
+    and never leaves a block of the main arena pinned by one survivor. A sub-heap that empties goes back to the
+    main arena as the one block it was, unless it's the last of its lifetime, which is kept until the main arena
+    runs out. Long lived and hot data stays packed into the few sub-heaps it fills.
+ 
+    Sub-heaps only come out of the one buddy arena a process owns. Everything about them happens under the main
+    arena's lock, so their own locks are never taken.
+ */
+
+/*
+    Returns the lifetime the flags ask for, or LIFETIME_NONE. Short lived wins over hot, and hot over long lived.
+ */
+unsigned int lifetimeForFlags(unsigned int flags)
+{
+    if(flags & ALLOCATION_HINT_SHORT_LIVED){
+        return 0;
+    }
+    
+    if(flags & ALLOCATION_HINT_HOT){
+        return 2;
+    }
+    
+    if(flags & ALLOCATION_HINT_LONG_LIVED){
+        return 1;
+    }
+    
+    return LIFETIME_NONE;
+}
+
+/*
+    Returns the adjusted index of the main arena blocks sub-heaps are made of, or one past its range when they'd be too small.
+ */
+unsigned int lifetimeHeapIndex(void)
+{
+    Arena* arena = _arenas[0];
+    
+    if(arena->freestoreRange < LIFETIME_HEAP_SHIFT){
+        return arena->freestoreRange + 1;
+    }
+    
+    unsigned int index = arena->freestoreRange - LIFETIME_HEAP_SHIFT;
+    unsigned int size = (arena->basicBlockSize << (arena->minFreestoreIndex + index));
+    
+    return (size >= LIFETIME_MIN_HEAP_SIZE) ? index : arena->freestoreRange + 1;
+}
+
+bool lifetimeHeapsAvailable(void)
+{
+    return (_engine == ALLOCATOR_ENGINE_BUDDY && !_numaArenas && _mappedHeap == EMPTY_ADDRESS &&
+            getArenaFreestore(_arenas[0]) != EMPTY_ADDRESS && lifetimeHeapIndex() <= _arenas[0]->freestoreRange) ? true : false;
+}
+
+/*
+    Takes a block from the main arena and lays a new sub-heap of the lifetime over it. The caller holds the main
+    arena's lock, and _arena is the main arena again on return. Returns EMPTY_ADDRESS if there's no block left.
+ */
+Arena* createLifetimeHeap(unsigned int lifetime)
+{
+    unsigned int count = _lifetimeHeapCounts[lifetime];
+    Arena* mainArena = _arenas[0];
+    
+    if(count == LIFETIME_MAX_HEAPS){
+        return EMPTY_ADDRESS;
+    }
+    
+    _arena = mainArena;
+    
+    unsigned int blockSize = getSizeForAdjustedFreestoreIndex(lifetimeHeapIndex());
+    MemoryHeader* header = allocateHeaderForSize(blockSize - _arena->headerSize);
+    
+    if(header == EMPTY_ADDRESS){
+        return EMPTY_ADDRESS;
+    }
+    
+    Addr memory = recordHeaderAllocation(header, blockSize - _arena->headerSize);
+    
+    //Pointers only ever trade places among the slots used so far, so the storage behind a new one is free.
+    if(_lifetimeHeaps[lifetime][count] == EMPTY_ADDRESS){
+        _lifetimeHeaps[lifetime][count] = &_lifetimeArenaStorage[lifetime][count];
+    }
+    
+    Arena* heap = _lifetimeHeaps[lifetime][count];
+    memset(heap, 0, sizeof(Arena));
+    
+    //Short of two smallest blocks, the memory splits into blocks of every order below the one it came from, with nothing left over.
+    _arena = heap;
+    unsigned int length = initArenaWithMemory(mainArena->basicBlockSize, blockSize - 2 * mainArena->minFreestoreIndexMemorySize, memory);
+    _arena = mainArena;
+    
+    if(length == 0)
+    {
+        deallocateInArena(memory);
+        return EMPTY_ADDRESS;
+    }
+    
+    _lifetimeHeapCounts[lifetime] += 1;
+    _lifetimeHeapTotal += 1;
+    
+    return heap;
+}
+
+/*
+    Returns the memory of an empty sub-heap to the main arena. The caller holds the main arena's lock.
+ */
+void releaseLifetimeHeap(unsigned int lifetime, unsigned int slot)
+{
+    Arena* heap = _lifetimeHeaps[lifetime][slot];
+    unsigned int last = _lifetimeHeapCounts[lifetime] - 1;
+    
+    //The last one used moves into the slot, the released one past the used ones.
+    _lifetimeHeaps[lifetime][slot] = _lifetimeHeaps[lifetime][last];
+    _lifetimeHeaps[lifetime][last] = heap;
+    _lifetimeHeapCounts[lifetime] -= 1;
+    _lifetimeHeapTotal -= 1;
+    
+    _arena = _arenas[0];
+    deallocateInArena(getArenaFreestore(heap));
+    setArenaFreestore(heap, EMPTY_ADDRESS);
+}
+
+/*
+    Returns every empty sub-heap to the main arena, the last of each lifetime included. The caller holds the
+    main arena's lock. Returns whether there were any.
+ */
+bool releaseEmptyLifetimeHeaps(void)
+{
+    bool released = false;
+    
+    for(unsigned int i = 0; i < LIFETIME_CLASSES; i++)
+    {
+        //Releasing moves the last sub-heap into the slot, so going down only ever moves one that was already looked at.
+        for(unsigned int j = _lifetimeHeapCounts[i]; j > 0; j--)
+        {
+            if(_lifetimeHeaps[i][j - 1]->allocatedBlocks == 0)
+            {
+                releaseLifetimeHeap(i, j - 1);
+                released = true;
+            }
+        }
+    }
+    
+    return released;
+}
+
+bool isLifetimeHeap(Arena* arena)
+{
+    return (arena >= &_lifetimeArenaStorage[0][0] && arena < &_lifetimeArenaStorage[LIFETIME_CLASSES][0]) ? true : false;
+}
+
+/*
+    Returns the sub-heap the address lies in, and where it's kept, or EMPTY_ADDRESS if it's in none.
+ */
+Arena* lifetimeHeapForAddress(Addr memoryAddress, unsigned int* lifetime, unsigned int* slot)
+{
+    for(unsigned int i = 0; i < LIFETIME_CLASSES; i++)
+    {
+        for(unsigned int j = 0; j < _lifetimeHeapCounts[i]; j++)
+        {
+            Arena* heap = _lifetimeHeaps[i][j];
+            Addr startAddress = getArenaFreestore(heap);
+            
+            if(memoryAddress >= startAddress && memoryAddress < (startAddress + heap->length))
+            {
+                *lifetime = i;
+                *slot = j;
+                return heap;
+            }
+        }
+    }
+    
+    return EMPTY_ADDRESS;
+}
+
+/*
+    Allocates from the sub-heaps of the lifetime, oldest first so they stay packed, and makes another one when
+    they are all full. The caller holds the main arena's lock, and _arena is the main arena again on return.
+    Returns EMPTY_ADDRESS, without counting a failure, when the lifetime can't serve the request.
+ */
+Addr allocateInLifetimeHeaps(unsigned int lifetime, unsigned int length)
+{
+    Addr address = EMPTY_ADDRESS;
+    
+    for(unsigned int i = 0; address == EMPTY_ADDRESS && i <= _lifetimeHeapCounts[lifetime]; i++)
+    {
+        Arena* heap = (i < _lifetimeHeapCounts[lifetime]) ? _lifetimeHeaps[lifetime][i] : createLifetimeHeap(lifetime);
+        
+        if(heap == EMPTY_ADDRESS){
+            break;
+        }
+        
+        _arena = heap;
+        MemoryHeader* header = allocateHeaderForSize(length);
+        
+        if(header != EMPTY_ADDRESS){
+            address = recordHeaderAllocation(header, length);
+        }
+    }
+    
+    _arena = _arenas[0];
+    
+    return address;
+}
+
+/*
+    Frees the address if it lies in a sub-heap, and lets the sub-heap go if that emptied it. Returns -1 if the
+    address is in no sub-heap, and otherwise 0 if everything ok, and 1 if it wasn't an allocation. The caller
+    holds the main arena's lock.
+ */
+int deallocateInLifetimeHeap(Addr memoryAddress)
+{
+    unsigned int lifetime, slot;
+    Arena* heap = lifetimeHeapForAddress(memoryAddress, &lifetime, &slot);
+    
+    if(heap == EMPTY_ADDRESS){
+        return -1;
+    }
+    
+    _arena = heap;
+    bool success = deallocateInArena(memoryAddress);
+    
+    if(success && heap->allocatedBlocks == 0 && _lifetimeHeapCounts[lifetime] > 1)
+    {
+        releaseLifetimeHeap(lifetime, slot);
+    }
+    
+    _arena = _arenas[0];
+    
+    return (success == true) ? 0 : 1;
+}
+
+/*
+    Adds the sub-heaps to the stats of the main arena. The caller holds the main arena's lock.
+ */
+void collectLifetimeStats(AllocatorStats* stats)
+{
+    stats->lifetimeHeaps = _lifetimeHeapTotal;
+    stats->lifetimeBytes = (_lifetimeHeapTotal > 0) ? (unsigned long)_lifetimeHeapTotal * getSizeForAdjustedFreestoreIndex(lifetimeHeapIndex()) : 0;
+    stats->lifetimeBlocks = 0;
+    
+    for(unsigned int i = 0; i < LIFETIME_CLASSES; i++)
+    {
+        for(unsigned int j = 0; j < _lifetimeHeapCounts[i]; j++)
+        {
+            stats->lifetimeBlocks += _lifetimeHeaps[i][j]->allocatedBlocks;
+        }
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/* HANDLES */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Memory reached through a handle may be moved while it isn't locked. A buddy block only merges once both its
+    halves are free, so a single live block in a pair keeps the pair's memory from ever coming back whole.
+    Compaction slides handle blocks down into the lowest free blocks of their size, filling the holes at the
+    bottom of the memory, so the pairs they leave behind at the top empty out and merge.
+ 
+    Handle memory comes straight from the main arena's freestore, never from a slab, so each one is a block
+    with a header at its start. Everything here happens under the main arena's lock.
+ */
+
+HandleEntry* entryForHandle(Handle handle)
+{
+    if(handle == 0 || handle > _handleCapacity || _handles[handle - 1].address == EMPTY_ADDRESS)
+    {
+        return EMPTY_ADDRESS;
+    }
+    
+    return &_handles[handle - 1];
+}
+
+/*
+    Takes a free entry for the address, growing the table when there is none. Returns 0 if it can't grow.
+ */
+Handle createHandle(Addr address, bool movable)
+{
+    if(_handleFree == 0)
+    {
+        unsigned int capacity = _handleCapacity + HANDLE_TABLE_GROWTH;
+        HandleEntry* handles = realloc(_handles, capacity * sizeof(HandleEntry));
+        
+        if(handles == EMPTY_ADDRESS){
+            return 0;
+        }
+        
+        //New entries are chained in order, so handles are handed out from the low ones up.
+        for(unsigned int i = _handleCapacity; i < capacity; i++)
+        {
+            handles[i].address = EMPTY_ADDRESS;
+            handles[i].lockCount = 0;
+            handles[i].nextFree = (i + 1 < capacity) ? (i + 2) : 0;
+            handles[i].movable = false;
+        }
+        
+        _handleFree = _handleCapacity + 1;
+        _handles = handles;
+        _handleCapacity = capacity;
+    }
+    
+    Handle handle = _handleFree;
+    HandleEntry* entry = &_handles[handle - 1];
+    
+    _handleFree = entry->nextFree;
+    _handleCount += 1;
+    
+    entry->address = address;
+    entry->lockCount = 0;
+    entry->nextFree = 0;
+    entry->movable = movable;
+    
+    return handle;
+}
+
+/*
+    Sorts the free blocks of the index by address, lowest first, so compaction always has the lowest one at hand.
+ 
+    Blocks freed by my_free go in right behind the first, so the order only holds until the next round sorts again.
+ */
+void sortFreestoreAtAdjustedIndex(unsigned int index)
+{
+    FreestoreBlock* chain = sortFreestoreChain(detachFreestoreChainAtAdjustedIndex(index));
+    FreestoreBlock* firstBlock = getFirstFreestoreBlockAtAdjustedIndex(index);
+    
+    if(chain != EMPTY_ADDRESS)
+    {
+        //The first block lives in the freestore array, the rest stay chained through their own headers.
+        firstBlock->address = chain->address;
+        firstBlock->nextBlock = chain->nextBlock;
+        
+        chain->address = EMPTY_OFFSET;
+        chain->nextBlock = EMPTY_OFFSET;
+    }
+}
+
+/*
+    Moves the block of an unlocked handle down into the lowest free block of its index or above, splitting that
+    one if it's larger. Its own buddy doesn't count, nor does anything above the block. Returns true if it moved.
+ 
+    Blocks only ever move down, so compaction ends, and the top of the memory empties out into whole blocks.
+    The moved block keeps its index and length, so none of the arena's counters change. The block it leaves
+    merges with its buddy, lazy coalescing or not, and goes in last, above the lower blocks still to be taken.
+ */
+bool moveHandleBlock(HandleEntry* entry)
+{
+    MemoryHeader* header = memoryHeaderForAddress(entry->address);
+    
+    if(header == EMPTY_ADDRESS)
+    {
+        return false;
+    }
+    
+    unsigned int index = header->index;
+    unsigned int targetIndex = _arena->freestoreRange + 1;
+    Addr blockAddress = header;
+    Addr buddyAddress = getBuddyAddressForAdjustedIndex(index, blockAddress);
+    Addr targetAddress = blockAddress;
+    
+    for(unsigned int i = index; i <= _arena->freestoreRange; i++)
+    {
+        Addr address = addressForOffset(getFirstFreestoreBlockAtAdjustedIndex(i)->address);
+        
+        if(address != EMPTY_ADDRESS && address < targetAddress && !(i == index && address == buddyAddress))
+        {
+            targetAddress = address;
+            targetIndex = i;
+        }
+    }
+    
+    if(targetIndex > _arena->freestoreRange)
+    {
+        return false;
+    }
+    
+    //Commit the block moved into and the headers of the upper halves before anything is written, as a split does.
+    for(unsigned int i = index; _arena->reservedLength > 0 && i <= targetIndex; i++)
+    {
+        unsigned int length = (i == index) ? getSizeForAdjustedFreestoreIndex(index) : sizeof(FreestoreBlock);
+        Addr address = (i == index) ? targetAddress : (targetAddress + getSizeForAdjustedFreestoreIndex(i - 1));
+        
+        if(!commitArenaRange(address, length)){
+            return false;
+        }
+    }
+    
+    popFreestoreBlockAtAdjustedIndex(targetIndex);
+    
+    if(_arena->lazyCount[targetIndex] > 0)
+    {
+        _arena->lazyCount[targetIndex] -= 1;
+    }
+    
+    for(unsigned int i = targetIndex; i > index; i--)
+    {
+        addAddressToFreestoreForAdjustedIndex(i - 1, targetAddress + getSizeForAdjustedFreestoreIndex(i - 1));
+        _arena->splitCount += 1;
+    }
+    
+    MemoryHeader* movedHeader = targetAddress;
+    Addr movedAddress = (targetAddress + _arena->headerSize);
+    
+    movedHeader->index = index;
+    movedHeader->length = header->length;
+    movedHeader->memoryStart = offsetForAddress(movedAddress);
+    memcpy(movedAddress, entry->address, header->length);
+    
+    clearAllocationAtAddress(entry->address);
+    markAllocationAtAddress(movedAddress);
+    
+    header->memoryStart = EMPTY_OFFSET;
+    header->index = EMPTY_VALUE;
+    header->length = EMPTY_VALUE;
+    
+    unsigned int mergedIndex = index;
+    Addr mergedAddress = mergeFreestoreBlockAtAdjustedIndex(&mergedIndex, blockAddress);
+    appendAddressToFreestoreForAdjustedIndex(mergedIndex, mergedAddress);
+    
+    entry->address = movedAddress;
+    _handleMoves += 1;
+    
+    return true;
+}
+
+/*
+    Visits handles from where the last slice stopped, moving what it can until the time is up. Each round over
+    the table starts by sorting the free blocks. The caller holds the main arena's lock.
+    Returns false once a whole round moved nothing, and true while there may be more to move.
+ */
+bool compactHandles(unsigned int microseconds)
+{
+    struct timespec start, now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    for(unsigned int visited = 0; visited < _handleCapacity; visited++)
+    {
+        if(_handleCursor == 0)
+        {
+            if(visited > 0 && _roundMoves == 0){
+                return false;
+            }
+            
+            for(unsigned int i = 0; i <= _arena->freestoreRange; i++)
+            {
+                sortFreestoreAtAdjustedIndex(i);
+            }
+            
+            _roundMoves = 0;
+        }
+        
+        //From the last entry down: handles are handed out from the low ones up, and so mostly are their blocks,
+        //so the highest blocks get the lowest free ones, and each block only has to move once.
+        HandleEntry* entry = &_handles[_handleCapacity - 1 - _handleCursor];
+        _handleCursor = (_handleCursor + 1) % _handleCapacity;
+        
+        bool moved = (entry->address != EMPTY_ADDRESS && entry->movable && entry->lockCount == 0 && moveHandleBlock(entry)) ? true : false;
+        
+        if(moved){
+            _roundMoves += 1;
+        }
+        
+        //A move walks free lists, so the clock is read after each one, and otherwise only now and then.
+        if(moved || ((visited + 1) % COMPACTION_CHECK_INTERVAL) == 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            
+            long elapsed = ((now.tv_sec - start.tv_sec) * 1000000L) + ((now.tv_nsec - start.tv_nsec) / 1000L);
+            
+            if(elapsed >= (long)microseconds){
+                return true;
+            }
+        }
+    }
+    
+    //A round that ends right where the slice started only counts if it started there too.
+    return (_handleCursor != 0 || _roundMoves > 0) ? true : false;
+}
+
+/*
+    Forgets every handle. Their memory goes with the arena it came from.
+ */
+void releaseHandles(void)
+{
+    free(_handles);
+    
+    _handles = EMPTY_ADDRESS;
+    _handleCapacity = 0;
+    _handleCount = 0;
+    _handleFree = 0;
+    _handleCursor = 0;
+    _handleMoves = 0;
+    _roundMoves = 0;
+    _compactionPending = false;
+}
+
+/*--------------------------------------------------------------------------*/
+/* WAITING ALLOCATIONS */
+/*--------------------------------------------------------------------------*/
+
+/*
+    With waiting on, an allocation the main arena can't serve yet waits for room instead of failing. Blocking
+    callers park on a condition of the index they need, and callbacks queue there in order. Whenever memory
+    comes back, the thread that freed it serves the queued callbacks that now fit and wakes the parked threads
+    whose index, or one above, has a free block; those try again for themselves.
+ 
+    Everything is kept under the main arena's lock, which waiting turns on if nothing else did.
+ */
+
+/*
+    Turns waiting off: pending callbacks get 0, and parked threads wake up and return 0.
+ */
+void stopWaiting(void)
+{
+    if(_waitingEnabled == false)
+    {
+        return;
+    }
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    
+    _waitingEnabled = false;
+    WaitRequest* ready = EMPTY_ADDRESS;
+    
+    for(unsigned int i = 0; i < MAX_ALLOCATOR_ORDERS; i++)
+    {
+        //Callbacks are run in the order they were queued.
+        while(_pendingRequests[i] != EMPTY_ADDRESS)
+        {
+            WaitRequest* request = _pendingRequests[i];
+            _pendingRequests[i] = request->next;
+            
+            request->address = EMPTY_ADDRESS;
+            request->next = ready;
+            ready = request;
+        }
+        
+        _pendingTails[i] = EMPTY_ADDRESS;
+        pthread_cond_broadcast(&_waitQueues[i]);
+    }
+    
+    //The conditions can't go before every parked thread has left them.
+    bool parked = true;
+    
+    while(parked)
+    {
+        parked = false;
+        
+        for(unsigned int i = 0; i < MAX_ALLOCATOR_ORDERS; i++)
+        {
+            parked = (_parkedThreads[i] > 0) ? true : parked;
+        }
+        
+        if(parked)
+        {
+            unlockArena();
+            sched_yield();
+            lockArena();
+        }
+    }
+    
+    _waitingCount = 0;
+    unlockArena();
+    
+    for(unsigned int i = 0; i < MAX_ALLOCATOR_ORDERS; i++)
+    {
+        pthread_cond_destroy(&_waitQueues[i]);
+    }
+    
+    //Reversed above, so the oldest is first again.
+    WaitRequest* ordered = EMPTY_ADDRESS;
+    
+    while(ready != EMPTY_ADDRESS)
+    {
+        WaitRequest* next = ready->next;
+        ready->next = ordered;
+        ordered = ready;
+        ready = next;
+    }
+    
+    completeWaitingAllocations(ordered);
+    
+    if(_waitingLockedArenas)
+    {
+        //A maintenance thread that still runs keeps the lock, and drops it when it stops.
+        if(_maintenanceInterval > 0)
+        {
+            _maintenanceLockedArenas = false;
+        } else {
+            _lockedArenas = false;
+            pthread_mutex_destroy(&_arenas[0]->lock);
+        }
+    }
+    
+    _waitingLockedArenas = false;
+}
+
+/*
+    Returns the highest index with a free block, or one past the range if there is none.
+ */
+unsigned int highestFreeAdjustedIndex(void)
+{
+    for(unsigned int i = _arena->freestoreRange + 1; i-- > 0;)
+    {
+        if(containsFreeSpaceAtAdjustedIndex(i))
+        {
+            return i;
+        }
+    }
+    
+    return _arena->freestoreRange + 1;
+}
+
+/*
+    Allocates a header block for a waiting request, or returns EMPTY_ADDRESS without counting a failure.
+    Waiting is expected to find the arena full, so nothing is printed either.
+ */
+Addr allocateWaitingRequest(unsigned int length)
+{
+    MemoryHeader* header = allocateHeaderForSize(length);
+    
+    return (header != EMPTY_ADDRESS) ? recordHeaderAllocation(header, length) : EMPTY_ADDRESS;
+}
+
+/*
+    Serves the queued callbacks that fit now, and wakes the parked threads that may. The caller holds the main
+    arena's lock, and runs the returned callbacks with completeWaitingAllocations once it let go of it.
+ */
+WaitRequest* serveWaitingAllocations(void)
+{
+    WaitRequest* ready = EMPTY_ADDRESS;
+    WaitRequest* readyTail = EMPTY_ADDRESS;
+    
+    if(_waitingCount == 0)
+    {
+        return EMPTY_ADDRESS;
+    }
+    
+    //Parked blocks have to merge before anything waiting can tell whether it fits.
+    if(_arena->lazyThreshold > 0 || _maintenanceInterval > 0)
+    {
+        coalesceFreestore();
+    }
+    
+    unsigned int highestIndex = highestFreeAdjustedIndex();
+    
+    for(unsigned int i = 0; i <= highestIndex && i <= _arena->freestoreRange; i++)
+    {
+        while(_pendingRequests[i] != EMPTY_ADDRESS)
+        {
+            WaitRequest* request = _pendingRequests[i];
+            Addr address = allocateWaitingRequest(request->length);
+            
+            if(address == EMPTY_ADDRESS){
+                break;
+            }
+            
+            _pendingRequests[i] = request->next;
+            _pendingTails[i] = (_pendingRequests[i] != EMPTY_ADDRESS) ? _pendingTails[i] : EMPTY_ADDRESS;
+            _waitingCount -= 1;
+            _waitedCount += 1;
+            
+            request->address = address;
+            request->next = EMPTY_ADDRESS;
+            
+            if(readyTail != EMPTY_ADDRESS){
+                readyTail->next = request;
+            } else {
+                ready = request;
+            }
+            
+            readyTail = request;
+        }
+        
+        if(_parkedThreads[i] > 0 && getFirstFreeAdjustedIndexFromAdjustedIndex(i) <= _arena->freestoreRange)
+        {
+            pthread_cond_broadcast(&_waitQueues[i]);
+        }
+    }
+    
+    return ready;
+}
+
+/*
+    Runs the callbacks of served requests, in order, and lets go of them. Called without any arena lock held,
+    so the callbacks may allocate and free as they like.
+ */
+void completeWaitingAllocations(WaitRequest* ready)
+{
+    while(ready != EMPTY_ADDRESS)
+    {
+        WaitRequest* next = ready->next;
+        
+        ready->callback(ready->address, ready->context);
+        free(ready);
+        
+        ready = next;
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/* I/O BUFFERS */
+/*--------------------------------------------------------------------------*/
+
+/*
+    I/O buffers are plain buddy blocks of the main arena, from 4 KiB to 1 MiB, handed out whole with no header
+    in front. Blocks start at a multiple of their size from the start of the memory, so with a page aligned
+    arena and a power of two basic block size every buffer starts on a page.
+ 
+    With no header, the order of each live buffer is kept in a side map with an entry per 4 KiB of the arena.
+    Freed buffers first go to a small cache of their order, so a steady stream of reads of one size never
+    splits or merges anything. The cache is emptied into the freestore whenever the arena runs out.
+ 
+    Everything here runs under the main arena's lock.
+ */
+
+/*
+    Returns whether the main arena can hold I/O buffers, setting up the side map the first time it can.
+ */
+bool ioBuffersAvailable(void)
+{
+    if(_ioBufferOrders != EMPTY_ADDRESS)
+    {
+        return true;
+    }
+    
+    //A mapped heap outlives the side map, and only the C buddy engine has a freestore to take blocks from.
+    if(_engine != ALLOCATOR_ENGINE_BUDDY || _numaArenas || _mappedHeap != EMPTY_ADDRESS || getArenaFreestore(_arena) == EMPTY_ADDRESS)
+    {
+        return false;
+    }
+    
+    unsigned long start = (unsigned long)getArenaFreestore(_arena);
+    unsigned int minIndex = getAdjustedFreestoreIndexForSize(IO_BUFFER_MIN_SIZE);
+    
+    if((start % IO_BUFFER_MIN_SIZE) != 0 || getSizeForAdjustedFreestoreIndex(minIndex) != IO_BUFFER_MIN_SIZE || minIndex > _arena->freestoreRange)
+    {
+        return false;
+    }
+    
+    _ioBufferSlots = (_arena->length / IO_BUFFER_MIN_SIZE) + 1;
+    _ioBufferOrders = calloc(_ioBufferSlots, sizeof(unsigned char));
+    
+    return (_ioBufferOrders != EMPTY_ADDRESS) ? true : false;
+}
+
+/*
+    Returns the order of the smallest buffer that holds the length, or IO_BUFFER_ORDERS if none does.
+ */
+unsigned int ioBufferOrderForLength(unsigned int length)
+{
+    unsigned int order = 0;
+    
+    while(order < IO_BUFFER_ORDERS && (IO_BUFFER_MIN_SIZE << order) < length)
+    {
+        order++;
+    }
+    
+    return order;
+}
+
+unsigned int ioBufferIndexForOrder(unsigned int order)
+{
+    return getAdjustedFreestoreIndexForSize(IO_BUFFER_MIN_SIZE << order);
+}
+
+unsigned int ioBufferCacheDepth(unsigned int order)
+{
+    return maxValue(IO_BUFFER_CACHE_DEPTH >> order, 1);
+}
+
+/*
+    Returns the side map entry of the page at the address, or _ioBufferSlots if it isn't the start of a page of the arena.
+ */
+unsigned long ioBufferSlotForAddress(Addr memoryAddress)
+{
+    Addr startAddress = getArenaFreestore(_arena);
+    
+    if(memoryAddress < startAddress || memoryAddress >= (startAddress + _arena->length) || ((memoryAddress - startAddress) % IO_BUFFER_MIN_SIZE) != 0)
+    {
+        return _ioBufferSlots;
+    }
+    
+    return (unsigned long)(memoryAddress - startAddress) / IO_BUFFER_MIN_SIZE;
+}
+
+/*
+    Gives every cached buffer back to the freestore. Returns whether there were any.
+ */
+bool flushIoBufferCache(void)
+{
+    bool flushed = false;
+    
+    for(unsigned int order = 0; order < IO_BUFFER_ORDERS; order++)
+    {
+        unsigned int index = ioBufferIndexForOrder(order);
+        
+        while(_ioBufferCached[order] > 0)
+        {
+            _ioBufferCached[order] -= 1;
+            returnFreestoreBlockAtAdjustedIndex(index, _ioBufferCache[order][_ioBufferCached[order]]);
+            flushed = true;
+        }
+    }
+    
+    return flushed;
+}
+
+/*
+    Hands out a buffer of the order, from the cache if it has one, and from the freestore otherwise.
+    Returns EMPTY_ADDRESS when neither has room, without printing anything.
+ */
+Addr allocateIoBuffer(unsigned int order)
+{
+    unsigned int index = ioBufferIndexForOrder(order);
+    Addr address = EMPTY_ADDRESS;
+    
+    if(index > _arena->freestoreRange)
+    {
+        _arena->failedCount += 1;
+        return EMPTY_ADDRESS;
+    }
+    
+    if(_ioBufferCached[order] > 0)
+    {
+        _ioBufferCached[order] -= 1;
+        address = _ioBufferCache[order][_ioBufferCached[order]];
+    } else {
+        if(_maintenanceInterval > 0){
+            _arena->demandCount[index] += 1;
+        }
+        
+        address = takeFreestoreBlockAtAdjustedIndex(index);
+    }
+    
+    if(address == EMPTY_ADDRESS)
+    {
+        _arena->failedCount += 1;
+        return EMPTY_ADDRESS;
+    }
+    
+    unsigned int size = (IO_BUFFER_MIN_SIZE << order);
+    
+    _ioBufferOrders[ioBufferSlotForAddress(address)] = order + 1;
+    _ioBufferCount += 1;
+    _ioBufferBytes += size;
+    
+    _arena->allocatedBlocks += 1;
+    _arena->allocatedBytes += size;
+    _arena->mallocCount += 1;
+    
+    return address;
+}
+
+/*
+    Takes back the buffer at the address, into the cache of its order while it has room.
+    Returns false if the address isn't the start of a live buffer.
+ */
+bool deallocateIoBuffer(Addr memoryAddress)
+{
+    unsigned long slot = ioBufferSlotForAddress(memoryAddress);
+    
+    if(_ioBufferOrders == EMPTY_ADDRESS || slot >= _ioBufferSlots || _ioBufferOrders[slot] == 0)
+    {
+        return false;
+    }
+    
+    unsigned int order = _ioBufferOrders[slot] - 1;
+    unsigned int size = (IO_BUFFER_MIN_SIZE << order);
+    
+    _ioBufferOrders[slot] = 0;
+    _ioBufferCount -= 1;
+    _ioBufferBytes -= size;
+    
+    _arena->allocatedBlocks -= 1;
+    _arena->allocatedBytes -= size;
+    _arena->freeCount += 1;
+    
+    //Others waiting for memory would never see a cached buffer, so it goes straight back while they wait.
+    if(_ioBufferCached[order] < ioBufferCacheDepth(order) && _waitingCount == 0)
+    {
+        _ioBufferCache[order][_ioBufferCached[order]] = memoryAddress;
+        _ioBufferCached[order] += 1;
+    } else {
+        returnFreestoreBlockAtAdjustedIndex(ioBufferIndexForOrder(order), memoryAddress);
+    }
+    
+    return true;
+}
+
+/*
+    Forgets every buffer, along with the side map. Their memory goes with the arena.
+ */
+void releaseIoBuffers(void)
+{
+    free(_ioBufferOrders);
+    _ioBufferOrders = EMPTY_ADDRESS;
+    _ioBufferSlots = 0;
+    _ioBufferCount = 0;
+    _ioBufferBytes = 0;
+    
+    for(unsigned int order = 0; order < IO_BUFFER_ORDERS; order++)
+    {
+        _ioBufferCached[order] = 0;
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/* LARGE ALLOCATIONS */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Requests past the threshold skip the arenas and get a mapping of their own, see large_allocations.h.
+    They can be larger than any arena, and never take a top order block away from the small requests.
+    my_free looks pointers up among them only when they lie outside every arena.
+ */
+
+/*
+    Returns the most bytes one allocation from the arenas can hold, or 0 before the allocator is initialized.
+ */
+unsigned long largestArenaRequest(void)
+{
+    _arena = _arenas[0];     //Orders are the same in every arena.
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY)
+    {
+        const EngineOps* ops = &_engineTable[_engine];
+        
+        if(_engineMemory == EMPTY_ADDRESS){
+            return 0;
+        }
+        
+        //Without orders, one request can take the whole memory.
+        if(ops->orderCount == NULL){
+            return _arena->length;
+        }
+        
+        unsigned int orderCount = ops->orderCount();
+        return (orderCount > 0) ? (ops->orderSize(orderCount - 1) - _arena->headerSize) : 0;
+    }
+    
+    if(getArenaFreestore(_arena) == EMPTY_ADDRESS){
+        return 0;
+    }
+    
+    return getSizeForAdjustedFreestoreIndex(_arena->freestoreRange) - _arena->headerSize;
+}
+
+bool isLargeRequest(unsigned int length)
+{
+    unsigned long largestRequest = largestArenaRequest();
+    
+    //A mapped heap's memory has to stay in its file, and an allocator that isn't initialized fails as it always did.
+    if(_mappedHeap != EMPTY_ADDRESS || largestRequest == 0){
+        return false;
+    }
+    
+    if(_largeThreshold > 0){
+        return (length >= _largeThreshold) ? true : false;
+    }
+    
+    return (length > largestRequest) ? true : false;
+}
+
+/*
+    Maps a large allocation, counting its failure against the first arena. An alignment of 0 allocates unaligned.
+ */
+Addr allocateLarge(unsigned int length, unsigned int alignment)
+{
+    Addr address = large_malloc(length, alignment);
+    
+    if(address == EMPTY_ADDRESS)
+    {
+        __atomic_add_fetch(&_arenas[0]->failedCount, 1, __ATOMIC_RELAXED);
+        printf("ERROR> Allocation Failure: Could not deliver size(%d) for request. \n",length);
+    }
+    
+    return address;
+}
+
+/*--------------------------------------------------------------------------*/
+/* PUBLIC FUNCTIONS FOR MODULE MY_ALLOCATOR */
+/*--------------------------------------------------------------------------*/
+
+extern Addr my_malloc(unsigned int length) {
+    
+    Addr address = EMPTY_ADDRESS;
+    
+    if(isLargeRequest(length))
+    {
+        address = allocateLarge(length, 0);
+    } else if(_numaArenas)
+    {
+        address = allocateInNodeArena(length, 0);
+    } else {
+        _arena = _arenas[0];
+        address = allocateInLockedArena(length, 0);
+    }
+    
+    if(_heapSampling)
+    {
+        heap_profiler_malloc(address, length);
+    }
+    
+    return address;
+}
+
+extern Addr my_malloc_aligned(unsigned int length, unsigned int alignment) {
+    
+    if(_numaArenas == false)
+    {
+        _arena = _arenas[0];
+    }
+    
+    //Only powers of two make sense as an alignment. No arena lock is held here, so the count is added atomically.
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        __atomic_add_fetch(&_arenas[0]->failedCount, 1, __ATOMIC_RELAXED);
+        return EMPTY_ADDRESS;
+    }
+    
+    Addr address = EMPTY_ADDRESS;
+    
+    if(isLargeRequest(length))
+    {
+        address = allocateLarge(length, alignment);
+    } else {
+        address = (_numaArenas) ? allocateInNodeArena(length, alignment) : allocateInLockedArena(length, alignment);
+    }
+    
+    if(_heapSampling)
+    {
+        heap_profiler_malloc(address, length);
+    }
+    
+    return address;
+}
+
+extern Addr my_malloc_hint(unsigned int length, unsigned int flags) {
+    
+    unsigned int lifetime = lifetimeForFlags(flags);
+    
+    //Without a sub-heap to go to, a hint is only a my_malloc.
+    if(lifetime == LIFETIME_NONE || isLargeRequest(length) || !lifetimeHeapsAvailable())
+    {
+        return my_malloc(length);
+    }
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    Addr address = allocateInLifetimeHeaps(lifetime, length);
+    
+    //Too large for a sub-heap, or none left to make: the main arena serves it.
+    if(address == EMPTY_ADDRESS){
+        address = allocateInArena(length);
+    }
+    
+    unlockArena();
+    
+    if(_heapSampling)
+    {
+        heap_profiler_malloc(address, length);
+    }
+    
+    return address;
+}
+
+extern Addr my_malloc_wait(unsigned int length, unsigned int timeout) {
+    
+    if(!_waitingEnabled || isLargeRequest(length))
+    {
+        return my_malloc(length);
+    }
+    
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    
+    unsigned long nanoseconds = (unsigned long)deadline.tv_nsec + ((unsigned long)timeout * 1000);
+    deadline.tv_sec += (nanoseconds / 1000000000);
+    deadline.tv_nsec = (nanoseconds % 1000000000);
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    
+    unsigned int index = getAdjustedFreestoreIndexForSize(length + _arena->headerSize);
+    Addr address = allocateWaitingRequest(length);
+    bool waiting = (address == EMPTY_ADDRESS && timeout > 0 && index <= _arena->freestoreRange) ? true : false;
+    
+    while(waiting)
+    {
+        _parkedThreads[index] += 1;
+        _waitingCount += 1;
+        
+        int result = (timeout == ALLOCATOR_WAIT_FOREVER) ? pthread_cond_wait(&_waitQueues[index], &_arena->lock) :
+                                                           pthread_cond_timedwait(&_waitQueues[index], &_arena->lock, &deadline);
+        
+        _parkedThreads[index] -= 1;
+        _waitingCount -= 1;
+        
+        if(!_waitingEnabled){
+            break;
+        }
+        
+        address = allocateWaitingRequest(length);
+        
+        if(address != EMPTY_ADDRESS){
+            _waitedCount += 1;
+        }
+        
+        waiting = (address == EMPTY_ADDRESS && result != ETIMEDOUT) ? true : false;
+    }
+    
+    if(address == EMPTY_ADDRESS){
+        _arena->failedCount += 1;
+    }
+    
+    unlockArena();
+    
+    if(_heapSampling)
+    {
+        heap_profiler_malloc(address, length);
+    }
+    
+    return address;
+}
+
+extern int my_malloc_async(unsigned int length, AllocationCallback callback, void* context) {
+    
+    if(callback == EMPTY_ADDRESS){
+        return 1;
+    }
+    
+    if(!_waitingEnabled || isLargeRequest(length))
+    {
+        callback(my_malloc(length), context);
+        return 0;
+    }
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    
+    unsigned int index = getAdjustedFreestoreIndexForSize(length + _arena->headerSize);
+    Addr address = allocateWaitingRequest(length);
+    
+    if(address != EMPTY_ADDRESS || index > _arena->freestoreRange)
+    {
+        _arena->failedCount += (address == EMPTY_ADDRESS) ? 1 : 0;
+        unlockArena();
+        
+        if(address == EMPTY_ADDRESS){
+            return 1;
+        }
+        
+        callback(address, context);
+        return 0;
+    }
+    
+    WaitRequest* request = malloc(sizeof(WaitRequest));
+    
+    if(request == EMPTY_ADDRESS)
+    {
+        unlockArena();
+        return 1;
+    }
+    
+    request->length = length;
+    request->callback = callback;
+    request->context = context;
+    request->address = EMPTY_ADDRESS;
+    request->next = EMPTY_ADDRESS;
+    
+    if(_pendingTails[index] != EMPTY_ADDRESS){
+        _pendingTails[index]->next = request;
+    } else {
+        _pendingRequests[index] = request;
+    }
+    
+    _pendingTails[index] = request;
+    _waitingCount += 1;
+    
+    unlockArena();
+    
+    return 0;
+}
+
+extern Handle my_halloc(unsigned int length) {
+    
+    //Only blocks of the one buddy arena can be moved. Anything else is held by a handle that stays put.
+    bool movable = (_engine == ALLOCATOR_ENGINE_BUDDY && !_numaArenas && !isLargeRequest(length) &&
+                    getArenaFreestore(_arenas[0]) != EMPTY_ADDRESS) ? true : false;
+    Addr address = EMPTY_ADDRESS;
+    
+    if(!movable)
+    {
+        address = my_malloc(length);
+        
+        if(address == EMPTY_ADDRESS){
+            return 0;
+        }
+    }
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    
+    if(movable){
+        address = recordHeaderAllocation(allocateHeaderForSize(length), length);
+    }
+    
+    Handle handle = (address != EMPTY_ADDRESS) ? createHandle(address, movable) : 0;
+    
+    if(handle == 0 && address != EMPTY_ADDRESS && movable){
+        deallocateInArena(address);
+    }
+    
+    unlockArena();
+    
+    if(handle == 0 && address != EMPTY_ADDRESS && !movable){
+        my_free(address);
+    }
+    
+    return handle;
+}
+
+extern Addr my_hlock(Handle handle) {
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    
+    HandleEntry* entry = entryForHandle(handle);
+    Addr address = EMPTY_ADDRESS;
+    
+    if(entry != EMPTY_ADDRESS)
+    {
+        entry->lockCount += 1;
+        address = entry->address;
+    }
+    
+    unlockArena();
+    
+    return address;
+}
+
+extern int my_hunlock(Handle handle) {
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    
+    HandleEntry* entry = entryForHandle(handle);
+    int result = 1;
+    
+    if(entry != EMPTY_ADDRESS && entry->lockCount > 0)
+    {
+        entry->lockCount -= 1;
+        result = 0;
+    }
+    
+    unlockArena();
+    
+    return result;
+}
+
+extern int my_hfree(Handle handle) {
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    
+    HandleEntry* entry = entryForHandle(handle);
+    
+    if(entry == EMPTY_ADDRESS)
+    {
+        unlockArena();
+        return 1;
+    }
+    
+    Addr address = entry->address;
+    bool movable = entry->movable;
+    
+    entry->address = EMPTY_ADDRESS;
+    entry->lockCount = 0;
+    entry->nextFree = _handleFree;
+    _handleFree = handle;
+    _handleCount -= 1;
+    
+    WaitRequest* ready = EMPTY_ADDRESS;
+    
+    if(movable)
+    {
+        deallocateInArena(address);
+        ready = serveWaitingAllocations();
+    }
+    
+    unlockArena();
+    
+    completeWaitingAllocations(ready);
+    
+    return (movable) ? 0 : my_free(address);
+}
+
+extern int my_allocator_compact(unsigned int microseconds) {
+    
+    if(_handleCount == 0 || _engine != ALLOCATOR_ENGINE_BUDDY || _numaArenas)
+    {
+        return 0;
+    }
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    bool pending = compactHandles(microseconds);
+    WaitRequest* ready = serveWaitingAllocations();
+    unlockArena();
+    
+    completeWaitingAllocations(ready);
+    
+    return (pending) ? 1 : 0;
+}
+
+extern Addr my_iobuf_alloc(unsigned int length) {
+    
+    unsigned int order = ioBufferOrderForLength(length);
+    
+    if(order >= IO_BUFFER_ORDERS){
+        return EMPTY_ADDRESS;
+    }
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    Addr address = (ioBuffersAvailable()) ? allocateIoBuffer(order) : EMPTY_ADDRESS;
+    unlockArena();
+    
+    return address;
+}
+
+extern int my_iobuf_free(Addr address) {
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    bool success = deallocateIoBuffer(address);
+    WaitRequest* ready = (success) ? serveWaitingAllocations() : EMPTY_ADDRESS;
+    unlockArena();
+    
+    completeWaitingAllocations(ready);
+    
+    return (success == true) ? 0 : 1;
+}
+
+extern unsigned int my_iobuf_size(Addr address) {
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    unsigned long slot = (_ioBufferOrders != EMPTY_ADDRESS) ? ioBufferSlotForAddress(address) : _ioBufferSlots;
+    unsigned int order = (slot < _ioBufferSlots) ? _ioBufferOrders[slot] : 0;
+    unlockArena();
+    
+    return (order > 0) ? (IO_BUFFER_MIN_SIZE << (order - 1)) : 0;
+}
+
+extern unsigned int my_iobuf_vector(struct iovec* vector, unsigned int count, unsigned long length, unsigned int bufferLength) {
+    
+    unsigned int order = ioBufferOrderForLength(bufferLength);
+    
+    if(vector == EMPTY_ADDRESS || length == 0 || order >= IO_BUFFER_ORDERS){
+        return 0;
+    }
+    
+    unsigned long size = (IO_BUFFER_MIN_SIZE << order);
+    unsigned long needed = (length + size - 1) / size;
+    
+    if(needed > count){
+        return 0;
+    }
+    
+    _arena = _arenas[0];
+    
+    lockArena();
+    
+    unsigned int filled = 0;
+    
+    if(ioBuffersAvailable())
+    {
+        while(filled < needed)
+        {
+            Addr address = allocateIoBuffer(order);
+            
+            if(address == EMPTY_ADDRESS){
+                break;
+            }
+            
+            //The last buffer is only read into as far as the length goes.
+            vector[filled].iov_base = address;
+            vector[filled].iov_len = (filled + 1 < needed) ? size : length - (filled * size);
+            filled++;
+        }
     }
     
-    return address;
+    //All or nothing, so a short list never turns into a short read.
+    if(filled < needed)
+    {
+        while(filled > 0)
+        {
+            filled--;
+            deallocateIoBuffer(vector[filled].iov_base);
+        }
+    }
+    
+    unlockArena();
+    
+    return filled;
+}
+
+extern int my_iobuf_vector_free(struct iovec* vector, unsigned int count) {
+    
+    int result = 0;
+    
+    for(unsigned int i = 0; vector != EMPTY_ADDRESS && i < count; i++)
+    {
+        result |= my_iobuf_free(vector[i].iov_base);
+    }
+    
+    return result;
 }
 
 extern int my_free(Addr address) {
-    bool success = deallocateHeaderAtAddress(address);
+    bool success = false;
+    
+    if(large_count() > 0 && !isArenaAddress(address) && large_usable_size(address) > 0)
+    {
+        if(_heapSampling)
+        {
+            heap_profiler_free(address);
+        }
+        
+        return large_free(address);
+    }
+    
+    if(_lifetimeHeapTotal > 0 && !_numaArenas)
+    {
+        _arena = _arenas[0];
+        
+        lockArena();
+        int result = deallocateInLifetimeHeap(address);
+        WaitRequest* ready = (result == 0) ? serveWaitingAllocations() : EMPTY_ADDRESS;
+        unlockArena();
+        
+        completeWaitingAllocations(ready);
+        
+        if(result >= 0)
+        {
+            if(_heapSampling && result == 0)
+            {
+                heap_profiler_free(address);
+            }
+            
+            return result;
+        }
+    }
+    
+    //Memory goes back to the arena it came from, whichever node the caller is on now.
+    Arena* arena = (_numaArenas) ? arenaForAddress(address) : _arenas[0];
+    
+    if(arena == EMPTY_ADDRESS){
+        return 1;
+    }
+    
+    _arena = arena;
+    
+    if(_heapSampling)
+    {
+        heap_profiler_free(address);
+    }
+    
+    lockArena();
+    success = deallocateInArena(address);
+    WaitRequest* ready = (success && arena == _arenas[0]) ? serveWaitingAllocations() : EMPTY_ADDRESS;
+    unlockArena();
+    
+    completeWaitingAllocations(ready);
+    
     return (success == true) ? 0 : 1;
 }
 
+extern int my_allocator_stats(AllocatorStats* stats) {
+    
+    if(stats == 0x0){
+        return 1;
+    }
+    
+    if(!_numaArenas)
+    {
+        _arena = _arenas[0];
+        
+        lockArena();
+        int result = collectArenaStats(stats);
+        collectLifetimeStats(stats);
+        stats->handles = _handleCount;
+        stats->handleMoves = _handleMoves;
+        stats->waitingRequests = _waitingCount;
+        stats->waitedRequests = _waitedCount;
+        stats->ioBuffers = _ioBufferCount;
+        stats->ioBufferBytes = _ioBufferBytes;
+        stats->ioCachedBytes = 0;
+        
+        for(unsigned int order = 0; order < IO_BUFFER_ORDERS; order++)
+        {
+            stats->ioCachedBytes += (unsigned long)_ioBufferCached[order] * (IO_BUFFER_MIN_SIZE << order);
+        }
+        
+        unlockArena();
+        
+        stats->largeBlocks = large_count();
+        stats->largeBytes = large_bytes();
+        
+        return result;
+    }
+    
+    AllocatorStats arenaStats;
+    stats->arenaCount = 0;
+    
+    for(unsigned int i = 0; i < _arenaCount; i++)
+    {
+        _arena = _arenas[i];
+        
+        lockArena();
+        int result = collectArenaStats(&arenaStats);
+        unlockArena();
+        
+        if(result != 0){
+            return result;
+        }
+        
+        accumulateArenaStats(stats, &arenaStats);
+    }
+    
+    stats->lifetimeHeaps = 0;
+    stats->lifetimeBytes = 0;
+    stats->lifetimeBlocks = 0;
+    stats->handles = _handleCount;
+    stats->handleMoves = _handleMoves;
+    stats->waitingRequests = 0;
+    stats->waitedRequests = 0;
+    stats->ioBuffers = 0;
+    stats->ioBufferBytes = 0;
+    stats->ioCachedBytes = 0;
+    stats->largeBlocks = large_count();
+    stats->largeBytes = large_bytes();
+    
+    return 0;
+}
+
+extern Addr my_realloc(Addr address, unsigned int length) {
+    
+    if(address == EMPTY_ADDRESS){
+        return my_malloc(length);
+    }
+    
+    if(length == 0){
+        my_free(address);
+        return EMPTY_ADDRESS;
+    }
+    
+    //Large allocations stay mapped, and mremap grows them without copying a byte.
+    if(large_count() > 0 && !isArenaAddress(address) && large_usable_size(address) > 0)
+    {
+        Addr newAddress = large_realloc(address, length);
+        
+        if(newAddress != EMPTY_ADDRESS && _heapSampling)
+        {
+            heap_profiler_free(address);
+            heap_profiler_malloc(newAddress, length);
+        }
+        
+        return newAddress;
+    }
+    
+    Arena* arena = (_numaArenas) ? arenaForAddress(address) : _arenas[0];
+    
+    if(arena == EMPTY_ADDRESS){
+        return EMPTY_ADDRESS;
+    }
+    
+    _arena = arena;
+    
+    lockArena();
+    
+    //Memory from a sub-heap is read through the sub-heap, and moves to one of the same lifetime.
+    unsigned int lifetime = LIFETIME_NONE, slot;
+    Arena* heap = (_lifetimeHeapTotal > 0 && !_numaArenas) ? lifetimeHeapForAddress(address, &lifetime, &slot) : EMPTY_ADDRESS;
+    
+    _arena = (heap != EMPTY_ADDRESS) ? heap : arena;
+    unsigned int usableSize = usableSizeInArena(address);
+    _arena = arena;
+    
+    unlockArena();
+    
+    if(usableSize == 0){
+        return EMPTY_ADDRESS;
+    }
+    
+    if(length <= usableSize && !isLargeRequest(length)){
+        return address;
+    }
+    
+    unsigned int hintFlags[LIFETIME_CLASSES + 1] = { ALLOCATION_HINT_SHORT_LIVED, ALLOCATION_HINT_LONG_LIVED, ALLOCATION_HINT_HOT, ALLOCATION_HINT_NONE };
+    Addr newAddress = my_malloc_hint(length, hintFlags[lifetime]);
+    
+    if(newAddress == EMPTY_ADDRESS){
+        return EMPTY_ADDRESS;
+    }
+    
+    memcpy(newAddress, address, (length < usableSize) ? length : usableSize);
+    my_free(address);
+    
+    return newAddress;
+}
+
+extern int my_allocator_set_large_threshold(unsigned int threshold) {
+    
+    _largeThreshold = threshold;
+    
+    return 0;
+}
+
+extern unsigned int my_allocator_order_size(unsigned int order) {
+    
+    _arena = _arenas[0];     //Orders are the same in every arena.
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY)
+    {
+        unsigned int orderSize = (_engineMemory != EMPTY_ADDRESS) ? _engineTable[_engine].orderSize(order) : 0;
+        return (orderSize > 0) ? (orderSize - _arena->headerSize) : 0;
+    }
+    
+    if(getArenaFreestore(_arena) == EMPTY_ADDRESS || order > _arena->freestoreRange){
+        return 0;
+    }
+    
+    return getSizeForAdjustedFreestoreIndex(order) - _arena->headerSize;
+}
+
+extern int my_allocator_set_lazy_coalescing(unsigned int threshold) {
+    
+    unsigned int arenaCount = maxValue(_arenaCount, 1);
+    
+    for(unsigned int i = 0; i < arenaCount; i++)
+    {
+        _arena = _arenas[i];
+        
+        lockArena();
+        
+        //Going back to eager merging needs the freestore fully merged first.
+        if(threshold == 0 && _arena->lazyThreshold > 0 && getArenaFreestore(_arena) != EMPTY_ADDRESS)
+        {
+            coalesceFreestore();
+        }
+        
+        _arena->lazyThreshold = threshold;
+        
+        unlockArena();
+    }
+    
+    return 0;
+}
+
+extern int my_allocator_set_size_classes(unsigned int enabled) {
+    
+    unsigned int arenaCount = maxValue(_arenaCount, 1);
+    
+    //Slots already handed out stay valid to free either way.
+    for(unsigned int i = 0; i < arenaCount; i++)
+    {
+        _arenas[i]->sizeClassesEnabled = (enabled != 0) ? true : false;
+    }
+    
+    return 0;
+}
+
+extern int my_allocator_set_maintenance(unsigned int interval) {
+    
+    if(interval == 0)
+    {
+        stopMaintenance();
+        return 0;
+    }
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY || getArenaFreestore(_arenas[0]) == EMPTY_ADDRESS)
+    {
+        return 1;
+    }
+    
+    pthread_mutex_lock(&_maintenanceLock);
+    
+    if(_maintenanceInterval > 0)
+    {
+        _maintenanceInterval = interval;    //Taken from the next pass on.
+        pthread_mutex_unlock(&_maintenanceLock);
+        return 0;
+    }
+    
+    pthread_mutex_unlock(&_maintenanceLock);
+    
+    _maintenanceLockedArenas = _lockedArenas;
+    
+    for(unsigned int i = 0; i < _arenaCount; i++)
+    {
+        if(_lockedArenas == false)
+        {
+            pthread_mutex_init(&_arenas[i]->lock, EMPTY_ADDRESS);
+        }
+        
+        for(unsigned int j = 0; j < MAX_ALLOCATOR_ORDERS; j++)
+        {
+            _arenas[i]->demandCount[j] = 0;
+            _reserveTargets[i][j] = 0;
+        }
+        
+        _maintenanceActivity[i] = _arenas[i]->mallocCount + _arenas[i]->freeCount;
+    }
+    
+    _lockedArenas = true;
+    _maintenanceInterval = interval;
+    
+    if(pthread_create(&_maintenanceThread, EMPTY_ADDRESS, maintenanceMain, EMPTY_ADDRESS) != 0)
+    {
+        _maintenanceInterval = 0;
+        _lockedArenas = _maintenanceLockedArenas;
+        return 1;
+    }
+    
+    return 0;
+}
+
+extern int my_allocator_set_waiting(unsigned int enabled) {
+    
+    if(enabled == 0)
+    {
+        stopWaiting();
+        return 0;
+    }
+    
+    if(_waitingEnabled){
+        return 0;
+    }
+    
+    //Waiting only makes sense with one arena for every thread to free into.
+    if(_engine != ALLOCATOR_ENGINE_BUDDY || _numaArenas || _mappedHeapShared || getArenaFreestore(_arenas[0]) == EMPTY_ADDRESS)
+    {
+        return 1;
+    }
+    
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    
+    for(unsigned int i = 0; i < MAX_ALLOCATOR_ORDERS; i++)
+    {
+        pthread_cond_init(&_waitQueues[i], &attributes);
+        _parkedThreads[i] = 0;
+        _pendingRequests[i] = EMPTY_ADDRESS;
+        _pendingTails[i] = EMPTY_ADDRESS;
+    }
+    
+    pthread_condattr_destroy(&attributes);
+    
+    //The lock has to outlive a maintenance thread that made it, and go when waiting stops.
+    if(_lockedArenas == false)
+    {
+        pthread_mutex_init(&_arenas[0]->lock, EMPTY_ADDRESS);
+        _lockedArenas = true;
+        _waitingLockedArenas = true;
+    } else if(_maintenanceInterval > 0 && _maintenanceLockedArenas == false)
+    {
+        _maintenanceLockedArenas = true;
+        _waitingLockedArenas = true;
+    }
+    
+    _waitingCount = 0;
+    _waitedCount = 0;
+    _waitingEnabled = true;
+    
+    return 0;
+}
+
+extern int my_allocator_set_root(Addr root) {
+    
+    _arena = _arenas[0];
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY || getArenaFreestore(_arena) == EMPTY_ADDRESS)
+    {
+        return 1;
+    }
+    
+    //Anything outside the arena would mean nothing once the heap is mapped again.
+    if(root != EMPTY_ADDRESS && (root <= (Addr)getArenaFreestore(_arena) || root >= ((Addr)getArenaFreestore(_arena) + _arena->length)))
+    {
+        return 1;
+    }
+    
+    _arena->rootObject = offsetForAddress(root);
+    
+    return 0;
+}
+
+extern Addr my_allocator_root(void) {
+    
+    _arena = _arenas[0];
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY || getArenaFreestore(_arena) == EMPTY_ADDRESS)
+    {
+        return EMPTY_ADDRESS;
+    }
+    
+    return addressForOffset(_arena->rootObject);
+}
+
+extern unsigned long my_allocator_offset(Addr address) {
+    
+    _arena = _arenas[0];
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY || getArenaFreestore(_arena) == EMPTY_ADDRESS)
+    {
+        return 0;
+    }
+    
+    if(address <= (Addr)getArenaFreestore(_arena) || address >= ((Addr)getArenaFreestore(_arena) + _arena->length))
+    {
+        return 0;
+    }
+    
+    return offsetForAddress(address);
+}
+
+extern Addr my_allocator_address(unsigned long offset) {
+    
+    _arena = _arenas[0];
+    
+    if(_engine != ALLOCATOR_ENGINE_BUDDY || getArenaFreestore(_arena) == EMPTY_ADDRESS || offset >= _arena->length)
+    {
+        return EMPTY_ADDRESS;
+    }
+    
+    return addressForOffset(offset);
+}
+
+extern int my_allocator_set_sampling(unsigned long rate) {
+    
+    if(rate > 0)
+    {
+        _heapSampling = true;
+    }
+    
+    heap_profiler_set_rate(rate);
+    
+    return 0;
+}
+
+extern int my_allocator_dump_profile(const char* path) {
+    
+    if(path == EMPTY_ADDRESS)
+    {
+        return 1;
+    }
+    
+    return heap_profiler_dump(path);
+}
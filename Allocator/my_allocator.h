@@ -17,7 +17,8 @@
 /* DEFINES */
 /*--------------------------------------------------------------------------*/
 
-/* -- (none) -- */
+#define MAX_ALLOCATOR_ORDERS 32            // upper bound on freestore indexes
+#define ALLOCATOR_WAIT_FOREVER 0xffffffff  // timeout of my_malloc_wait that never runs out
 
 /*--------------------------------------------------------------------------*/
 /* INCLUDES */
@@ -29,6 +30,62 @@
 
 typedef void* Addr; 
 
+struct iovec;                                           // From sys/uio.h, see my_iobuf_vector.
+
+typedef unsigned int Handle;                            // Names memory that may move, see my_halloc. 0 is never a handle.
+
+typedef void (*AllocationCallback)(Addr _a, void* _context);   // Gets the memory of my_malloc_async.
+
+typedef enum AllocatorEngine {
+    ALLOCATOR_ENGINE_BUDDY,                             // Power of two buddy blocks kept in the freestore.
+    ALLOCATOR_ENGINE_TLSF,                              // Two-Level Segregated Fit, see tlsf_allocator.h.
+    ALLOCATOR_ENGINE_LOCKFREE,                          // Buddy blocks on lock-free stacks, see lockfree_buddy.h.
+    ALLOCATOR_ENGINE_TEMPLATE,                          // Compile-time specialised BuddyHeap, see BuddyHeap.hpp.
+    ALLOCATOR_ENGINE_TREE                               // Buddy tree in a flat array, see tree_buddy.h.
+} AllocatorEngine;
+
+typedef enum AllocationHint {
+    ALLOCATION_HINT_NONE = 0,
+    ALLOCATION_HINT_SHORT_LIVED = 1,                    // Freed soon, like per-request buffers.
+    ALLOCATION_HINT_LONG_LIVED = 2,                     // Kept for long, like cache entries.
+    ALLOCATION_HINT_HOT = 4                             // Read often, so worth keeping close together.
+} AllocationHint;
+
+typedef struct AllocatorStats {
+    unsigned int basicBlockSize;
+    unsigned int headerSize;
+    unsigned int orderCount;                            // Number of (adjusted) freestore indexes.
+    unsigned int orderSize[MAX_ALLOCATOR_ORDERS];       // Block size of each index.
+    unsigned int freeBlocks[MAX_ALLOCATOR_ORDERS];      // Free blocks currently chained at each index.
+    unsigned long freeBytes;
+    unsigned long allocatedBlocks;                      // Live allocations.
+    unsigned long allocatedBytes;                       // Block and slot bytes held by live allocations, headers included.
+    unsigned long requestedBytes;                       // Bytes asked for by live buddy allocations with a header.
+    unsigned long headerBytes;                          // MemoryHeader bytes of live allocations.
+    unsigned long slabBytes;                            // Buddy block bytes held by size class slabs.
+    unsigned long slotBytes;                            // Slab slot bytes held by live allocations.
+    unsigned long mallocCount;
+    unsigned long freeCount;
+    unsigned long failedCount;
+    unsigned long splitCount;                           // Blocks split in half, since init.
+    unsigned long mergeCount;                           // Buddy pairs merged, since init.
+    unsigned long lazyBlocks;                           // Lazily freed blocks waiting to be coalesced.
+    unsigned long committedBytes;                       // Memory made usable, less than the length only for a reserved arena.
+    unsigned long largeBlocks;                          // Live allocations mapped on their own, see my_allocator_set_large_threshold.
+    unsigned long largeBytes;                           // Bytes mapped for them, in whole pages.
+    unsigned long lifetimeHeaps;                        // Sub-heaps serving hinted requests, see my_malloc_hint.
+    unsigned long lifetimeBytes;                        // Main arena bytes they hold, counted there as allocated.
+    unsigned long lifetimeBlocks;                       // Live allocations in them.
+    unsigned long handles;                              // Live handles, see my_halloc.
+    unsigned long handleMoves;                          // Blocks moved by compaction, since init.
+    unsigned long waitingRequests;                      // Threads and callbacks waiting for memory to be freed.
+    unsigned long waitedRequests;                       // Allocations served after waiting, since waiting was turned on.
+    unsigned long ioBuffers;                            // Live I/O buffers, see my_iobuf_alloc.
+    unsigned long ioBufferBytes;                        // Bytes they hold, counted as allocated too.
+    unsigned long ioCachedBytes;                        // Bytes of freed I/O buffers kept for reuse, neither free nor allocated.
+    unsigned int arenaCount;                            // Arenas summed up here, one per NUMA node when placement is on.
+} AllocatorStats;
+
 /*--------------------------------------------------------------------------*/
 /* FORWARDS */ 
 /*--------------------------------------------------------------------------*/
@@ -48,6 +105,84 @@ unsigned int init_allocator(unsigned int _basic_block_size,
    it returns 0. 
 */ 
 
+unsigned int init_allocator_with_engine(AllocatorEngine _engine,
+                                        unsigned int _basic_block_size,
+                                        unsigned int _length);
+/* Same as ’init_allocator’, but backs my_malloc/my_free with the given
+   ’_engine’. ’init_allocator’ uses ALLOCATOR_ENGINE_BUDDY. The TLSF engine
+   has no orders, so ’_basic_block_size’ is ignored by it, as are the lazy
+   coalescing and size class settings. The lock-free engine can be called
+   from any number of threads at once without taking a lock; it always
+   merges eagerly and has no size classes either. The template engine is
+   the BuddyHeap of BuddyHeap.hpp, instantiated for basic block sizes of
+   16 to 4096 bytes; like the lock-free engine it merges eagerly and has
+   no size classes, but it is not thread safe. The tree engine keeps the
+   buddy tree in a flat array instead of free lists and always hands out
+   the lowest address that fits; its blocks have no header, and aligned
+   requests are limited to the page size. It is not thread safe either.
+*/
+
+unsigned int init_allocator_reserved(unsigned int _basic_block_size,
+                                     unsigned int _length);
+/* Same as ’init_allocator’, but ’_length’ bytes of address space are
+   only reserved, with no access, and are committed a megabyte at a time
+   as blocks are first handed out. Init writes only the freestore and the
+   headers of the few blocks it starts with, so it takes the same time,
+   and leaves the same few pages resident, whatever the ’_length’.
+   Committed memory is kept until ’release_allocator’. Returns the
+   memory made available, or 0 on error.
+*/
+
+unsigned int init_allocator_numa(unsigned int _basic_block_size,
+                                 unsigned int _length);
+/* Same as ’init_allocator’, but builds one buddy arena of ’_length’
+   bytes per NUMA node, each bound to its node’s memory. ’my_malloc’
+   serves the calling thread from the arena of the node it runs on, and
+   ’my_free’ returns memory to the arena it came from, from any thread.
+   Each arena has a lock of its own. An arena that runs out of memory
+   fails the allocation rather than borrowing from another node. On a
+   single node machine this is the same as ’init_allocator’. Returns
+   the memory made available on all nodes, or 0 on error.
+*/
+
+unsigned int init_allocator_mapped(const char* _path,
+                                   unsigned int _basic_block_size,
+                                   unsigned int _length);
+/* Same as ’init_allocator’, but the arena, freestore and all, lives in
+   the file at ’_path’, mapped shared. Blocks link to each other by
+   offset rather than by address, so the file can be mapped again
+   anywhere. If the file doesn’t exist or is empty, it is created and a
+   fresh heap is laid out in it. Otherwise the heap in it is picked up as
+   it was left, with every block it held still allocated, provided it was
+   made with the same ’_basic_block_size’ and ’_length’. Use
+   ’my_allocator_root’ to find the data structures again. The TLSF engine
+   and NUMA placement can’t be mapped. Returns the memory made available,
+   or 0 on error.
+*/
+
+unsigned int init_allocator_shared(const char* _name,
+                                   unsigned int _basic_block_size,
+                                   unsigned int _length);
+/* Same as ’init_allocator_mapped’, but the heap lives in the POSIX
+   shared memory object ’_name’ (see shm_open), for several processes to
+   map at once, each at its own address. The process that creates the
+   object lays the heap out. The others attach to it, and get 0 back
+   until it is laid out, so they can try again. ’my_malloc’ and
+   ’my_free’ work from any of them, under a process-shared lock kept in
+   the heap. Memory is handed between processes as an offset, see
+   ’my_allocator_offset’. ’release_allocator’ only unmaps the heap; the
+   object stays until it is shm_unlink’ed.
+*/
+
+unsigned int init_allocator_shared_fd(int _fd,
+                                      unsigned int _basic_block_size,
+                                      unsigned int _length);
+/* Same as ’init_allocator_shared’, over a file that is already open,
+   such as a memfd inherited from a parent or passed over a socket. An
+   empty file gets a fresh heap, anything else is attached to. ’_fd’
+   stays the caller’s to close.
+*/
+
 int release_allocator(); 
 /* This function returns any allocated memory to the operating system. 
    After this function is called, any allocation fails.
@@ -59,7 +194,201 @@ Addr my_malloc(unsigned int _length);
 
 int my_free(Addr _a);
 /* Frees the section of physical memory previously allocated 
-   using ’my_malloc’. Returns 0 if everything ok. */ 
+   using ’my_malloc’. Returns 0 if everything ok, and 1 if ’_a’ is not
+   the start of a live allocation: a double free, a pointer into the
+   middle of an allocation, or memory the allocator never handed out.
+   Those are caught by a bitmap lookup before any free list is touched. */ 
+
+Addr my_malloc_aligned(unsigned int _length, unsigned int _alignment);
+/* Same as ’my_malloc’, but the returned address is a multiple of
+   ’_alignment’, which has to be a power of two. The memory is freed with
+   ’my_free’ as usual. Returns 0 when out of memory or when ’_alignment’
+   is not a power of two. */
+
+Addr my_malloc_hint(unsigned int _length, unsigned int _flags);
+/* Same as ’my_malloc’, but ’_flags’, a mask of AllocationHint values,
+   says how the memory will be used. Short lived, long lived and hot
+   memory each come from sub-heaps of their own, so short lived churn
+   doesn't break up the blocks long lived memory sits in. Short lived
+   wins over hot, and hot over long lived. Only the buddy engine without
+   NUMA arenas keeps sub-heaps; elsewhere the hint is ignored. The memory
+   is freed with ’my_free’ as usual. */
+
+Handle my_halloc(unsigned int _length);
+/* Allocates ’_length’ bytes reached through the returned handle rather
+   than an address, so that ’my_allocator_compact’ may move them. Returns
+   0 when out of memory. Only the buddy engine without NUMA arenas moves
+   memory; elsewhere, and for large requests, the memory stays put. */
+
+Addr my_hlock(Handle _h);
+/* Returns the address of the memory of ’_h’ and keeps it there until a
+   matching ’my_hunlock’. Locks nest. Returns 0 if ’_h’ is not a live
+   handle. Addresses from an earlier lock are stale once it is unlocked. */
+
+int my_hunlock(Handle _h);
+/* Undoes one ’my_hlock’ of ’_h’. Returns 0 if everything ok, and 1 if
+   ’_h’ is not a live handle or isn’t locked. */
+
+int my_hfree(Handle _h);
+/* Frees the memory of ’_h’, locked or not, and the handle with it.
+   Returns 0 if everything ok, and 1 if ’_h’ is not a live handle. */
+
+int my_allocator_compact(unsigned int _microseconds);
+/* Moves unlocked handle memory for about ’_microseconds’, picking up
+   where the last call stopped. Blocks only move down, into the lowest
+   free memory that holds them, so the pairs they leave at the top of
+   the arena merge back into large blocks. Returns 1 while there may be
+   more to move, and 0 once a whole pass over the handles moved nothing.
+   The maintenance thread, when it runs, compacts on its idle passes by
+   itself. The stats count the blocks moved. */
+
+Addr my_malloc_wait(unsigned int _length, unsigned int _microseconds);
+/* Same as ’my_malloc’, but with waiting on (see
+   ’my_allocator_set_waiting’), waits up to ’_microseconds’ for another
+   thread to free enough memory, rather than failing straight away.
+   ’ALLOCATOR_WAIT_FOREVER’ waits for as long as it takes, and 0 doesn’t
+   wait at all. Returns 0 when the time runs out, or at once when no
+   amount of freeing would make ’_length’ fit. */
+
+int my_malloc_async(unsigned int _length, AllocationCallback _callback,
+                    void* _context);
+/* Hands ’_length’ bytes to ’_callback’, along with ’_context’. If the
+   memory is there, the callback runs before this returns. Otherwise,
+   with waiting on, the request queues behind earlier ones of its size,
+   and the callback runs on the thread whose ’my_free’ made room, once
+   the allocator lock is let go. When waiting is turned off, queued
+   callbacks get 0. Returns 0 if everything ok, and 1 if ’_length’ can
+   never fit, in which case the callback isn’t called. */
+
+Addr my_iobuf_alloc(unsigned int _length);
+/* Allocates an I/O buffer of ’_length’ rounded up to a power of two
+   from 4 KiB to 1 MiB. The buffer is a whole buddy block with no header,
+   starting on a page, so it can be read into with O_DIRECT. A few freed
+   buffers of each size are kept for the next request, and given back
+   to the arena once it runs out. Only the buddy engine with a single arena
+   that isn’t mapped, and a power of two basic block size up to 4 KiB,
+   has I/O buffers. Returns 0 when out of memory, when ’_length’ is over
+   1 MiB, or when there are no I/O buffers. */
+
+int my_iobuf_free(Addr _a);
+/* Frees the I/O buffer at ’_a’. Returns 0 if everything ok, and 1 if
+   ’_a’ is not a live I/O buffer. I/O buffers aren’t freed with
+   ’my_free’, nor ’my_free’d memory with this. */
+
+unsigned int my_iobuf_size(Addr _a);
+/* Returns the length of the I/O buffer at ’_a’, or 0 if ’_a’ is not a
+   live I/O buffer. */
+
+unsigned int my_iobuf_vector(struct iovec* _vector, unsigned int _count,
+                             unsigned long _length,
+                             unsigned int _buffer_length);
+/* Fills ’_vector’ in with I/O buffers of ’_buffer_length’ covering
+   ’_length’ bytes, ready for readv or preadv. The last entry is only as
+   long as what is left of ’_length’. Either every buffer is allocated or
+   none is. Returns the entries filled in, or 0 if more than ’_count’
+   are needed or memory ran out. */
+
+int my_iobuf_vector_free(struct iovec* _vector, unsigned int _count);
+/* Frees the buffers of the first ’_count’ entries of ’_vector’. Returns
+   0 if everything ok, and 1 if one of them is not a live I/O buffer. */
+
+Addr my_realloc(Addr _a, unsigned int _length);
+/* Resizes the allocation at ’_a’ to ’_length’ bytes, keeping its
+   contents up to the smaller of the two sizes. Stays in place while the
+   block still holds ’_length’, and otherwise moves to a new allocation.
+   A large allocation is grown or shrunk with mremap, which moves its
+   pages rather than copying them, and stays large. With ’_a’ 0 this is
+   ’my_malloc’, and with ’_length’ 0 it is ’my_free’. Returns the new
+   address, or 0 on failure, which leaves ’_a’ as it was. */
+
+int my_allocator_set_large_threshold(unsigned int _threshold);
+/* Requests of ’_threshold’ bytes or more skip the arenas and are mapped
+   on their own, page aligned, so they are not capped by the arena size
+   and never hold top order blocks the small requests need. ’my_free’
+   unmaps them. A ’_threshold’ of 0 (the default) only maps requests no
+   block could hold, which used to fail. A mapped or shared heap never
+   maps allocations outside its file. Returns 0 if everything ok. */
+
+int my_allocator_stats(AllocatorStats* _stats);
+/* Fills ’_stats’ with a snapshot of the freestore and of the live 
+   allocations. Free block counts are gathered by walking the freestore, 
+   so this is meant for periodic sampling rather than the hot path.
+   Returns 0 if everything ok. */
+
+unsigned int my_allocator_order_size(unsigned int _order);
+/* Returns the most bytes a single ’my_malloc’ can ask for and still be
+   served by one block of (adjusted) freestore index ’_order’, or 0 if
+   there is no such order. With the TLSF engine, which has no orders,
+   this is ’_basic_block_size’ doubled ’_order’ times. */
+
+int my_allocator_set_lazy_coalescing(unsigned int _threshold);
+/* With a ’_threshold’ above 0, freed blocks are parked at their own size
+   without merging them with their buddies. A size is coalesced once more
+   than ’_threshold’ blocks were parked there, and everything is coalesced
+   before an allocation is allowed to fail. A ’_threshold’ of 0 (the
+   default) merges on every free. Returns 0 if everything ok. */
+
+int my_allocator_set_size_classes(unsigned int _enabled);
+/* When ’_enabled’, small requests are served from slabs of finer size
+   classes (four per power of two) instead of being rounded up to the next
+   power of two, and carry no header. Slots don't record the length that
+   was asked for, so they are left out of ’requestedBytes’ in the stats.
+   Off by default. Returns 0 if everything ok. */
+
+int my_allocator_set_maintenance(unsigned int _interval);
+/* With an ’_interval’ above 0, starts a thread that wakes up every
+   ’_interval’ microseconds to split blocks ahead of time, keeping about
+   as many free at each size as were asked for since its last pass, and
+   to coalesce parked frees once an arena sees no mallocs or frees for a
+   whole pass. my_malloc then rarely splits, and my_free never merges, so
+   their slowest calls get much closer to the typical ones. Arenas take
+   their lock while it runs, so my_malloc/my_free may then be called from
+   several threads. Called again, it only changes the interval. An
+   ’_interval’ of 0 (the default) stops the thread and coalesces what it
+   left parked, as does ’release_allocator’. Start and stop it while no
+   other thread allocates. Buddy engine only. Returns 0 if everything ok,
+   and 1 if the thread couldn’t be started. */
+
+int my_allocator_set_waiting(unsigned int _enabled);
+/* With ’_enabled’ above 0, lets ’my_malloc_wait’ and ’my_malloc_async’
+   wait for memory instead of failing. The arena takes its lock from
+   then on, so the allocator may be called from several threads. With
+   0, wakes every waiting thread and fails every queued callback, as
+   does ’release_allocator’. Turn it on and off while no other thread
+   allocates. Buddy engine only, with neither NUMA arenas nor a shared
+   heap. Returns 0 if everything ok, and 1 if waiting isn’t supported. */
+
+int my_allocator_set_root(Addr _root);
+/* Remembers ’_root’, an address inside the buddy arena, as the place a
+   heap’s data structures start from. It is kept in the arena itself, so
+   a heap reopened with ’init_allocator_mapped’ still has it. Passing 0
+   clears it. Returns 0 if everything ok, and 1 if ’_root’ is outside
+   the arena. */
+
+Addr my_allocator_root(void);
+/* Returns the address given to ’my_allocator_set_root’, at wherever the
+   arena is mapped now, or 0 if none was set. */
+
+int my_allocator_set_sampling(unsigned long _rate);
+/* With a ’_rate’ above 0, about one allocation every ’_rate’ bytes is
+   sampled, at random, and the call stack that asked for it is recorded.
+   Sampled allocations are tracked until they are freed, so the profile
+   shows both the bytes still live and the bytes ever allocated per call
+   site. A ’_rate’ of 0 (the default) stops sampling. Returns 0 if
+   everything ok. */
+
+int my_allocator_dump_profile(const char* _path);
+/* Writes the sampled profile to ’_path’ in pprof’s text heap format,
+   ready for ’pprof <program> <path>’. Returns 0 if everything ok. */
+
+unsigned long my_allocator_offset(Addr _a);
+/* Returns where ’_a’ sits in the buddy arena, counted from its start,
+   or 0 if it is outside the arena. The offset means the same thing in
+   every process that maps the heap. */
+
+Addr my_allocator_address(unsigned long _offset);
+/* Returns the address of ’_offset’ in the buddy arena as this process
+   maps it, or 0 if ’_offset’ is 0 or past the arena. */
 
 
 #endif 
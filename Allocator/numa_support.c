@@ -0,0 +1,124 @@
+/*
+    File: numa_support.c
+
+    This file contains the implementation of the module "NUMA_SUPPORT".
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#define EMPTY_ADDRESS 0x0
+
+#define NUMA_ONLINE_PATH "/sys/devices/system/node/online"
+#define NUMA_MPOL_BIND 2                    //MPOL_BIND from linux/mempolicy.h, which isn't always installed.
+#define NUMA_MAX_NODES 1024
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "numa_support.h"
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE NUMA_SUPPORT */
+/*--------------------------------------------------------------------------*/
+
+unsigned int numa_node_count(void) {
+
+    unsigned int count = 1;
+
+#ifdef __linux__
+    FILE* file = fopen(NUMA_ONLINE_PATH, "r");
+
+    if(file != EMPTY_ADDRESS)
+    {
+        //The list reads like "0" or "0-3" or "0,2-3". Nodes are numbered from 0, so the highest one gives the count.
+        unsigned int node = 0;
+        int next = 0;
+
+        while(fscanf(file, "%u", &node) == 1)
+        {
+            if(node + 1 > count && node < NUMA_MAX_NODES)
+            {
+                count = node + 1;
+            }
+
+            next = fgetc(file);
+
+            if(next != ',' && next != '-')
+            {
+                break;
+            }
+        }
+
+        fclose(file);
+    }
+#endif
+
+    return count;
+}
+
+unsigned int numa_current_node(void) {
+
+    unsigned int node = 0;
+
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned int cpu = 0;
+
+    if(syscall(SYS_getcpu, &cpu, &node, EMPTY_ADDRESS) != 0)
+    {
+        node = 0;
+    }
+#endif
+
+    return node;
+}
+
+Addr numa_map_on_node(unsigned long length, unsigned int node) {
+
+#ifdef __linux__
+    Addr memory = mmap(EMPTY_ADDRESS, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(memory == MAP_FAILED)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+#ifdef SYS_mbind
+    //Bind before anything touches the pages, so none of them get placed by first touch.
+    if(node < NUMA_MAX_NODES)
+    {
+        unsigned long nodeMask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+        nodeMask[node / (8 * sizeof(unsigned long))] = (1UL << (node % (8 * sizeof(unsigned long))));
+
+        syscall(SYS_mbind, memory, length, NUMA_MPOL_BIND, nodeMask, (unsigned long)NUMA_MAX_NODES + 1, 0);     //The kernel reads one bit less than maxnode.
+    }
+#endif
+
+    return memory;
+#else
+    return malloc(length);
+#endif
+}
+
+void numa_unmap(Addr address, unsigned long length) {
+
+#ifdef __linux__
+    munmap(address, length);
+#else
+    free(address);
+#endif
+}
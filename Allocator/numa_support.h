@@ -0,0 +1,51 @@
+/*
+    File: numa_support.h
+
+    Finds the NUMA nodes of the machine, and maps memory on a given node.
+    Everything degrades to a single node where NUMA isn't available.
+
+*/
+
+#ifndef _numa_support_h_                   // include file only once
+#define _numa_support_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "my_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   NUMA_SUPPORT */
+/*--------------------------------------------------------------------------*/
+
+unsigned int numa_node_count(void);
+/* Returns the number of NUMA nodes, read from sysfs. Returns 1 on
+   machines, or systems, without NUMA. */
+
+unsigned int numa_current_node(void);
+/* Returns the node of the CPU the calling thread is running on. Threads
+   can migrate, so this is only a hint. Returns 0 without NUMA. */
+
+Addr numa_map_on_node(unsigned long _length, unsigned int _node);
+/* Maps ’_length’ bytes of anonymous memory whose pages are bound to
+   ’_node’ with mbind. If the binding is refused the memory is still
+   returned, just without a placement. Returns 0 if nothing could be
+   mapped. */
+
+void numa_unmap(Addr _a, unsigned long _length);
+/* Unmaps memory returned by ’numa_map_on_node’. */
+
+#endif
@@ -0,0 +1,207 @@
+/*
+    File: perf_counters.c
+
+    This file contains the implementation of the module "PERF_COUNTERS".
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#define EMPTY_ADDRESS 0x0
+#define CLOSED_COUNTER -1
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "perf_counters.h"
+
+/*--------------------------------------------------------------------------*/
+/* CONSTANTS */
+/*--------------------------------------------------------------------------*/
+
+/* -- Counters -- */
+    static int _counters[PERF_COUNTER_COUNT] = { CLOSED_COUNTER, CLOSED_COUNTER, CLOSED_COUNTER,
+                                                 CLOSED_COUNTER, CLOSED_COUNTER, CLOSED_COUNTER };
+
+    //Readings at the start of the phase. Counts of exited threads survive a reset, so phases take differences.
+    static unsigned long long _baselines[PERF_COUNTER_COUNT][3];
+
+    static const char* _counterNames[PERF_COUNTER_COUNT] = {
+        "cycles", "instructions", "L1d misses", "LLC misses", "dTLB misses", "branch misses"
+    };
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS FOR MODULE PERF_COUNTERS */
+/*--------------------------------------------------------------------------*/
+
+#ifdef __linux__
+
+/* Opens a disabled counter of the event ’config’ of ’type’, or returns CLOSED_COUNTER. */
+static int openCounter(unsigned int type, unsigned long config) {
+
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+
+    attributes.size = sizeof(attributes);
+    attributes.type = type;
+    attributes.config = config;
+    attributes.disabled = 1;
+    attributes.inherit = 1;
+    attributes.exclude_kernel = 1;          //Enough for a perf_event_paranoid of 2, the usual default.
+    attributes.exclude_hv = 1;
+    attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    int counter = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+
+    return (counter >= 0) ? counter : CLOSED_COUNTER;
+}
+
+/* Reads the value of ’counter’, then the time it was enabled, and the time it actually had a hardware counter. */
+static int readCounter(int counter, unsigned long long* reading) {
+
+    return (read(counter, reading, 3 * sizeof(unsigned long long)) == 3 * sizeof(unsigned long long)) ? 0 : 1;
+}
+
+/* Returns the config of a read miss of the ’cache’ for PERF_TYPE_HW_CACHE. */
+static unsigned long cacheReadMisses(unsigned long cache) {
+
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+#endif
+
+static unsigned long elapsedNanoseconds(struct timespec* start, struct timespec* end) {
+
+    return ((end->tv_sec - start->tv_sec) * 1000000000UL) + end->tv_nsec - start->tv_nsec;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE PERF_COUNTERS */
+/*--------------------------------------------------------------------------*/
+
+unsigned int perf_counters_open(void) {
+
+    unsigned int opened = 0;
+
+    perf_counters_close();
+
+#ifdef __linux__
+    _counters[PERF_COUNTER_CYCLES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    _counters[PERF_COUNTER_INSTRUCTIONS] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    _counters[PERF_COUNTER_L1D_MISSES] = openCounter(PERF_TYPE_HW_CACHE, cacheReadMisses(PERF_COUNT_HW_CACHE_L1D));
+    _counters[PERF_COUNTER_LLC_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    _counters[PERF_COUNTER_DTLB_MISSES] = openCounter(PERF_TYPE_HW_CACHE, cacheReadMisses(PERF_COUNT_HW_CACHE_DTLB));
+    _counters[PERF_COUNTER_BRANCH_MISSES] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+    //The first failure says best why counting isn't available, the ones after it may only be missing events.
+    int firstError = 0;
+
+    for(unsigned int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        if(_counters[c] != CLOSED_COUNTER){
+            opened |= (1u << c);
+        } else if(firstError == 0){
+            firstError = errno;
+        }
+    }
+
+    errno = (opened == 0) ? firstError : errno;
+#else
+    errno = ENOSYS;
+#endif
+
+    return opened;
+}
+
+void perf_counters_close(void) {
+
+    for(unsigned int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+#ifdef __linux__
+        if(_counters[c] != CLOSED_COUNTER){
+            close(_counters[c]);
+        }
+#endif
+        _counters[c] = CLOSED_COUNTER;
+    }
+}
+
+void perf_counters_start(PerfSample* sample) {
+
+    memset(sample, 0, sizeof(PerfSample));
+
+#ifdef __linux__
+    for(unsigned int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        if(_counters[c] != CLOSED_COUNTER)
+        {
+            ioctl(_counters[c], PERF_EVENT_IOC_ENABLE, 0);
+            
+            if(readCounter(_counters[c], _baselines[c]) != 0){
+                memset(_baselines[c], 0, sizeof(_baselines[c]));
+            }
+        }
+    }
+#endif
+
+    //Read last, so starting the counters isn't timed.
+    clock_gettime(CLOCK_MONOTONIC, &sample->started);
+}
+
+void perf_counters_stop(PerfSample* sample) {
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    sample->nanoseconds = elapsedNanoseconds(&sample->started, &end);
+
+#ifdef __linux__
+    for(unsigned int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        if(_counters[c] != CLOSED_COUNTER){
+            ioctl(_counters[c], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    for(unsigned int c = 0; c < PERF_COUNTER_COUNT; c++)
+    {
+        unsigned long long reading[3];
+
+        if(_counters[c] == CLOSED_COUNTER || readCounter(_counters[c], reading) != 0){
+            continue;
+        }
+
+        unsigned long long value = reading[0] - _baselines[c][0];
+        unsigned long long enabled = reading[1] - _baselines[c][1];
+        unsigned long long running = reading[2] - _baselines[c][2];
+
+        //An event that never got a counter, because others took them all, counted nothing worth reporting.
+        if(running == 0){
+            continue;
+        }
+
+        sample->values[c] = (unsigned long)((double)value * ((double)enabled / (double)running));
+        sample->counted |= (1u << c);
+    }
+#endif
+}
+
+const char* perf_counter_name(unsigned int counter) {
+
+    return (counter < PERF_COUNTER_COUNT) ? _counterNames[counter] : EMPTY_ADDRESS;
+}
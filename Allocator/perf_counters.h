@@ -0,0 +1,71 @@
+/*
+    File: perf_counters.h
+
+    Counts hardware events, like cycles and cache misses, around a phase
+    of a benchmark with perf_event_open. Where the counters can't be
+    opened, phases are only timed.
+
+*/
+
+#ifndef _perf_counters_h_                   // include file only once
+#define _perf_counters_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <time.h>
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+typedef enum PerfCounter {
+    PERF_COUNTER_CYCLES,
+    PERF_COUNTER_INSTRUCTIONS,
+    PERF_COUNTER_L1D_MISSES,                            // Level 1 data cache read misses.
+    PERF_COUNTER_LLC_MISSES,                            // Last level cache misses.
+    PERF_COUNTER_DTLB_MISSES,                           // Data TLB read misses.
+    PERF_COUNTER_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+} PerfCounter;
+
+typedef struct PerfSample {
+    struct timespec started;
+    unsigned long nanoseconds;                          // Wall clock time of the phase.
+    unsigned long values[PERF_COUNTER_COUNT];           // Scaled up when the kernel shared a counter between events.
+    unsigned int counted;                               // Bit c is set when values[c] was counted.
+} PerfSample;
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   PERF_COUNTERS */
+/*--------------------------------------------------------------------------*/
+
+unsigned int perf_counters_open(void);
+/* Opens a counter for each PerfCounter, counting the user space events
+   of the calling thread and of the threads it starts from then on.
+   Counters the machine doesn’t have are left out. Returns a mask with
+   bit c set for each counter opened, or 0 when none could be, leaving
+   errno as perf_event_open set it. */
+
+void perf_counters_close(void);
+/* Closes the counters opened by ’perf_counters_open’. */
+
+void perf_counters_start(PerfSample* _sample);
+/* Clears ’_sample’, and starts the clock and the open counters. One
+   phase is counted at a time, so phases can’t nest. */
+
+void perf_counters_stop(PerfSample* _sample);
+/* Stops the clock and the counters, and fills ’_sample’ in with what
+   they counted since ’perf_counters_start’. */
+
+const char* perf_counter_name(unsigned int _counter);
+/* Returns a short name for ’_counter’, or 0 if there is no such counter. */
+
+#endif
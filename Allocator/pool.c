@@ -0,0 +1,153 @@
+/*
+    File: pool.c
+
+    This file contains the implementation of the module "POOL".
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define EMPTY_ADDRESS 0x0
+
+#define POOL_ALIGN_SIZE 16
+#define alignedLength(length) (((length) + (POOL_ALIGN_SIZE - 1)) & ~(POOL_ALIGN_SIZE - 1))
+
+typedef enum { false, true } bool;
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "pool.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Free objects are chained through their own first bytes, so an object is never smaller than a PoolObject.
+ */
+typedef struct PoolObject {
+    struct PoolObject* nextObject;
+} PoolObject;
+
+/*
+    Every chunk starts with a PoolChunk, chained to the chunk taken before it.
+
+    {[PoolChunk][object][object]...}
+ */
+typedef struct PoolChunk {
+    struct PoolChunk* previousChunk;
+} PoolChunk;
+
+struct Pool {
+    unsigned int objectSize;
+    unsigned int objectsPerChunk;
+    PoolObject* freeObjects;            //Objects given back with pool_free.
+    Addr unusedObject;                  //Objects of the newest chunk that were never handed out start here...
+    Addr unusedLimit;                   //...and end here, so a new chunk doesn't have to be threaded onto the free list.
+    PoolChunk* lastChunk;
+};
+
+/*--------------------------------------------------------------------------*/
+/* FORWARDS */
+/*--------------------------------------------------------------------------*/
+
+static bool addPoolChunk(Pool* pool);
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS */
+/*--------------------------------------------------------------------------*/
+
+static bool addPoolChunk(Pool* pool)
+{
+    unsigned int chunkHeaderSize = alignedLength(sizeof(PoolChunk));
+    PoolChunk* chunk = my_malloc(chunkHeaderSize + (pool->objectSize * pool->objectsPerChunk));
+
+    if(chunk == EMPTY_ADDRESS)
+    {
+        return false;
+    }
+
+    chunk->previousChunk = pool->lastChunk;
+    pool->lastChunk = chunk;
+
+    pool->unusedObject = (Addr)chunk + chunkHeaderSize;
+    pool->unusedLimit = pool->unusedObject + (pool->objectSize * pool->objectsPerChunk);
+
+    return true;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE POOL */
+/*--------------------------------------------------------------------------*/
+
+Pool* pool_create(unsigned int object_size, unsigned int objects_per_chunk) {
+
+    if(objects_per_chunk == 0)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    Pool* pool = my_malloc(sizeof(Pool));
+
+    if(pool != EMPTY_ADDRESS)
+    {
+        pool->objectSize = alignedLength((object_size > sizeof(PoolObject)) ? object_size : sizeof(PoolObject));
+        pool->objectsPerChunk = objects_per_chunk;
+        pool->freeObjects = EMPTY_ADDRESS;
+        pool->unusedObject = EMPTY_ADDRESS;
+        pool->unusedLimit = EMPTY_ADDRESS;
+        pool->lastChunk = EMPTY_ADDRESS;
+    }
+
+    return pool;
+}
+
+Addr pool_alloc(Pool* pool) {
+
+    PoolObject* object = pool->freeObjects;
+
+    if(object != EMPTY_ADDRESS)
+    {
+        pool->freeObjects = object->nextObject;
+        return object;
+    }
+
+    if(pool->unusedObject == pool->unusedLimit && !addPoolChunk(pool))
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    object = pool->unusedObject;
+    pool->unusedObject += pool->objectSize;
+
+    return object;
+}
+
+void pool_free(Pool* pool, Addr address) {
+
+    PoolObject* object = address;
+
+    if(object != EMPTY_ADDRESS)
+    {
+        object->nextObject = pool->freeObjects;
+        pool->freeObjects = object;
+    }
+}
+
+void pool_destroy(Pool* pool) {
+
+    PoolChunk* chunk = pool->lastChunk;
+
+    while(chunk != EMPTY_ADDRESS)
+    {
+        PoolChunk* previousChunk = chunk->previousChunk;
+        my_free(chunk);
+        chunk = previousChunk;
+    }
+
+    my_free(pool);
+}
@@ -0,0 +1,52 @@
+/*
+    File: pool.h
+
+    Pools of fixed size objects, served from chunks taken with my_malloc.
+
+*/
+
+#ifndef _pool_h_                   // include file only once
+#define _pool_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "my_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+typedef struct Pool Pool;
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   POOL */
+/*--------------------------------------------------------------------------*/
+
+Pool* pool_create(unsigned int _object_size, unsigned int _objects_per_chunk);
+/* Creates a pool of ’_object_size’ byte objects. Memory is taken from
+   my_malloc one chunk of ’_objects_per_chunk’ objects at a time, and the
+   objects carry no header of their own. Objects are 16 byte aligned.
+   Returns 0 if the pool can't be allocated. */
+
+Addr pool_alloc(Pool* _p);
+/* Returns an object from ’_p’ in constant time, taking a new chunk when
+   every object is in use. Returns 0 when out of memory. */
+
+void pool_free(Pool* _p, Addr _a);
+/* Gives the object at ’_a’ back to ’_p’ in constant time. ’_a’ must have
+   come from ’pool_alloc’ on the same pool, and can't be passed to
+   ’my_free’. */
+
+void pool_destroy(Pool* _p);
+/* Returns every chunk of ’_p’, and ’_p’ itself, with one ’my_free’ each.
+   Objects still in use are released with their chunk. */
+
+#endif
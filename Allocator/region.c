@@ -0,0 +1,180 @@
+/*
+    File: region.c
+
+    This file contains the implementation of the module "REGION".
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define EMPTY_ADDRESS 0x0
+
+#define REGION_ALIGN_SIZE 16
+#define alignedLength(length) (((length) + (REGION_ALIGN_SIZE - 1)) & ~(REGION_ALIGN_SIZE - 1))
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "region.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Every block of a region starts with a RegionBlock, chained back to the block before it.
+
+    The first block also holds the Region itself, right after its RegionBlock.
+
+    {[RegionBlock][Region]...objects...} <- {[RegionBlock]...objects...} <- ...
+ */
+typedef struct RegionBlock {
+    struct RegionBlock* previousBlock;
+    unsigned int order;                 //Order the block was asked for at, which may be past the largest order.
+    unsigned int length;                //Bytes asked from my_malloc, RegionBlock included.
+} RegionBlock;
+
+struct Region {
+    RegionBlock* firstBlock;
+    RegionBlock* currentBlock;
+    Addr cursor;                        //Next free byte in the current block.
+    Addr limit;                         //End of the current block.
+};
+
+/*--------------------------------------------------------------------------*/
+/* FORWARDS */
+/*--------------------------------------------------------------------------*/
+
+static RegionBlock* createRegionBlock(unsigned int order, unsigned int minimumLength);
+static Addr growRegion(Region* region, unsigned int length);
+static void releaseChainedBlocks(Region* region);
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Allocates a block of at least the given order that can also hold minimumLength bytes after its RegionBlock.
+
+    When no order is large enough, the block is asked for at exactly the length it needs.
+ */
+static RegionBlock* createRegionBlock(unsigned int order, unsigned int minimumLength)
+{
+    unsigned int neededLength = alignedLength(sizeof(RegionBlock)) + minimumLength;
+    unsigned int length = my_allocator_order_size(order);
+
+    while(length != 0 && length < neededLength)
+    {
+        order += 1;
+        length = my_allocator_order_size(order);
+    }
+
+    if(length == 0)
+    {
+        length = neededLength;
+    }
+
+    RegionBlock* block = my_malloc(length);
+
+    if(block != EMPTY_ADDRESS)
+    {
+        block->previousBlock = EMPTY_ADDRESS;
+        block->order = order;
+        block->length = length;
+    }
+
+    return block;
+}
+
+/*
+    Chains on a new block, twice the size of the current one, and hands out the first length bytes of it.
+ */
+static Addr growRegion(Region* region, unsigned int length)
+{
+    RegionBlock* block = createRegionBlock(region->currentBlock->order + 1, length);
+
+    if(block == EMPTY_ADDRESS)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    block->previousBlock = region->currentBlock;
+    region->currentBlock = block;
+
+    Addr address = (Addr)block + alignedLength(sizeof(RegionBlock));
+    region->cursor = address + length;
+    region->limit = (Addr)block + block->length;
+
+    return address;
+}
+
+/*
+    Frees every block after the first one, newest first.
+ */
+static void releaseChainedBlocks(Region* region)
+{
+    RegionBlock* block = region->currentBlock;
+
+    while(block != region->firstBlock)
+    {
+        RegionBlock* previousBlock = block->previousBlock;
+        my_free(block);
+        block = previousBlock;
+    }
+
+    region->currentBlock = region->firstBlock;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE REGION */
+/*--------------------------------------------------------------------------*/
+
+Region* region_create(unsigned int initial_order) {
+
+    RegionBlock* block = createRegionBlock(initial_order, alignedLength(sizeof(Region)));
+
+    if(block == EMPTY_ADDRESS)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    Region* region = (Addr)block + alignedLength(sizeof(RegionBlock));
+
+    region->firstBlock = block;
+    region->currentBlock = block;
+    region_reset(region);
+
+    return region;
+}
+
+Addr region_alloc(Region* region, unsigned int length) {
+
+    length = alignedLength(length);
+
+    //The pointer bump is all that most allocations take.
+    if((unsigned long)(region->limit - region->cursor) >= length)
+    {
+        Addr address = region->cursor;
+        region->cursor += length;
+        return address;
+    }
+
+    return growRegion(region, length);
+}
+
+void region_reset(Region* region) {
+
+    releaseChainedBlocks(region);
+
+    region->cursor = (Addr)region + alignedLength(sizeof(Region));
+    region->limit = (Addr)region->firstBlock + region->firstBlock->length;
+}
+
+void region_destroy(Region* region) {
+
+    releaseChainedBlocks(region);
+    my_free(region->firstBlock);
+}
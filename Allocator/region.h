@@ -0,0 +1,52 @@
+/*
+    File: region.h
+
+    Bump pointer regions carved from allocator blocks, for objects that all die together.
+
+*/
+
+#ifndef _region_h_                   // include file only once
+#define _region_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "my_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+typedef struct Region Region;
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   REGION */
+/*--------------------------------------------------------------------------*/
+
+Region* region_create(unsigned int _initial_order);
+/* Takes one block of (adjusted) freestore index ’_initial_order’ from
+   my_malloc and starts a region in it. The region keeps its own state at
+   the front of that block. Returns 0 when the block can't be allocated. */
+
+Addr region_alloc(Region* _r, unsigned int _length);
+/* Hands out ’_length’ bytes, 16 byte aligned, by bumping a pointer. When
+   the current block runs out, another block of the next order up (or one
+   large enough for ’_length’) is chained on. Memory from a region can't
+   be passed to ’my_free’. Returns 0 when out of memory. */
+
+void region_reset(Region* _r);
+/* Frees everything allocated from ’_r’ at once. Every chained block goes
+   back with one ’my_free’ each, and the first block is kept for reuse. */
+
+void region_destroy(Region* _r);
+/* Same as ’region_reset’, then also returns the first block. ’_r’ can't
+   be used afterwards. */
+
+#endif
@@ -0,0 +1,569 @@
+/*
+    File: tlsf_allocator.c
+
+    This file contains the implementation of the module "TLSF_ALLOCATOR".
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define EMPTY_ADDRESS 0x0
+
+#define ALIGN_SHIFT 4                                       //Blocks and sizes are 16 byte aligned.
+#define ALIGN_SIZE (1 << ALIGN_SHIFT)
+#define SL_INDEX_COUNT_SHIFT 4                              //Second level lists per power of two.
+#define SL_INDEX_COUNT (1 << SL_INDEX_COUNT_SHIFT)
+#define FL_INDEX_SHIFT (SL_INDEX_COUNT_SHIFT + ALIGN_SHIFT)
+#define FL_INDEX_MAX 32                                     //Sizes stay below 2^32, like the lengths handed in.
+#define FL_INDEX_COUNT (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE (1 << FL_INDEX_SHIFT)              //Below this, the second level steps linearly.
+
+#define BLOCK_FREE_BIT 0x1
+#define BLOCK_PREVIOUS_FREE_BIT 0x2
+#define BLOCK_FLAG_MASK (ALIGN_SIZE - 1)
+
+#define BITMAP_WORD_BITS (8 * sizeof(unsigned long))
+
+#define BLOCK_HEADER_OVERHEAD (offsetof(TlsfBlock, nextFree))
+#define BLOCK_SIZE_MIN (sizeof(TlsfBlock) - BLOCK_HEADER_OVERHEAD)
+
+typedef enum { false, true } bool;
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <stddef.h>
+#include "tlsf_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/*
+    Every block, free or used, starts with the size of its payload. The low bits of the size flag whether
+    the block itself and the block physically before it are free.
+
+    When the block before is free, previousPhysical points at it. That's the boundary tag that lets a freed
+    block merge with its left neighbour without a search. The free list links live in the payload, so a used
+    block only pays for the first two fields.
+
+    {[previousPhysical][size]...payload...}
+
+    The memory ends with a zero size sentinel block that is never free, so merging right always stops there.
+ */
+typedef struct TlsfBlock {
+    struct TlsfBlock* previousPhysical;     //Only valid while the previous block is free.
+    unsigned long size;
+    struct TlsfBlock* nextFree;             //Only valid while this block is free.
+    struct TlsfBlock* previousFree;
+} TlsfBlock;
+
+/*--------------------------------------------------------------------------*/
+/* CONSTANTS */
+/*--------------------------------------------------------------------------*/
+
+/* -- Definitions -- */
+    static Addr _memoryStart;
+    static Addr _memoryEnd;
+    static unsigned long* _allocationBitmap;                        //Bit per ALIGN_SIZE bytes, set where an allocated payload starts.
+
+/* -- Free Lists -- */
+    static unsigned int _flBitmap;                                  //Bit per first level with any free block.
+    static unsigned int _slBitmap[FL_INDEX_COUNT];                  //Bit per second level list with a free block.
+    static TlsfBlock* _freeBlocks[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+/* -- Sizes -- */
+    static unsigned long _freeBytes;
+
+/*--------------------------------------------------------------------------*/
+/* FORWARDS */
+/*--------------------------------------------------------------------------*/
+
+//Bit Math
+static unsigned int findLastSet(unsigned long word);
+static unsigned int findFirstSet(unsigned int word);
+
+//Block Accessors
+static unsigned long getBlockSize(TlsfBlock* block);
+static void setBlockSize(TlsfBlock* block, unsigned long size);
+static bool blockIsFree(TlsfBlock* block);
+static Addr getBlockPayload(TlsfBlock* block);
+static TlsfBlock* getBlockForPayload(Addr payload);
+static TlsfBlock* getNextPhysicalBlock(TlsfBlock* block);
+static void markBlockFree(TlsfBlock* block);
+static void markBlockUsed(TlsfBlock* block);
+static bool isAllocatedPayload(Addr payload);
+static void setPayloadAllocated(Addr payload, bool allocated);
+
+//Index Math
+static void mappingInsert(unsigned long size, unsigned int* fl, unsigned int* sl);
+static void mappingSearch(unsigned long size, unsigned int* fl, unsigned int* sl);
+
+//Free Lists
+static void insertFreeBlock(TlsfBlock* block);
+static void removeFreeBlock(TlsfBlock* block);
+static TlsfBlock* searchSuitableBlock(unsigned int* fl, unsigned int* sl);
+
+//Split and Merge
+static void trimFreeBlock(TlsfBlock* block, unsigned long size);
+static TlsfBlock* trimFreeBlockLeading(TlsfBlock* block, unsigned long gap);
+static TlsfBlock* mergeFreeNeighbours(TlsfBlock* block);
+
+/*--------------------------------------------------------------------------*/
+// SUPPORT FUNCTIONS
+/*--------------------------------------------------------------------------*/
+
+static unsigned int findLastSet(unsigned long word)
+{
+    return (sizeof(unsigned long) * 8) - 1 - __builtin_clzl(word);
+}
+
+static unsigned int findFirstSet(unsigned int word)
+{
+    return __builtin_ctz(word);
+}
+
+static unsigned long getBlockSize(TlsfBlock* block)
+{
+    return (block->size & ~((unsigned long)BLOCK_FLAG_MASK));
+}
+
+static void setBlockSize(TlsfBlock* block, unsigned long size)
+{
+    block->size = (block->size & BLOCK_FLAG_MASK) | size;
+}
+
+static bool blockIsFree(TlsfBlock* block)
+{
+    return (block->size & BLOCK_FREE_BIT) ? true : false;
+}
+
+static Addr getBlockPayload(TlsfBlock* block)
+{
+    return ((Addr)block + BLOCK_HEADER_OVERHEAD);
+}
+
+static TlsfBlock* getBlockForPayload(Addr payload)
+{
+    return (TlsfBlock*)(payload - BLOCK_HEADER_OVERHEAD);
+}
+
+static TlsfBlock* getNextPhysicalBlock(TlsfBlock* block)
+{
+    return (TlsfBlock*)(getBlockPayload(block) + getBlockSize(block));
+}
+
+/*
+    Flags the block free, and leaves the boundary tag for the block after it.
+ */
+static void markBlockFree(TlsfBlock* block)
+{
+    TlsfBlock* nextBlock = getNextPhysicalBlock(block);
+
+    block->size |= BLOCK_FREE_BIT;
+    nextBlock->previousPhysical = block;
+    nextBlock->size |= BLOCK_PREVIOUS_FREE_BIT;
+}
+
+static void markBlockUsed(TlsfBlock* block)
+{
+    TlsfBlock* nextBlock = getNextPhysicalBlock(block);
+
+    block->size &= ~((unsigned long)BLOCK_FREE_BIT);
+    nextBlock->size &= ~((unsigned long)BLOCK_PREVIOUS_FREE_BIT);
+}
+
+/*
+    Returns true if the payload lies in the memory and an allocated block starts there.
+
+    The bitmap is only written by tlsf_malloc and tlsf_free, so unlike the free flag in a header,
+    it can't be left stale by a merge or overwritten through a dangling pointer.
+ */
+static bool isAllocatedPayload(Addr payload)
+{
+    if(payload < (_memoryStart + BLOCK_HEADER_OVERHEAD) || payload >= _memoryEnd || ((unsigned long)payload & BLOCK_FLAG_MASK) != 0)
+    {
+        return false;
+    }
+
+    unsigned long granule = ((payload - _memoryStart) >> ALIGN_SHIFT);
+    return ((_allocationBitmap[granule / BITMAP_WORD_BITS] >> (granule % BITMAP_WORD_BITS)) & 1) ? true : false;
+}
+
+static void setPayloadAllocated(Addr payload, bool allocated)
+{
+    unsigned long granule = ((payload - _memoryStart) >> ALIGN_SHIFT);
+    unsigned long bit = (1UL << (granule % BITMAP_WORD_BITS));
+
+    if(allocated)
+    {
+        _allocationBitmap[granule / BITMAP_WORD_BITS] |= bit;
+    } else {
+        _allocationBitmap[granule / BITMAP_WORD_BITS] &= ~bit;
+    }
+}
+
+/*
+    Returns the list a free block of the given size belongs in.
+
+    The first level is the power of two of the size, and the second level splits that power of two
+    into SL_INDEX_COUNT equal ranges. Small sizes all share the first level, in ALIGN_SIZE steps.
+ */
+static void mappingInsert(unsigned long size, unsigned int* fl, unsigned int* sl)
+{
+    if(size < SMALL_BLOCK_SIZE)
+    {
+        *fl = 0;
+        *sl = (unsigned int)(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+    } else {
+        unsigned int lastSet = findLastSet(size);
+        *sl = (unsigned int)((size >> (lastSet - SL_INDEX_COUNT_SHIFT)) ^ SL_INDEX_COUNT);
+        *fl = lastSet - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+/*
+    Returns the first list whose every block is large enough for the size, by rounding the size up to the next list.
+ */
+static void mappingSearch(unsigned long size, unsigned int* fl, unsigned int* sl)
+{
+    if(size >= SMALL_BLOCK_SIZE)
+    {
+        unsigned long round = (1UL << (findLastSet(size) - SL_INDEX_COUNT_SHIFT)) - 1;
+        size += round;
+    }
+
+    mappingInsert(size, fl, sl);
+}
+
+/*--------------------------------------------------------------------------*/
+// FREE LISTS
+/*--------------------------------------------------------------------------*/
+
+static void insertFreeBlock(TlsfBlock* block)
+{
+    unsigned int fl, sl;
+    mappingInsert(getBlockSize(block), &fl, &sl);
+
+    TlsfBlock* firstBlock = _freeBlocks[fl][sl];
+
+    block->nextFree = firstBlock;
+    block->previousFree = EMPTY_ADDRESS;
+
+    if(firstBlock != EMPTY_ADDRESS)
+    {
+        firstBlock->previousFree = block;
+    }
+
+    _freeBlocks[fl][sl] = block;
+    _flBitmap |= (1U << fl);
+    _slBitmap[fl] |= (1U << sl);
+
+    _freeBytes += getBlockSize(block) + BLOCK_HEADER_OVERHEAD;
+}
+
+static void removeFreeBlock(TlsfBlock* block)
+{
+    unsigned int fl, sl;
+    mappingInsert(getBlockSize(block), &fl, &sl);
+
+    if(block->previousFree != EMPTY_ADDRESS)
+    {
+        block->previousFree->nextFree = block->nextFree;
+    } else {
+        _freeBlocks[fl][sl] = block->nextFree;
+
+        //Clear the bitmaps once the list runs empty.
+        if(block->nextFree == EMPTY_ADDRESS)
+        {
+            _slBitmap[fl] &= ~(1U << sl);
+
+            if(_slBitmap[fl] == 0)
+            {
+                _flBitmap &= ~(1U << fl);
+            }
+        }
+    }
+
+    if(block->nextFree != EMPTY_ADDRESS)
+    {
+        block->nextFree->previousFree = block->previousFree;
+    }
+
+    _freeBytes -= getBlockSize(block) + BLOCK_HEADER_OVERHEAD;
+}
+
+/*
+    Finds the first non-empty list at or after (fl, sl) with two bitmap scans, and updates fl and sl to it.
+ */
+static TlsfBlock* searchSuitableBlock(unsigned int* fl, unsigned int* sl)
+{
+    unsigned int slMap = _slBitmap[*fl] & (~0U << *sl);
+
+    if(slMap == 0)
+    {
+        //Nothing left on this level, so take the smallest list of the next level that has anything.
+        unsigned int flMap = (*fl + 1 < 32) ? (_flBitmap & (~0U << (*fl + 1))) : 0;
+
+        if(flMap == 0)
+        {
+            return EMPTY_ADDRESS;
+        }
+
+        *fl = findFirstSet(flMap);
+        slMap = _slBitmap[*fl];
+    }
+
+    *sl = findFirstSet(slMap);
+
+    return _freeBlocks[*fl][*sl];
+}
+
+/*--------------------------------------------------------------------------*/
+// SPLIT AND MERGE
+/*--------------------------------------------------------------------------*/
+
+/*
+    Cuts the block down to size, returning the tail to the free lists when it can hold a block of its own.
+ */
+static void trimFreeBlock(TlsfBlock* block, unsigned long size)
+{
+    unsigned long blockSize = getBlockSize(block);
+
+    if(blockSize >= (size + sizeof(TlsfBlock)))
+    {
+        TlsfBlock* remainingBlock = (TlsfBlock*)(getBlockPayload(block) + size);
+
+        remainingBlock->size = (blockSize - size - BLOCK_HEADER_OVERHEAD);
+        setBlockSize(block, size);
+
+        markBlockFree(remainingBlock);
+        insertFreeBlock(remainingBlock);
+    }
+}
+
+/*
+    Cuts the first gap bytes off the block and returns them to the free lists, and returns the block that's left.
+
+    The block came off the free lists, so the block before it is in use and the gap can't merge with anything.
+ */
+static TlsfBlock* trimFreeBlockLeading(TlsfBlock* block, unsigned long gap)
+{
+    TlsfBlock* remainingBlock = (TlsfBlock*)((Addr)block + gap);
+
+    remainingBlock->size = (getBlockSize(block) - gap);
+    setBlockSize(block, gap - BLOCK_HEADER_OVERHEAD);
+
+    markBlockFree(block);
+    insertFreeBlock(block);
+
+    return remainingBlock;
+}
+
+/*
+    Merges a block that was just freed with the free blocks on either side of it, and returns the merged block.
+ */
+static TlsfBlock* mergeFreeNeighbours(TlsfBlock* block)
+{
+    block->size |= BLOCK_FREE_BIT;
+
+    if(block->size & BLOCK_PREVIOUS_FREE_BIT)
+    {
+        TlsfBlock* previousBlock = block->previousPhysical;
+
+        removeFreeBlock(previousBlock);
+        setBlockSize(previousBlock, getBlockSize(previousBlock) + BLOCK_HEADER_OVERHEAD + getBlockSize(block));
+        block = previousBlock;
+    }
+
+    TlsfBlock* nextBlock = getNextPhysicalBlock(block);
+
+    if(blockIsFree(nextBlock))
+    {
+        removeFreeBlock(nextBlock);
+        setBlockSize(block, getBlockSize(block) + BLOCK_HEADER_OVERHEAD + getBlockSize(nextBlock));
+    }
+
+    return block;
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE TLSF_ALLOCATOR */
+/*--------------------------------------------------------------------------*/
+
+unsigned int tlsf_init(Addr memory, unsigned int length) {
+
+    unsigned long misalignment = ((unsigned long)memory & (ALIGN_SIZE - 1));
+    Addr start = (misalignment > 0) ? (memory + (ALIGN_SIZE - misalignment)) : memory;
+    Addr end = (memory + length);
+
+    //The allocation bitmap goes first. It covers a little more than the blocks after it, which is harmless.
+    unsigned long bitmapWords = ((length >> ALIGN_SHIFT) + BITMAP_WORD_BITS) / BITMAP_WORD_BITS;
+    unsigned long bitmapSize = (bitmapWords * sizeof(unsigned long) + ALIGN_SIZE - 1) & ~((unsigned long)BLOCK_FLAG_MASK);
+
+    _allocationBitmap = start;
+    start += bitmapSize;
+
+    _flBitmap = 0;
+    _freeBytes = 0;
+
+    for(unsigned int i = 0; i < FL_INDEX_COUNT; i++)
+    {
+        _slBitmap[i] = 0;
+
+        for(unsigned int j = 0; j < SL_INDEX_COUNT; j++)
+        {
+            _freeBlocks[i][j] = EMPTY_ADDRESS;
+        }
+    }
+
+    if(end < start + (2 * BLOCK_HEADER_OVERHEAD) + BLOCK_SIZE_MIN)
+    {
+        return 0;
+    }
+
+    for(unsigned long i = 0; i < bitmapWords; i++)
+    {
+        _allocationBitmap[i] = 0;
+    }
+
+    //One free block over everything, followed by the sentinel.
+    unsigned long blockSize = ((end - start) - (2 * BLOCK_HEADER_OVERHEAD)) & ~((unsigned long)BLOCK_FLAG_MASK);
+    TlsfBlock* block = start;
+
+    block->size = blockSize;
+
+    TlsfBlock* sentinelBlock = getNextPhysicalBlock(block);
+    sentinelBlock->size = 0;
+
+    markBlockFree(block);
+    insertFreeBlock(block);
+
+    _memoryStart = start;
+    _memoryEnd = (Addr)sentinelBlock;
+
+    return (unsigned int)blockSize;
+}
+
+Addr tlsf_malloc(unsigned int length) {
+
+    unsigned long size = (length > BLOCK_SIZE_MIN) ? length : BLOCK_SIZE_MIN;
+    size = (size + ALIGN_SIZE - 1) & ~((unsigned long)BLOCK_FLAG_MASK);
+
+    unsigned int fl, sl;
+    mappingSearch(size, &fl, &sl);
+
+    if(fl >= FL_INDEX_COUNT)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    TlsfBlock* block = searchSuitableBlock(&fl, &sl);
+
+    if(block == EMPTY_ADDRESS)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    removeFreeBlock(block);
+    trimFreeBlock(block, size);
+    markBlockUsed(block);
+    setPayloadAllocated(getBlockPayload(block), true);
+
+    return getBlockPayload(block);
+}
+
+Addr tlsf_malloc_aligned(unsigned int length, unsigned int alignment) {
+
+    if(alignment <= ALIGN_SIZE)
+    {
+        return tlsf_malloc(length);
+    }
+
+    unsigned long size = (length > BLOCK_SIZE_MIN) ? length : BLOCK_SIZE_MIN;
+    size = (size + ALIGN_SIZE - 1) & ~((unsigned long)BLOCK_FLAG_MASK);
+
+    //Room to move up to the alignment, while leaving a gap large enough to be a free block of its own.
+    unsigned long searchSize = size + alignment + sizeof(TlsfBlock);
+
+    unsigned int fl, sl;
+    mappingSearch(searchSize, &fl, &sl);
+
+    if(fl >= FL_INDEX_COUNT)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    TlsfBlock* block = searchSuitableBlock(&fl, &sl);
+
+    if(block == EMPTY_ADDRESS)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    removeFreeBlock(block);
+
+    unsigned long payload = (unsigned long)getBlockPayload(block);
+    unsigned long alignedPayload = (payload + (alignment - 1)) & ~((unsigned long)alignment - 1);
+
+    if(alignedPayload != payload)
+    {
+        if((alignedPayload - payload) < sizeof(TlsfBlock))
+        {
+            alignedPayload = (payload + sizeof(TlsfBlock) + (alignment - 1)) & ~((unsigned long)alignment - 1);
+        }
+
+        block = trimFreeBlockLeading(block, alignedPayload - payload);
+    }
+
+    trimFreeBlock(block, size);
+    markBlockUsed(block);
+    setPayloadAllocated(getBlockPayload(block), true);
+
+    return getBlockPayload(block);
+}
+
+int tlsf_free(Addr address) {
+
+    //Double frees, interior pointers and foreign pointers all stop here, before any list is touched.
+    if(!isAllocatedPayload(address))
+    {
+        return 1;
+    }
+
+    TlsfBlock* block = getBlockForPayload(address);
+    setPayloadAllocated(address, false);
+
+    block = mergeFreeNeighbours(block);
+    markBlockFree(block);
+    insertFreeBlock(block);
+
+    return 0;
+}
+
+unsigned int tlsf_block_size(Addr address) {
+
+    if(!isAllocatedPayload(address))
+    {
+        return 0;
+    }
+
+    return (unsigned int)(getBlockSize(getBlockForPayload(address)) + BLOCK_HEADER_OVERHEAD);
+}
+
+unsigned int tlsf_usable_size(Addr address) {
+
+    if(!isAllocatedPayload(address))
+    {
+        return 0;
+    }
+
+    return (unsigned int)getBlockSize(getBlockForPayload(address));
+}
+
+unsigned long tlsf_free_bytes(void) {
+    return _freeBytes;
+}
@@ -0,0 +1,65 @@
+/*
+    File: tlsf_allocator.h
+
+    Two-Level Segregated Fit engine behind my_malloc/my_free.
+
+*/
+
+#ifndef _tlsf_allocator_h_                   // include file only once
+#define _tlsf_allocator_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "my_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   TLSF_ALLOCATOR */
+/*--------------------------------------------------------------------------*/
+
+unsigned int tlsf_init(Addr _memory, unsigned int _length);
+/* Lays a single free block over the ’_length’ bytes at ’_memory’. The
+   memory stays owned by the caller. Returns the number of bytes that can
+   be handed out, or 0 if the memory is too small to hold a block.
+*/
+
+Addr tlsf_malloc(unsigned int _length);
+/* Allocates ’_length’ bytes in constant time, with the same good-fit
+   search no matter how full or fragmented the memory is. Returns 0 when
+   no free block is large enough. */
+
+Addr tlsf_malloc_aligned(unsigned int _length, unsigned int _alignment);
+/* Same as ’tlsf_malloc’, but the returned address is a multiple of the
+   power of two ’_alignment’. The gap in front of it goes back to the free
+   lists as a block of its own. */
+
+int tlsf_free(Addr _a);
+/* Frees a block returned by ’tlsf_malloc’ and merges it with its free
+   physical neighbours, in constant time. Returns 0 if everything ok, and
+   1 if ’_a’ is not an allocated block. */
+
+unsigned int tlsf_block_size(Addr _a);
+/* Returns the bytes held by the allocated block at ’_a’, header included,
+   or 0 if ’_a’ is not an allocated block. */
+
+unsigned int tlsf_usable_size(Addr _a);
+/* Returns the bytes the allocated block at ’_a’ can hold from ’_a’ on,
+   or 0 if ’_a’ is not an allocated block. */
+
+unsigned long tlsf_free_bytes(void);
+/* Returns the bytes held by free blocks, headers included. */
+
+#endif
@@ -0,0 +1,461 @@
+/*
+    File: tree_buddy.c
+
+    This file contains the implementation of the module "TREE_BUDDY".
+
+*/
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+#define EMPTY_ADDRESS 0x0
+
+#define TREE_MIN_BLOCK_SIZE 16                  //Same alignment my_malloc gives with the other engines.
+#define TREE_PAGE_SIZE 4096                     //Blocks start on a page, so any order is page aligned from there on.
+#define TREE_LINE_SIZE 64
+#define TREE_LINE_LEVELS 6                      //A subtree of 6 levels is 63 nodes, one cache line with a byte to spare.
+#define TREE_MAX_HEIGHT 31
+#define TREE_MAX_LINE_LEVELS (1 + ((TREE_MAX_HEIGHT + TREE_LINE_LEVELS - 1) / TREE_LINE_LEVELS))
+#define NOTHING_FREE 0
+
+#define alignUp(value, alignment) (((value) + (alignment) - 1) & ~((unsigned long)(alignment) - 1))
+
+typedef enum { false, true } bool;
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include <string.h>
+#include "tree_buddy.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/*
+    A node at depth d covers 1 << (_treeHeight - d) of the smallest blocks, so its order is _treeHeight - d.
+    Its byte holds the largest free order under it, plus one, with NOTHING_FREE when there is none. A node
+    that is free as a whole holds its own order plus one; an allocated node holds NOTHING_FREE, and the nodes
+    under it keep the values they had when it was taken, which are all "free as a whole".
+
+    Nodes are stored in cache lines of 6 levels each, breadth first within the line. The top line holds the
+    first 1 to 6 levels, so that every line below it is full. A descent from the root touches a line every
+    6 levels instead of one per level, and the 2^6 lines under a line sit next to each other.
+
+    Smallest blocks past the end of the memory are leaves with NOTHING_FREE, so the tree can always be a
+    full power of two.
+ */
+
+/*--------------------------------------------------------------------------*/
+/* CONSTANTS */
+/*--------------------------------------------------------------------------*/
+
+/* -- Definitions -- */
+    static Addr _heapStart;
+    static unsigned long _blockCount;                   //Smallest blocks in the memory.
+    static unsigned int _minBlockSize;
+    static unsigned int _treeHeight;                    //Depth of the leaves, and order of the root.
+    static unsigned int _orderCount;
+
+/* -- Tree -- */
+    static unsigned char* _tree;
+    static unsigned int _topLevels;                     //Levels in the top line.
+    static unsigned long _lineLevelOffsets[TREE_MAX_LINE_LEVELS];
+    static unsigned long _depthLineOffsets[TREE_MAX_HEIGHT + 1];    //Offset of the line level each depth is in.
+    static unsigned char _depthLocalDepths[TREE_MAX_HEIGHT + 1];    //Depth within its line.
+
+/* -- Statistics -- */
+    static unsigned long _freeBytes;
+    static unsigned long _splitCount;
+    static unsigned long _mergeCount;
+
+/*--------------------------------------------------------------------------*/
+/* FORWARDS */
+/*--------------------------------------------------------------------------*/
+
+/* Geometry */
+unsigned long treeOrderSize(unsigned int order);
+unsigned int treeOrderForLength(unsigned long length);
+unsigned long treeLayout(unsigned int height);
+
+/* Nodes */
+unsigned char* treeNode(unsigned int depth, unsigned long position);
+unsigned char treeWholeValue(unsigned int depth);
+void treeUpdateAncestors(unsigned int depth, unsigned long position, bool countMerges);
+bool treeAllocatedNode(Addr address, unsigned int* depth, unsigned long* position);
+Addr treeAllocateOrder(unsigned int order);
+unsigned long treeCountWholeNodes(unsigned int depth, unsigned long position, unsigned int targetDepth);
+
+/*--------------------------------------------------------------------------*/
+/* SUPPORT FUNCTIONS FOR MODULE TREE_BUDDY */
+/*--------------------------------------------------------------------------*/
+
+unsigned long treeOrderSize(unsigned int order)
+{
+    return ((unsigned long)_minBlockSize << order);
+}
+
+/*
+    Returns the smallest order whose blocks hold the length, or _orderCount if none does.
+ */
+unsigned int treeOrderForLength(unsigned long length)
+{
+    unsigned int order = 0;
+
+    while(order < _orderCount && treeOrderSize(order) < length)
+    {
+        order++;
+    }
+
+    return order;
+}
+
+/*
+    Sets the line layout for a tree with leaves at the height, and returns the bytes it takes.
+ */
+unsigned long treeLayout(unsigned int height)
+{
+    unsigned int levels = height + 1;
+    unsigned long lineCount = 1;
+    unsigned long offset = TREE_LINE_SIZE;
+
+    _topLevels = ((levels - 1) % TREE_LINE_LEVELS) + 1;
+    _lineLevelOffsets[0] = 0;
+
+    //The top line has 2^_topLevels lines under it, and every full line 2^6.
+    lineCount <<= _topLevels;
+
+    for(unsigned int line = 1; line < TREE_MAX_LINE_LEVELS && _topLevels + ((line - 1) * TREE_LINE_LEVELS) < levels; line++)
+    {
+        _lineLevelOffsets[line] = offset;
+        offset += (lineCount * TREE_LINE_SIZE);
+        lineCount <<= TREE_LINE_LEVELS;
+    }
+
+    //Looked up on every node access, instead of dividing by the line levels each time.
+    for(unsigned int depth = 0; depth < levels; depth++)
+    {
+        unsigned int lineLevel = (depth < _topLevels) ? 0 : 1 + ((depth - _topLevels) / TREE_LINE_LEVELS);
+
+        _depthLineOffsets[depth] = _lineLevelOffsets[lineLevel];
+        _depthLocalDepths[depth] = (unsigned char)((depth < _topLevels) ? depth : ((depth - _topLevels) % TREE_LINE_LEVELS));
+    }
+
+    return offset;
+}
+
+/* Nodes */
+
+/*
+    Returns the byte of the node at the depth, position nodes from the left of its level.
+ */
+unsigned char* treeNode(unsigned int depth, unsigned long position)
+{
+    unsigned int localDepth = _depthLocalDepths[depth];
+    unsigned long line = (position >> localDepth);
+
+    //The top line is the only one at its level, so its line is always 0.
+    return &_tree[_depthLineOffsets[depth] + (line * TREE_LINE_SIZE) + (1UL << localDepth) + (position & ((1UL << localDepth) - 1))];
+}
+
+/*
+    Value of a node at the depth that is free as a whole.
+ */
+unsigned char treeWholeValue(unsigned int depth)
+{
+    return (unsigned char)(_treeHeight - depth + 1);
+}
+
+/*
+    Recomputes the nodes above the one at the depth and position, up to the first one that doesn't change.
+    Two buddies that are both free as a whole make their parent free as a whole, which is a merge.
+ */
+void treeUpdateAncestors(unsigned int depth, unsigned long position, bool countMerges)
+{
+    while(depth > 0)
+    {
+        unsigned char left = *treeNode(depth, position & ~1UL);
+        unsigned char right = *treeNode(depth, position | 1UL);
+        unsigned char whole = treeWholeValue(depth);
+        unsigned char value = (left > right) ? left : right;
+
+        depth--;
+        position >>= 1;
+
+        if(left == whole && right == whole)
+        {
+            value = treeWholeValue(depth);
+
+            if(countMerges){
+                _mergeCount++;
+            }
+        }
+
+        unsigned char* node = treeNode(depth, position);
+
+        if(*node == value)
+        {
+            return;
+        }
+
+        *node = value;
+    }
+}
+
+/*
+    Finds the allocated node whose block starts at the address. Below an allocated node, every node is marked
+    free as a whole, so walking up from its first leaf, the first NOTHING_FREE is that node. A right child on
+    the way means the block would start before the address.
+ */
+bool treeAllocatedNode(Addr address, unsigned int* depth, unsigned long* position)
+{
+    if(_orderCount == 0 || address < _heapStart || address >= _heapStart + (_blockCount * _minBlockSize))
+    {
+        return false;
+    }
+
+    unsigned long offset = (unsigned long)(address - _heapStart);
+
+    if((offset % _minBlockSize) != 0)
+    {
+        return false;
+    }
+
+    unsigned int nodeDepth = _treeHeight;
+    unsigned long nodePosition = (offset / _minBlockSize);
+
+    while(*treeNode(nodeDepth, nodePosition) != NOTHING_FREE)
+    {
+        if(nodeDepth == 0 || (nodePosition & 1) != 0)
+        {
+            return false;
+        }
+
+        nodeDepth--;
+        nodePosition >>= 1;
+    }
+
+    *depth = nodeDepth;
+    *position = nodePosition;
+    return true;
+}
+
+/*
+    Descends from the root to the leftmost node of the order that is free as a whole, and takes it.
+ */
+Addr treeAllocateOrder(unsigned int order)
+{
+    unsigned char needed = (unsigned char)(order + 1);
+
+    if(order >= _orderCount || *treeNode(0, 0) < needed)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    unsigned int depth = 0;
+    unsigned long position = 0;
+    unsigned int targetDepth = (_treeHeight - order);
+
+    while(depth < targetDepth)
+    {
+        //Coming down through a node that was free as a whole splits it.
+        if(*treeNode(depth, position) == treeWholeValue(depth)){
+            _splitCount++;
+        }
+
+        depth++;
+        position <<= 1;
+
+        if(*treeNode(depth, position) < needed){
+            position |= 1;
+        }
+    }
+
+    *treeNode(depth, position) = NOTHING_FREE;
+    treeUpdateAncestors(depth, position, false);
+    _freeBytes -= treeOrderSize(order);
+
+    return (_heapStart + ((position << order) * _minBlockSize));
+}
+
+/*
+    Counts the free blocks at the target depth under the node. The nodes under an allocated one still read as
+    free, so the walk only goes down through nodes that have something free and aren't free as a whole.
+ */
+unsigned long treeCountWholeNodes(unsigned int depth, unsigned long position, unsigned int targetDepth)
+{
+    unsigned char value = *treeNode(depth, position);
+
+    if(value < treeWholeValue(targetDepth))
+    {
+        return 0;
+    }
+
+    if(value == treeWholeValue(depth))
+    {
+        return (depth == targetDepth) ? 1 : 0;
+    }
+
+    if(depth == targetDepth)
+    {
+        return 0;
+    }
+
+    return treeCountWholeNodes(depth + 1, position << 1, targetDepth) + treeCountWholeNodes(depth + 1, (position << 1) | 1, targetDepth);
+}
+
+/*--------------------------------------------------------------------------*/
+/* MAIN FUNCTIONS FOR MODULE TREE_BUDDY */
+/*--------------------------------------------------------------------------*/
+
+unsigned int tree_init(Addr memory, unsigned int length, unsigned int basic_block_size) {
+
+    _orderCount = 0;
+    _freeBytes = 0;
+    _splitCount = 0;
+    _mergeCount = 0;
+
+    if(memory == EMPTY_ADDRESS || basic_block_size == 0)
+    {
+        return 0;
+    }
+
+    _minBlockSize = TREE_MIN_BLOCK_SIZE;
+
+    while(_minBlockSize < basic_block_size)
+    {
+        _minBlockSize <<= 1;
+    }
+
+    Addr treeStart = (Addr)alignUp((unsigned long)memory, TREE_LINE_SIZE);
+    Addr memoryEnd = (memory + length);
+
+    if(treeStart >= memoryEnd)
+    {
+        return 0;
+    }
+
+    //Sized as if the blocks covered all of the memory, which is a little more than they will.
+    unsigned long available = (unsigned long)(memoryEnd - treeStart);
+    _treeHeight = 0;
+
+    while(_treeHeight < TREE_MAX_HEIGHT && treeOrderSize(_treeHeight) < available)
+    {
+        _treeHeight++;
+    }
+
+    unsigned long treeSize = treeLayout(_treeHeight);
+    _heapStart = (Addr)alignUp((unsigned long)(treeStart + treeSize), TREE_PAGE_SIZE);
+
+    if(_heapStart >= memoryEnd || (unsigned long)(memoryEnd - _heapStart) < _minBlockSize)
+    {
+        return 0;
+    }
+
+    _tree = treeStart;
+    _blockCount = (unsigned long)(memoryEnd - _heapStart) / _minBlockSize;
+    memset(_tree, NOTHING_FREE, treeSize);
+
+    while(_orderCount <= _treeHeight && (1UL << _orderCount) <= _blockCount)
+    {
+        _orderCount++;
+    }
+
+    //Leaves first, then every level from its children. Whole nodes past the memory stay NOTHING_FREE.
+    for(unsigned long position = 0; position < _blockCount; position++)
+    {
+        *treeNode(_treeHeight, position) = treeWholeValue(_treeHeight);
+    }
+
+    for(unsigned int depth = _treeHeight; depth-- > 0;)
+    {
+        unsigned long usedNodes = ((_blockCount - 1) >> (_treeHeight - depth)) + 1;
+
+        for(unsigned long position = 0; position < usedNodes; position++)
+        {
+            unsigned char left = *treeNode(depth + 1, position << 1);
+            unsigned char right = *treeNode(depth + 1, (position << 1) | 1);
+            unsigned char whole = treeWholeValue(depth + 1);
+
+            *treeNode(depth, position) = (left == whole && right == whole) ? treeWholeValue(depth) : ((left > right) ? left : right);
+        }
+    }
+
+    _freeBytes = (_blockCount * _minBlockSize);
+
+    return (unsigned int)_freeBytes;
+}
+
+Addr tree_malloc(unsigned int length) {
+
+    return treeAllocateOrder(treeOrderForLength((length > 0) ? length : 1));
+}
+
+Addr tree_malloc_aligned(unsigned int length, unsigned int alignment) {
+
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment > TREE_PAGE_SIZE)
+    {
+        return EMPTY_ADDRESS;
+    }
+
+    unsigned long size = (length > alignment) ? length : alignment;
+
+    return treeAllocateOrder(treeOrderForLength((size > 0) ? size : 1));
+}
+
+int tree_free(Addr a) {
+
+    unsigned int depth;
+    unsigned long position;
+
+    if(!treeAllocatedNode(a, &depth, &position))
+    {
+        return 1;
+    }
+
+    *treeNode(depth, position) = treeWholeValue(depth);
+    treeUpdateAncestors(depth, position, true);
+    _freeBytes += treeOrderSize(_treeHeight - depth);
+
+    return 0;
+}
+
+unsigned int tree_block_size(Addr a) {
+
+    unsigned int depth;
+    unsigned long position;
+
+    return treeAllocatedNode(a, &depth, &position) ? (unsigned int)treeOrderSize(_treeHeight - depth) : 0;
+}
+
+unsigned int tree_order_count(void) {
+
+    return _orderCount;
+}
+
+unsigned int tree_order_size(unsigned int order) {
+
+    return (order < _orderCount) ? (unsigned int)treeOrderSize(order) : 0;
+}
+
+unsigned long tree_free_blocks(unsigned int order) {
+
+    return (order < _orderCount) ? treeCountWholeNodes(0, 0, (_treeHeight - order)) : 0;
+}
+
+unsigned long tree_free_bytes(void) {
+
+    return _freeBytes;
+}
+
+unsigned long tree_split_count(void) {
+
+    return _splitCount;
+}
+
+unsigned long tree_merge_count(void) {
+
+    return _mergeCount;
+}
@@ -0,0 +1,83 @@
+/*
+    File: tree_buddy.h
+
+    Buddy engine behind my_malloc/my_free that keeps the buddy tree as a
+    flat array of bytes, each the largest free order under its node, in
+    cache line sized subtrees. Allocations take the lowest address that
+    fits, and every call is O(log n).
+
+*/
+
+#ifndef _tree_buddy_h_                   // include file only once
+#define _tree_buddy_h_
+
+/*--------------------------------------------------------------------------*/
+/* DEFINES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* INCLUDES */
+/*--------------------------------------------------------------------------*/
+
+#include "my_allocator.h"
+
+/*--------------------------------------------------------------------------*/
+/* DATA STRUCTURES */
+/*--------------------------------------------------------------------------*/
+
+/* -- (none) -- */
+
+/*--------------------------------------------------------------------------*/
+/* MODULE   TREE_BUDDY */
+/*--------------------------------------------------------------------------*/
+
+unsigned int tree_init(Addr _memory, unsigned int _length, unsigned int _basic_block_size);
+/* Lays the tree at the front of the ’_length’ bytes at ’_memory’, and
+   the blocks over the rest, from the next page on. Blocks are
+   ’_basic_block_size’ rounded up to a power of two of 16 bytes or more.
+   The tree takes about two bytes per smallest block, and blocks carry
+   no header. The memory stays owned by the caller. Returns the number of
+   bytes the blocks cover, or 0 if the memory is too small. */
+
+Addr tree_malloc(unsigned int _length);
+/* Allocates ’_length’ bytes from the lowest addressed free block of the
+   smallest order that fits them. Returns 0 when no block is large
+   enough. Not thread safe. */
+
+Addr tree_malloc_aligned(unsigned int _length, unsigned int _alignment);
+/* Same as ’tree_malloc’, but the returned address is a multiple of the
+   power of two ’_alignment’. Blocks start at multiples of their size
+   from a page boundary on, so this only raises the order; alignments
+   beyond the page size are refused. */
+
+int tree_free(Addr _a);
+/* Returns the block starting at ’_a’ and merges it with its buddies.
+   Returns 0 if everything ok, and 1 if ’_a’ is not the start of an
+   allocated block. With no header, a second free is only caught until
+   the memory is handed out again. */
+
+unsigned int tree_block_size(Addr _a);
+/* Returns the bytes held by the allocated block starting at ’_a’, or 0
+   if ’_a’ is not the start of an allocated block. */
+
+unsigned int tree_order_count(void);
+/* Returns the number of orders with blocks in the memory. */
+
+unsigned int tree_order_size(unsigned int _order);
+/* Returns the block size of ’_order’, or 0 if there is no such order. */
+
+unsigned long tree_free_blocks(unsigned int _order);
+/* Returns the free blocks of ’_order’. Walks that level of the tree. */
+
+unsigned long tree_free_bytes(void);
+/* Returns the bytes held by free blocks. */
+
+unsigned long tree_split_count(void);
+/* Returns the number of blocks split since ’tree_init’. */
+
+unsigned long tree_merge_count(void);
+/* Returns the number of buddies merged since ’tree_init’. */
+
+#endif